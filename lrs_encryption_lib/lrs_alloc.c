@@ -0,0 +1,411 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "lrs_encryption_lib.h"
+
+// Allocators
+// Every heap allocation in the library goes through the calling thread's
+// allocator: the one installed with lrs_set_thread_allocator, else the process
+// default from lrs_set_allocator, else malloc and sodium_malloc. Buffers the
+// library returns (strings, hex) come from the same allocator and are released
+// with lrs_free.
+
+static void *default_alloc(void *ctx, size_t size) {
+    (void)ctx;
+    return malloc(size);
+}
+
+static void default_free(void *ctx, void *ptr) {
+    (void)ctx;
+    free(ptr);
+}
+
+static void *default_secure_alloc(void *ctx, size_t size) {
+    (void)ctx;
+    return sodium_malloc(size);
+}
+
+static void default_secure_free(void *ctx, void *ptr) {
+    (void)ctx;
+    sodium_free(ptr); // Zeroes before freeing
+}
+
+static const lrs_allocator_t default_allocator = {
+    default_alloc, default_free, default_secure_alloc, default_secure_free, NULL
+};
+
+static const lrs_allocator_t *process_allocator = NULL;
+static __thread const lrs_allocator_t *thread_allocator = NULL;
+
+// Install the process-wide default allocator (NULL restores malloc/sodium_malloc)
+void lrs_set_allocator(const lrs_allocator_t *allocator) {
+    __atomic_store_n(&process_allocator, allocator, __ATOMIC_RELEASE);
+}
+
+// Install an allocator for the calling thread only (NULL falls back to the
+// process default); returns the previous one so scopes can nest
+const lrs_allocator_t *lrs_set_thread_allocator(const lrs_allocator_t *allocator) {
+    const lrs_allocator_t *previous = thread_allocator;
+    thread_allocator = allocator;
+    return previous;
+}
+
+// The allocator in effect on the calling thread
+const lrs_allocator_t *lrs_current_allocator(void) {
+    if (thread_allocator) return thread_allocator;
+
+    const lrs_allocator_t *allocator = __atomic_load_n(&process_allocator, __ATOMIC_ACQUIRE);
+    return allocator ? allocator : &default_allocator;
+}
+
+void *lrs_alloc(size_t size) {
+    const lrs_allocator_t *allocator = lrs_current_allocator();
+    return allocator->alloc(allocator->ctx, size ? size : 1);
+}
+
+void lrs_free(void *ptr) {
+    if (!ptr) return;
+
+    const lrs_allocator_t *allocator = lrs_current_allocator();
+    allocator->free(allocator->ctx, ptr);
+}
+
+void *lrs_secure_alloc(size_t size) {
+    const lrs_allocator_t *allocator = lrs_current_allocator();
+    return allocator->secure_alloc(allocator->ctx, size);
+}
+
+void lrs_secure_free(void *ptr) {
+    if (!ptr) return;
+
+    const lrs_allocator_t *allocator = lrs_current_allocator();
+    allocator->secure_free(allocator->ctx, ptr);
+}
+
+// Bump arena
+// Allocations are carved from a chain of blocks and never freed one by one;
+// lrs_arena_reset rewinds to the first block in O(1) and keeps the blocks for
+// reuse. Secure allocations bypass the arena (sodium_malloc), so keys keep their
+// guard pages and are wiped when the library releases them.
+#define ARENA_ALIGN 16
+#define ARENA_BLOCK_DEFAULT (256 * 1024)
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGN) unsigned char data[];
+} arena_block_t;
+
+struct lrs_arena {
+    lrs_allocator_t allocator;    // Vtable bound to this arena
+    arena_block_t *first;
+    arena_block_t *current;
+    size_t block_size;
+};
+
+static arena_block_t *arena_block_new(size_t size) {
+    arena_block_t *block = (arena_block_t*)malloc(sizeof(arena_block_t) + size);
+    if (!block) return NULL;
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+static void *arena_alloc(void *ctx, size_t size) {
+    lrs_arena_t *arena = (lrs_arena_t*)ctx;
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    arena_block_t *block = arena->current;
+    while (block->size - block->used < size) {
+        // Reuse the next block from before the last reset if it is big enough,
+        // otherwise chain a new one in front of it
+        arena_block_t *next = block->next;
+        if (!next || next->size < size) {
+            arena_block_t *fresh = arena_block_new(size > arena->block_size ? size : arena->block_size);
+            if (!fresh) return NULL;
+            fresh->next = next;
+            block->next = fresh;
+            next = fresh;
+        }
+        next->used = 0;
+        block = next;
+    }
+
+    arena->current = block;
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+static void arena_free(void *ctx, void *ptr) {
+    (void)ctx;
+    (void)ptr; // Released by lrs_arena_reset
+}
+
+// Create an arena whose blocks hold `block_size` bytes (0 = 256 KiB)
+lrs_arena_t *lrs_arena_create(size_t block_size) {
+    if (block_size == 0) block_size = ARENA_BLOCK_DEFAULT;
+
+    lrs_arena_t *arena = (lrs_arena_t*)malloc(sizeof(lrs_arena_t));
+    if (!arena) return NULL;
+
+    arena->first = arena_block_new(block_size);
+    if (!arena->first) {
+        free(arena);
+        return NULL;
+    }
+    arena->current = arena->first;
+    arena->block_size = block_size;
+    arena->allocator = (lrs_allocator_t){
+        arena_alloc, arena_free, default_secure_alloc, default_secure_free, arena
+    };
+
+    return arena;
+}
+
+// Release everything allocated from the arena at once
+void lrs_arena_reset(lrs_arena_t *arena) {
+    arena->current = arena->first;
+    arena->first->used = 0;
+}
+
+// Bytes handed out since the last reset (block slack included)
+size_t lrs_arena_used(const lrs_arena_t *arena) {
+    size_t used = 0;
+    for (const arena_block_t *block = arena->first; block; block = block->next) {
+        used += block->used;
+        if (block == arena->current) break;
+    }
+    return used;
+}
+
+const lrs_allocator_t *lrs_arena_allocator(lrs_arena_t *arena) {
+    return &arena->allocator;
+}
+
+void lrs_arena_destroy(lrs_arena_t *arena) {
+    if (!arena) return;
+
+    arena_block_t *block = arena->first;
+    while (block) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+// Per-thread arena, created on first use and destroyed when the thread exits
+static pthread_key_t thread_arena_key;
+static pthread_once_t thread_arena_once = PTHREAD_ONCE_INIT;
+
+static void thread_arena_destroy(void *arena) {
+    lrs_arena_destroy((lrs_arena_t*)arena);
+}
+
+static void thread_arena_key_init(void) {
+    pthread_key_create(&thread_arena_key, thread_arena_destroy);
+}
+
+lrs_arena_t *lrs_thread_arena(void) {
+    pthread_once(&thread_arena_once, thread_arena_key_init);
+
+    lrs_arena_t *arena = (lrs_arena_t*)pthread_getspecific(thread_arena_key);
+    if (!arena) {
+        arena = lrs_arena_create(0);
+        if (arena && pthread_setspecific(thread_arena_key, arena) != 0) {
+            lrs_arena_destroy(arena);
+            arena = NULL;
+        }
+    }
+
+    return arena;
+}
+
+// Memory governor
+// Large working sets (Argon2 memory, stream batches, whole-file buffers) reserve
+// their size against a process-wide budget before allocating. Reservations are
+// granted in arrival order; when the budget is exhausted a caller queues for up
+// to the configured timeout, or fails at once with a timeout of 0. Without a
+// budget reservations always succeed and are only counted.
+typedef struct governor_waiter {
+    struct governor_waiter *next;
+    size_t bytes;
+} governor_waiter_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint64_t budget;              // 0 = unlimited
+    int timeout_ms;               // < 0 waits indefinitely
+    governor_waiter_t *head;      // FIFO of queued reservations
+    governor_waiter_t *tail;
+    lrs_memory_stats_t stats;
+} governor = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, -1, NULL, NULL, {0}
+};
+
+static uint64_t governor_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int governor_fits(size_t bytes) {
+    return governor.budget == 0 || governor.stats.reserved_bytes + bytes <= governor.budget;
+}
+
+static void governor_grant(size_t bytes) {
+    governor.stats.reserved_bytes += bytes;
+    governor.stats.reservations++;
+    if (governor.stats.reserved_bytes > governor.stats.peak_reserved_bytes) {
+        governor.stats.peak_reserved_bytes = governor.stats.reserved_bytes;
+    }
+}
+
+static void governor_dequeue(governor_waiter_t *waiter) {
+    governor_waiter_t **link = &governor.head;
+    governor_waiter_t *previous = NULL;
+    while (*link && *link != waiter) {
+        previous = *link;
+        link = &(*link)->next;
+    }
+    if (!*link) return;
+
+    *link = waiter->next;
+    if (governor.tail == waiter) governor.tail = previous;
+    governor.stats.queue_depth--;
+}
+
+// Set the budget in bytes (0 = unlimited) and how long a reservation may wait
+// for capacity: < 0 indefinitely, 0 not at all (fail fast)
+void lrs_memory_set_budget(size_t budget_bytes, int timeout_ms) {
+    pthread_mutex_lock(&governor.lock);
+    governor.budget = budget_bytes;
+    governor.timeout_ms = timeout_ms;
+    governor.stats.budget_bytes = budget_bytes;
+    pthread_cond_broadcast(&governor.changed);
+    pthread_mutex_unlock(&governor.lock);
+}
+
+// Reserve only if the budget has room right now; for optional buffers, so a
+// refusal is not counted as a rejection
+int lrs_memory_try_reserve(size_t bytes) {
+    pthread_mutex_lock(&governor.lock);
+
+    int result = -11;
+    if (!governor.head && governor_fits(bytes)) {
+        governor_grant(bytes);
+        result = 0;
+    }
+
+    pthread_mutex_unlock(&governor.lock);
+    return result;
+}
+
+// Reserve `bytes` of the budget; returns 0, or -11 if the budget is exhausted
+// (timed out, fail-fast, or a request larger than the whole budget)
+int lrs_memory_reserve(size_t bytes) {
+    pthread_mutex_lock(&governor.lock);
+
+    // Nobody may overtake queued reservations
+    if (!governor.head && governor_fits(bytes)) {
+        governor_grant(bytes);
+        pthread_mutex_unlock(&governor.lock);
+        return 0;
+    }
+
+    // Idle KDF arenas hold budget nobody is using; unmap them before waiting
+    if (!governor_fits(bytes)) {
+        pthread_mutex_unlock(&governor.lock);
+        size_t trimmed = lrs_kdf_arena_trim();
+        pthread_mutex_lock(&governor.lock);
+        if (trimmed && !governor.head && governor_fits(bytes)) {
+            governor_grant(bytes);
+            pthread_mutex_unlock(&governor.lock);
+            return 0;
+        }
+    }
+
+    if (governor.timeout_ms == 0 || (governor.budget != 0 && bytes > governor.budget)) {
+        governor.stats.rejections++;
+        pthread_mutex_unlock(&governor.lock);
+        return -11; // Memory budget exhausted
+    }
+
+    governor_waiter_t waiter = { NULL, bytes };
+    if (governor.tail) {
+        governor.tail->next = &waiter;
+    } else {
+        governor.head = &waiter;
+    }
+    governor.tail = &waiter;
+    if (++governor.stats.queue_depth > governor.stats.max_queue_depth) {
+        governor.stats.max_queue_depth = governor.stats.queue_depth;
+    }
+
+    uint64_t start = governor_now_ns();
+    int timeout_ms = governor.timeout_ms;
+    struct timespec deadline;
+    if (timeout_ms > 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    int granted = 0;
+    for (;;) {
+        if (governor.head == &waiter && governor_fits(bytes)) {
+            granted = 1;
+            break;
+        }
+        if (governor.budget != 0 && bytes > governor.budget) break; // Budget shrank
+
+        int wait_result = timeout_ms > 0
+            ? pthread_cond_timedwait(&governor.changed, &governor.lock, &deadline)
+            : pthread_cond_wait(&governor.changed, &governor.lock);
+        if (wait_result == ETIMEDOUT && !(governor.head == &waiter && governor_fits(bytes))) break;
+    }
+
+    governor_dequeue(&waiter);
+    uint64_t waited = governor_now_ns() - start;
+    governor.stats.total_wait_ns += waited;
+    if (waited > governor.stats.max_wait_ns) governor.stats.max_wait_ns = waited;
+
+    if (granted) {
+        governor_grant(bytes);
+        governor.stats.waits++;
+    } else {
+        governor.stats.rejections++;
+    }
+
+    // The next waiter may fit now, or is now at the head
+    pthread_cond_broadcast(&governor.changed);
+    pthread_mutex_unlock(&governor.lock);
+
+    return granted ? 0 : -11;
+}
+
+// Return a reservation made with lrs_memory_reserve
+void lrs_memory_release(size_t bytes) {
+    pthread_mutex_lock(&governor.lock);
+    governor.stats.reserved_bytes -= bytes < governor.stats.reserved_bytes ? bytes : governor.stats.reserved_bytes;
+    pthread_cond_broadcast(&governor.changed);
+    pthread_mutex_unlock(&governor.lock);
+}
+
+void lrs_memory_get_stats(lrs_memory_stats_t *stats) {
+    pthread_mutex_lock(&governor.lock);
+    *stats = governor.stats;
+    pthread_mutex_unlock(&governor.lock);
+}
@@ -0,0 +1,623 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "lrs_encryption_lib.h"
+
+// Argon2id (RFC 9106, version 0x13) with parallel lanes
+// libsodium's crypto_pwhash always uses a single lane. Here the p lanes of a
+// segment are filled concurrently on the worker pool, joining at each of the
+// four slice boundaries per pass, which are the only points where a lane may
+// start referencing blocks of the others. BLAKE2b comes from libsodium.
+
+#define ARGON2_BLOCK_SIZE 1024
+#define ARGON2_QWORDS (ARGON2_BLOCK_SIZE / 8)
+#define ARGON2_SYNC_POINTS 4
+#define ARGON2_ADDRESSES_IN_BLOCK 128
+#define ARGON2_PREHASH_BYTES 64
+#define ARGON2_VERSION 0x13
+#define ARGON2_TYPE_ID 2
+
+typedef struct {
+    uint64_t v[ARGON2_QWORDS];
+} argon2_block_t;
+
+typedef struct {
+    argon2_block_t *memory;
+    uint32_t memory_blocks;
+    uint32_t lane_length;
+    uint32_t segment_length;
+    uint32_t passes;
+    uint32_t lanes;
+    // Position being filled (set before each slice)
+    uint32_t pass;
+    uint32_t slice;
+} argon2_instance_t;
+
+// KDF memory
+// Without the arena every derivation maps fresh memory and unmaps it again, so
+// each call pays for faulting in and zeroing hundreds of MiB. The arena keeps one
+// mapping per thread instead, pre-faulted and 2 MiB aligned so it can sit on huge
+// pages (fewer faults and TLB misses). Memory is wiped after every derivation
+// either way and excluded from core dumps.
+#define KDF_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// Each thread's arena lives in thread-local storage and is listed process-wide,
+// so lrs_kdf_arena_trim can unmap the idle ones of every thread (on disable, or
+// when a memory reservation would otherwise have to wait for them).
+typedef struct kdf_arena {
+    struct kdf_arena *prev;
+    struct kdf_arena *next;
+    void *base;
+    size_t size;
+    int busy;                     // A derivation is using base
+    int listed;
+} kdf_arena_t;
+
+static int kdf_arena_on = 0;
+static lrs_kdf_arena_stats_t kdf_arena_stats;
+static pthread_key_t kdf_arena_key;  // Only for its destructor at thread exit
+static pthread_once_t kdf_arena_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t kdf_arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+static kdf_arena_t *kdf_arenas = NULL;
+static __thread kdf_arena_t kdf_arena;
+
+// Detach the mapping; the caller unmaps it outside kdf_arenas_lock
+// Returns the mapped size (0 if nothing was mapped)
+static size_t kdf_arena_detach(kdf_arena_t *arena, void **base) {
+    size_t size = arena->size;
+    *base = arena->base;
+    arena->base = NULL;
+    arena->size = 0;
+    return size;
+}
+
+static void kdf_arena_unmap(void *base, size_t size) {
+    if (!base) return;
+
+    munmap(base, size);
+    lrs_memory_release(size);
+    __atomic_fetch_sub(&kdf_arena_stats.mapped_bytes, size, __ATOMIC_RELAXED);
+}
+
+static void kdf_arena_destroy(void *ptr) {
+    kdf_arena_t *arena = (kdf_arena_t*)ptr;
+    void *base;
+
+    pthread_mutex_lock(&kdf_arenas_lock);
+    if (arena->prev) {
+        arena->prev->next = arena->next;
+    } else {
+        kdf_arenas = arena->next;
+    }
+    if (arena->next) arena->next->prev = arena->prev;
+    arena->listed = 0;
+    size_t size = kdf_arena_detach(arena, &base);
+    pthread_mutex_unlock(&kdf_arenas_lock);
+
+    kdf_arena_unmap(base, size);
+}
+
+static void kdf_arena_key_init(void) {
+    pthread_key_create(&kdf_arena_key, kdf_arena_destroy);
+}
+
+static kdf_arena_t *kdf_thread_arena(int create) {
+    pthread_once(&kdf_arena_once, kdf_arena_key_init);
+
+    kdf_arena_t *arena = &kdf_arena;
+    if (!arena->listed) {
+        if (!create || pthread_setspecific(kdf_arena_key, arena) != 0) return NULL;
+
+        pthread_mutex_lock(&kdf_arenas_lock);
+        arena->prev = NULL;
+        arena->next = kdf_arenas;
+        if (kdf_arenas) kdf_arenas->prev = arena;
+        kdf_arenas = arena;
+        arena->listed = 1;
+        pthread_mutex_unlock(&kdf_arenas_lock);
+    }
+
+    return arena;
+}
+
+// Map `size` bytes (a multiple of the huge page size), pre-faulted
+static void *kdf_arena_map(size_t size) {
+    void *memory;
+
+#ifdef MAP_HUGETLB
+    // Explicit huge pages, if the administrator reserved enough of them
+    memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (memory != MAP_FAILED) {
+        __atomic_fetch_add(&kdf_arena_stats.hugetlb_maps, 1, __ATOMIC_RELAXED);
+        madvise(memory, size, MADV_DONTDUMP);
+        return memory;
+    }
+#endif
+
+    // Otherwise align to a huge page so transparent huge pages can back all of it
+    size_t mapped = size + KDF_HUGE_PAGE_SIZE;
+    uint8_t *raw = (uint8_t*)mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+
+    uint8_t *aligned = (uint8_t*)(((uintptr_t)raw + KDF_HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(KDF_HUGE_PAGE_SIZE - 1));
+    if (aligned > raw) munmap(raw, (size_t)(aligned - raw));
+    size_t tail = (size_t)(raw + mapped - (aligned + size));
+    if (tail > 0) munmap(aligned + size, tail);
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+    madvise(aligned, size, MADV_DONTDUMP);
+
+    // Fault everything in now instead of during the first derivation
+    memset(aligned, 0, size);
+    return aligned;
+}
+
+void lrs_kdf_arena_enable(void) {
+    __atomic_store_n(&kdf_arena_on, 1, __ATOMIC_RELEASE);
+}
+
+void lrs_kdf_arena_disable(void) {
+    __atomic_store_n(&kdf_arena_on, 0, __ATOMIC_RELEASE);
+    lrs_kdf_arena_trim();
+}
+
+// Unmap every idle arena, on any thread, returning its governor reservation
+// Arenas in use are skipped (they are dropped after use once disabled)
+// Returns the number of bytes unmapped
+size_t lrs_kdf_arena_trim(void) {
+    size_t trimmed = 0;
+
+    pthread_mutex_lock(&kdf_arenas_lock);
+    for (kdf_arena_t *arena = kdf_arenas; arena; arena = arena->next) {
+        if (arena->busy || !arena->base) continue;
+
+        void *base;
+        size_t size = kdf_arena_detach(arena, &base);
+        kdf_arena_unmap(base, size);
+        trimmed += size;
+    }
+    pthread_mutex_unlock(&kdf_arenas_lock);
+
+    return trimmed;
+}
+
+int lrs_kdf_arena_enabled(void) {
+    return __atomic_load_n(&kdf_arena_on, __ATOMIC_ACQUIRE);
+}
+
+void lrs_kdf_arena_get_stats(lrs_kdf_arena_stats_t *stats) {
+    stats->acquires = __atomic_load_n(&kdf_arena_stats.acquires, __ATOMIC_RELAXED);
+    stats->reuses = __atomic_load_n(&kdf_arena_stats.reuses, __ATOMIC_RELAXED);
+    stats->maps = __atomic_load_n(&kdf_arena_stats.maps, __ATOMIC_RELAXED);
+    stats->hugetlb_maps = __atomic_load_n(&kdf_arena_stats.hugetlb_maps, __ATOMIC_RELAXED);
+    stats->mapped_bytes = __atomic_load_n(&kdf_arena_stats.mapped_bytes, __ATOMIC_RELAXED);
+}
+
+// Memory for one derivation: the calling thread's arena when enabled, else a
+// private mapping. Both are reserved with the memory governor (an arena for as
+// long as it stays mapped); returns -1 if mapping fails, -11 if the budget does
+static int kdf_memory_acquire(size_t size, void **memory_out) {
+    if (!lrs_kdf_arena_enabled()) {
+        if (lrs_memory_reserve(size) != 0) return -11;
+        void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            lrs_memory_release(size);
+            return -1;
+        }
+        madvise(memory, size, MADV_DONTDUMP);
+        *memory_out = memory;
+        return 0;
+    }
+
+    kdf_arena_t *arena = kdf_thread_arena(1);
+    if (!arena) return -1;
+
+    // Busy keeps lrs_kdf_arena_trim away until kdf_memory_release
+    void *base;
+    pthread_mutex_lock(&kdf_arenas_lock);
+    arena->busy = 1;
+    size_t old_size = arena->size >= size ? 0 : kdf_arena_detach(arena, &base);
+    pthread_mutex_unlock(&kdf_arenas_lock);
+
+    __atomic_fetch_add(&kdf_arena_stats.acquires, 1, __ATOMIC_RELAXED);
+    if (arena->base) {
+        __atomic_fetch_add(&kdf_arena_stats.reuses, 1, __ATOMIC_RELAXED);
+        *memory_out = arena->base;
+        return 0;
+    }
+
+    // Grow: replace the mapping rather than keep two
+    if (old_size) kdf_arena_unmap(base, old_size);
+    size_t rounded = (size + KDF_HUGE_PAGE_SIZE - 1) & ~(size_t)(KDF_HUGE_PAGE_SIZE - 1);
+    int result = lrs_memory_reserve(rounded) == 0 ? 0 : -11;
+    void *memory = result == 0 ? kdf_arena_map(rounded) : NULL;
+    if (result == 0 && !memory) {
+        lrs_memory_release(rounded);
+        result = -1;
+    }
+
+    pthread_mutex_lock(&kdf_arenas_lock);
+    if (result == 0) {
+        arena->base = memory;
+        arena->size = rounded;
+    } else {
+        arena->busy = 0;
+    }
+    pthread_mutex_unlock(&kdf_arenas_lock);
+    if (result != 0) return result;
+
+    __atomic_fetch_add(&kdf_arena_stats.maps, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&kdf_arena_stats.mapped_bytes, rounded, __ATOMIC_RELAXED);
+
+    *memory_out = memory;
+    return 0;
+}
+
+// Whether reservations are queued on the memory budget
+static int memory_contended(void) {
+    lrs_memory_stats_t stats;
+    lrs_memory_get_stats(&stats);
+    return stats.queue_depth > 0;
+}
+
+// Wipe the memory; keep it if it is the thread's arena, unless arenas were
+// disabled meanwhile or others are waiting for budget the arena holds
+static void kdf_memory_release(void *memory, size_t size) {
+    sodium_memzero(memory, size);
+
+    kdf_arena_t *arena = kdf_thread_arena(0);
+    if (arena && arena->base == memory) {
+        void *base = NULL;
+        size_t mapped = 0;
+        pthread_mutex_lock(&kdf_arenas_lock);
+        arena->busy = 0;
+        if (!lrs_kdf_arena_enabled() || memory_contended()) mapped = kdf_arena_detach(arena, &base);
+        pthread_mutex_unlock(&kdf_arenas_lock);
+        kdf_arena_unmap(base, mapped);
+        return;
+    }
+    munmap(memory, size);
+    lrs_memory_release(size);
+}
+
+static void store32_le(uint8_t out[4], uint32_t value) {
+    uint32_t le = htole32(value);
+    memcpy(out, &le, 4);
+}
+
+// H': BLAKE2b stretched to any output length
+static void blake2b_long(uint8_t *out, size_t out_len, const uint8_t *in, size_t in_len) {
+    crypto_generichash_blake2b_state state;
+    uint8_t len_le[4];
+    store32_le(len_le, (uint32_t)out_len);
+
+    if (out_len <= crypto_generichash_blake2b_BYTES_MAX) {
+        crypto_generichash_blake2b_init(&state, NULL, 0, out_len);
+        crypto_generichash_blake2b_update(&state, len_le, sizeof len_le);
+        crypto_generichash_blake2b_update(&state, in, in_len);
+        crypto_generichash_blake2b_final(&state, out, out_len);
+        sodium_memzero(&state, sizeof state);
+        return;
+    }
+
+    // 32 bytes from each of V1..Vr, then all of the last, shorter hash
+    uint8_t v[64], next[64];
+    crypto_generichash_blake2b_init(&state, NULL, 0, sizeof v);
+    crypto_generichash_blake2b_update(&state, len_le, sizeof len_le);
+    crypto_generichash_blake2b_update(&state, in, in_len);
+    crypto_generichash_blake2b_final(&state, v, sizeof v);
+    memcpy(out, v, 32);
+    out += 32;
+    out_len -= 32;
+
+    while (out_len > sizeof v) {
+        crypto_generichash_blake2b(next, sizeof next, v, sizeof v, NULL, 0);
+        memcpy(v, next, sizeof v);
+        memcpy(out, v, 32);
+        out += 32;
+        out_len -= 32;
+    }
+    crypto_generichash_blake2b(next, out_len, v, sizeof v, NULL, 0);
+    memcpy(out, next, out_len);
+
+    sodium_memzero(v, sizeof v);
+    sodium_memzero(next, sizeof next);
+    sodium_memzero(&state, sizeof state);
+}
+
+// Compression function G: BLAKE2b rounds with the multiply-hardened BlaMka mix
+static inline uint64_t blamka(uint64_t x, uint64_t y) {
+    return x + y + 2 * ((uint64_t)(uint32_t)x * (uint32_t)y);
+}
+
+static inline uint64_t rotr64(uint64_t w, unsigned c) {
+    return (w >> c) | (w << (64 - c));
+}
+
+#define ARGON2_G(a, b, c, d)                \
+    do {                                    \
+        a = blamka(a, b);                   \
+        d = rotr64(d ^ a, 32);              \
+        c = blamka(c, d);                   \
+        b = rotr64(b ^ c, 24);              \
+        a = blamka(a, b);                   \
+        d = rotr64(d ^ a, 16);              \
+        c = blamka(c, d);                   \
+        b = rotr64(b ^ c, 63);              \
+    } while (0)
+
+#define ARGON2_ROUND(v0, v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15) \
+    do {                                    \
+        ARGON2_G(v0, v4, v8, v12);          \
+        ARGON2_G(v1, v5, v9, v13);          \
+        ARGON2_G(v2, v6, v10, v14);         \
+        ARGON2_G(v3, v7, v11, v15);         \
+        ARGON2_G(v0, v5, v10, v15);         \
+        ARGON2_G(v1, v6, v11, v12);         \
+        ARGON2_G(v2, v7, v8, v13);          \
+        ARGON2_G(v3, v4, v9, v14);          \
+    } while (0)
+
+// next = G(prev, ref), or next ^= G(prev, ref) on later passes
+static void fill_block(const argon2_block_t *prev, const argon2_block_t *ref,
+                       argon2_block_t *next, int with_xor) {
+    argon2_block_t r, tmp;
+
+    for (size_t i = 0; i < ARGON2_QWORDS; i++) {
+        r.v[i] = prev->v[i] ^ ref->v[i];
+    }
+    tmp = r;
+    if (with_xor) {
+        for (size_t i = 0; i < ARGON2_QWORDS; i++) {
+            tmp.v[i] ^= next->v[i];
+        }
+    }
+
+    // Rows of 16 words, then columns of 2-word pairs
+    uint64_t *v = r.v;
+    for (size_t i = 0; i < 8; i++) {
+        uint64_t *row = v + 16 * i;
+        ARGON2_ROUND(row[0], row[1], row[2], row[3], row[4], row[5], row[6], row[7],
+                     row[8], row[9], row[10], row[11], row[12], row[13], row[14], row[15]);
+    }
+    for (size_t i = 0; i < 8; i++) {
+        uint64_t *col = v + 2 * i;
+        ARGON2_ROUND(col[0], col[1], col[16], col[17], col[32], col[33], col[48], col[49],
+                     col[64], col[65], col[80], col[81], col[96], col[97], col[112], col[113]);
+    }
+
+    for (size_t i = 0; i < ARGON2_QWORDS; i++) {
+        next->v[i] = tmp.v[i] ^ r.v[i];
+    }
+}
+
+// Next block of pseudo-random reference indexes (data-independent addressing)
+static void next_addresses(argon2_block_t *address_block, argon2_block_t *input_block) {
+    static const argon2_block_t zero_block;
+
+    input_block->v[6]++;
+    fill_block(&zero_block, input_block, address_block, 0);
+    fill_block(&zero_block, address_block, address_block, 0);
+}
+
+// Map a pseudo-random value to the block a new block references
+static uint32_t index_alpha(const argon2_instance_t *instance, uint32_t index,
+                            uint32_t pseudo_rand, int same_lane) {
+    uint32_t pass = instance->pass;
+    uint32_t slice = instance->slice;
+    uint32_t reference_area_size;
+
+    // Blocks already finished that this one may reference
+    if (pass == 0) {
+        if (slice == 0) {
+            reference_area_size = index - 1;
+        } else if (same_lane) {
+            reference_area_size = slice * instance->segment_length + index - 1;
+        } else {
+            reference_area_size = slice * instance->segment_length - (index == 0 ? 1 : 0);
+        }
+    } else {
+        if (same_lane) {
+            reference_area_size = instance->lane_length - instance->segment_length + index - 1;
+        } else {
+            reference_area_size = instance->lane_length - instance->segment_length - (index == 0 ? 1 : 0);
+        }
+    }
+
+    // Non-uniform mapping that favours recent blocks
+    uint64_t relative_position = pseudo_rand;
+    relative_position = relative_position * relative_position >> 32;
+    relative_position = reference_area_size - 1 - ((reference_area_size * relative_position) >> 32);
+
+    uint32_t start_position = 0;
+    if (pass != 0 && slice != ARGON2_SYNC_POINTS - 1) {
+        start_position = (slice + 1) * instance->segment_length;
+    }
+
+    return (uint32_t)((start_position + relative_position) % instance->lane_length);
+}
+
+// Fill one lane's segment of the current slice (a worker pool item)
+static void fill_segment(void *arg, size_t lane_index) {
+    const argon2_instance_t *instance = (const argon2_instance_t*)arg;
+    uint32_t lane = (uint32_t)lane_index;
+    uint32_t pass = instance->pass;
+    uint32_t slice = instance->slice;
+
+    // Argon2id: the first half of the first pass resists side channels,
+    // everything after that resists time-memory trade-offs
+    int data_independent = pass == 0 && slice < ARGON2_SYNC_POINTS / 2;
+    argon2_block_t address_block, input_block;
+
+    if (data_independent) {
+        memset(&input_block, 0, sizeof input_block);
+        input_block.v[0] = pass;
+        input_block.v[1] = lane;
+        input_block.v[2] = slice;
+        input_block.v[3] = instance->memory_blocks;
+        input_block.v[4] = instance->passes;
+        input_block.v[5] = ARGON2_TYPE_ID;
+    }
+
+    // The first two blocks of each lane come from the pre-hash
+    uint32_t starting_index = 0;
+    if (pass == 0 && slice == 0) {
+        starting_index = 2;
+        if (data_independent) next_addresses(&address_block, &input_block);
+    }
+
+    uint32_t curr_offset = lane * instance->lane_length + slice * instance->segment_length + starting_index;
+    uint32_t prev_offset = curr_offset % instance->lane_length == 0 ?
+                           curr_offset + instance->lane_length - 1 : curr_offset - 1;
+
+    for (uint32_t i = starting_index; i < instance->segment_length; i++, curr_offset++, prev_offset++) {
+        if (curr_offset % instance->lane_length == 1) {
+            prev_offset = curr_offset - 1;
+        }
+
+        uint64_t pseudo_rand;
+        if (data_independent) {
+            if (i % ARGON2_ADDRESSES_IN_BLOCK == 0) next_addresses(&address_block, &input_block);
+            pseudo_rand = address_block.v[i % ARGON2_ADDRESSES_IN_BLOCK];
+        } else {
+            pseudo_rand = instance->memory[prev_offset].v[0];
+        }
+
+        uint32_t ref_lane = (uint32_t)((pseudo_rand >> 32) % instance->lanes);
+        if (pass == 0 && slice == 0) ref_lane = lane;
+
+        uint32_t ref_index = index_alpha(instance, i, (uint32_t)pseudo_rand, ref_lane == lane);
+        const argon2_block_t *ref_block = instance->memory + (size_t)instance->lane_length * ref_lane + ref_index;
+
+        fill_block(instance->memory + prev_offset, ref_block, instance->memory + curr_offset, pass != 0);
+    }
+
+    if (data_independent) {
+        sodium_memzero(&address_block, sizeof address_block);
+        sodium_memzero(&input_block, sizeof input_block);
+    }
+}
+
+static void load_block(argon2_block_t *block, const uint8_t bytes[ARGON2_BLOCK_SIZE]) {
+    for (size_t i = 0; i < ARGON2_QWORDS; i++) {
+        uint64_t le;
+        memcpy(&le, bytes + 8 * i, 8);
+        block->v[i] = le64toh(le);
+    }
+}
+
+static void store_block(uint8_t bytes[ARGON2_BLOCK_SIZE], const argon2_block_t *block) {
+    for (size_t i = 0; i < ARGON2_QWORDS; i++) {
+        uint64_t le = htole64(block->v[i]);
+        memcpy(bytes + 8 * i, &le, 8);
+    }
+}
+
+// H0 over the parameters and inputs, each input prefixed with its length
+static void initial_hash(uint8_t h0[ARGON2_PREHASH_BYTES], size_t out_len,
+                         const uint8_t *pwd, size_t pwd_len, const uint8_t *salt, size_t salt_len,
+                         const uint8_t *secret, size_t secret_len, const uint8_t *ad, size_t ad_len,
+                         uint32_t ops, uint32_t mem_limit_kib, uint32_t lanes) {
+    crypto_generichash_blake2b_state state;
+    uint8_t value[4];
+
+    crypto_generichash_blake2b_init(&state, NULL, 0, ARGON2_PREHASH_BYTES);
+    const uint32_t params[] = { lanes, (uint32_t)out_len, mem_limit_kib, ops, ARGON2_VERSION, ARGON2_TYPE_ID };
+    for (size_t i = 0; i < sizeof params / sizeof params[0]; i++) {
+        store32_le(value, params[i]);
+        crypto_generichash_blake2b_update(&state, value, sizeof value);
+    }
+
+    const uint8_t *inputs[] = { pwd, salt, secret, ad };
+    const size_t input_lens[] = { pwd_len, salt_len, secret_len, ad_len };
+    for (size_t i = 0; i < 4; i++) {
+        store32_le(value, (uint32_t)input_lens[i]);
+        crypto_generichash_blake2b_update(&state, value, sizeof value);
+        if (input_lens[i] > 0) crypto_generichash_blake2b_update(&state, inputs[i], input_lens[i]);
+    }
+
+    crypto_generichash_blake2b_final(&state, h0, ARGON2_PREHASH_BYTES);
+    sodium_memzero(&state, sizeof state);
+}
+
+// Argon2id with `lanes` lanes, computed on up to min(lanes, CPUs) threads
+// secret and ad are optional (NULL with length 0). Returns 0, -1 on invalid
+// parameters or when the memory cannot be allocated, or -11 if the memory
+// governor's budget is exhausted.
+int lrs_argon2id(uint8_t *out, size_t out_len, const uint8_t *pwd, size_t pwd_len,
+                 const uint8_t *salt, size_t salt_len, const uint8_t *secret, size_t secret_len,
+                 const uint8_t *ad, size_t ad_len, uint32_t ops, uint32_t mem_limit_kib, uint32_t lanes) {
+    if (!out || out_len < 4 || out_len > UINT32_MAX || salt_len < 8 || ops < 1 ||
+        lanes < 1 || lanes > LRS_KDF_PARALLELISM_MAX ||
+        mem_limit_kib < 2 * ARGON2_SYNC_POINTS * lanes ||
+        (!pwd && pwd_len) || (!secret && secret_len) || (!ad && ad_len)) {
+        return -1;
+    }
+
+    // Memory rounds down to a whole number of segments per lane
+    argon2_instance_t instance;
+    instance.segment_length = mem_limit_kib / (lanes * ARGON2_SYNC_POINTS);
+    instance.lane_length = instance.segment_length * ARGON2_SYNC_POINTS;
+    instance.memory_blocks = instance.lane_length * lanes;
+    instance.passes = ops;
+    instance.lanes = lanes;
+
+    size_t memory_size = (size_t)instance.memory_blocks * sizeof(argon2_block_t);
+    void *memory = NULL;
+    int acquire_result = kdf_memory_acquire(memory_size, &memory);
+    if (acquire_result != 0) return acquire_result;
+    lrs_kdf_memory_held();
+    instance.memory = (argon2_block_t*)memory;
+
+    // B[lane][0] and B[lane][1] = H'(H0 || LE32(column) || LE32(lane))
+    uint8_t seed[ARGON2_PREHASH_BYTES + 8];
+    uint8_t block_bytes[ARGON2_BLOCK_SIZE];
+    initial_hash(seed, out_len, pwd, pwd_len, salt, salt_len, secret, secret_len, ad, ad_len,
+                 ops, mem_limit_kib, lanes);
+    for (uint32_t lane = 0; lane < lanes; lane++) {
+        for (uint32_t column = 0; column < 2; column++) {
+            store32_le(seed + ARGON2_PREHASH_BYTES, column);
+            store32_le(seed + ARGON2_PREHASH_BYTES + 4, lane);
+            blake2b_long(block_bytes, sizeof block_bytes, seed, sizeof seed);
+            load_block(instance.memory + (size_t)lane * instance.lane_length + column, block_bytes);
+        }
+    }
+
+    unsigned threads = lrs_cpu_count();
+    if (threads > lanes) threads = lanes;
+    lrs_pool_t *pool = threads > 1 ? lrs_pool_create(threads) : NULL; // NULL runs inline
+
+    for (uint32_t pass = 0; pass < ops; pass++) {
+        for (uint32_t slice = 0; slice < ARGON2_SYNC_POINTS; slice++) {
+            instance.pass = pass;
+            instance.slice = slice;
+            lrs_pool_run(pool, lanes, fill_segment, &instance);
+        }
+    }
+    lrs_pool_destroy(pool);
+
+    // Tag = H'(XOR of the last block of every lane)
+    argon2_block_t final_block = instance.memory[instance.lane_length - 1];
+    for (uint32_t lane = 1; lane < lanes; lane++) {
+        const argon2_block_t *last = instance.memory + (size_t)lane * instance.lane_length + instance.lane_length - 1;
+        for (size_t i = 0; i < ARGON2_QWORDS; i++) {
+            final_block.v[i] ^= last->v[i];
+        }
+    }
+    store_block(block_bytes, &final_block);
+    blake2b_long(out, out_len, block_bytes, sizeof block_bytes);
+
+    sodium_memzero(seed, sizeof seed);
+    sodium_memzero(block_bytes, sizeof block_bytes);
+    sodium_memzero(&final_block, sizeof final_block);
+    kdf_memory_release(memory, memory_size);
+
+    return 0;
+}
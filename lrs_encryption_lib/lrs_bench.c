@@ -0,0 +1,619 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <sodium.h>
+#include "lrs_encryption_lib.h"
+
+// Benchmark suite
+// Every case runs in batches of doubling size until one batch takes at least
+// --min-time seconds; that batch is reported as one JSON object with ns/op,
+// MB/s, library allocations per op and peak RSS. Output goes to stdout, progress
+// to stderr, so `./lrs_bench > run.json` gives a file to diff between versions.
+
+// Legacy wrapper entry point (lrs_wrapper.c)
+void encrypt_message(const char* message, uint32_t key, uint32_t* output, int* output_len);
+
+typedef struct {
+    double min_time;          // Seconds per reported batch
+    size_t max_size;          // Largest AEAD payload
+    size_t max_file_size;     // Largest file for the file APIs
+    unsigned threads;         // Threads for the file APIs (0 = one per CPU)
+    int kdf;                  // Include KDF-bound cases
+    const char *filter;       // Only run cases whose name contains this
+    const char *v1_path;      // v1 CLI for the lrs_encryption.c format
+    const char *dir;          // Scratch directory for files
+} bench_options_t;
+
+static bench_options_t options = {
+    .min_time = 0.2,
+    .max_size = 1024UL * 1024 * 1024,
+    .max_file_size = 256UL * 1024 * 1024,
+    .threads = 0,
+    .kdf = 1,
+    .filter = NULL,
+    .v1_path = "./lrs_encryption",
+    .dir = "/tmp",
+};
+
+static int first_result = 1;
+
+// Counting allocator: library allocations go through it, so each case can
+// report allocations per operation
+static uint64_t alloc_count;
+
+static void *count_alloc(void *ctx, size_t size) {
+    (void)ctx;
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+static void count_free(void *ctx, void *ptr) {
+    (void)ctx;
+    free(ptr);
+}
+
+static void *count_secure_alloc(void *ctx, size_t size) {
+    (void)ctx;
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    return sodium_malloc(size);
+}
+
+static void count_secure_free(void *ctx, void *ptr) {
+    (void)ctx;
+    sodium_free(ptr);
+}
+
+static const lrs_allocator_t counting_allocator = {
+    count_alloc, count_free, count_secure_alloc, count_secure_free, NULL
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Reset the peak RSS counter (Linux); later reads report the peak since then
+static void reset_peak_rss(void) {
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0) return;
+    if (write(fd, "5", 1) != 1) {
+        // Not permitted: peak_rss_kib stays the process-wide high-water mark
+    }
+    close(fd);
+}
+
+static long peak_rss_kib(void) {
+    FILE *status = fopen("/proc/self/status", "r");
+    if (status) {
+        char line[256];
+        while (fgets(line, sizeof(line), status)) {
+            long kib;
+            if (sscanf(line, "VmHWM: %ld kB", &kib) == 1) {
+                fclose(status);
+                return kib;
+            }
+        }
+        fclose(status);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static int selected(const char *name) {
+    return !options.filter || strstr(name, options.filter) != NULL;
+}
+
+static void print_result(const char *name, const char *params, size_t bytes_per_op, uint64_t iterations,
+                         double seconds, double allocs_per_op, long rss_kib, int ok) {
+    double ns_per_op = seconds * 1e9 / (double)iterations;
+
+    printf("%s\n    {\"name\": \"%s\", \"params\": \"%s\", \"bytes\": %zu, \"iterations\": %llu, "
+           "\"ns_per_op\": %.1f, ", first_result ? "" : ",", name, params, bytes_per_op,
+           (unsigned long long)iterations, ns_per_op);
+    if (bytes_per_op > 0) {
+        printf("\"mb_per_s\": %.2f, ", (double)bytes_per_op * (double)iterations / seconds / 1e6);
+    } else {
+        printf("\"mb_per_s\": null, ");
+    }
+    if (allocs_per_op >= 0) {
+        printf("\"allocs_per_op\": %.2f, ", allocs_per_op);
+    } else {
+        printf("\"allocs_per_op\": null, ");
+    }
+    printf("\"peak_rss_kib\": %ld, \"ok\": %s}", rss_kib, ok ? "true" : "false");
+    fflush(stdout);
+    first_result = 0;
+
+    fprintf(stderr, "%-28s %-22s %10zu B  %12.1f ns/op%s\n", name, params, bytes_per_op, ns_per_op,
+            ok ? "" : "  FAILED");
+}
+
+// Run `fn` in doubling batches and report the first batch that takes long enough
+static void run_case(const char *name, const char *params, size_t bytes_per_op,
+                     int (*fn)(void *ctx), void *ctx) {
+    if (!selected(name)) return;
+
+    reset_peak_rss();
+
+    uint64_t iterations = 1;
+    for (;;) {
+        uint64_t allocs_before = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+        int ok = 1;
+
+        double start = now_seconds();
+        for (uint64_t i = 0; i < iterations && ok; i++) {
+            ok = fn(ctx) == 0;
+        }
+        double seconds = now_seconds() - start;
+
+        if (!ok || seconds >= options.min_time || iterations >= (1ULL << 40)) {
+            uint64_t allocs = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - allocs_before;
+            print_result(name, params, bytes_per_op, iterations, seconds,
+                         (double)allocs / (double)iterations, peak_rss_kib(), ok);
+            return;
+        }
+
+        // Aim straight for the target once the batch is long enough to measure
+        if (seconds > options.min_time / 100) {
+            uint64_t target = (uint64_t)((double)iterations * options.min_time / seconds * 1.2) + 1;
+            iterations = target > iterations * 2 ? target : iterations * 2;
+        } else {
+            iterations *= 2;
+        }
+    }
+}
+
+// AEAD layer
+typedef struct {
+    uint32_t key[8];
+    uint8_t *pt;
+    uint8_t *ct;
+    size_t len;
+    size_t ct_len;
+    header_t header;
+    uint8_t tlv[LRS_TLV_MAX];
+    uint8_t tag[crypto_aead_xchacha20poly1305_ietf_ABYTES];
+} aead_ctx_t;
+
+static int bench_blob_encrypt(void *arg) {
+    aead_ctx_t *ctx = (aead_ctx_t*)arg;
+    return encrypt_blob_ex(ctx->pt, ctx->len, ctx->key, KEY_MODE_RAW_KEY, NULL, 0,
+                           &ctx->header, ctx->tlv, sizeof(ctx->tlv), ctx->ct, &ctx->ct_len);
+}
+
+static int bench_blob_decrypt(void *arg) {
+    aead_ctx_t *ctx = (aead_ctx_t*)arg;
+    size_t pt_len = 0;
+    return decrypt_blob_ex(ctx->ct, ctx->ct_len, ctx->key, KEY_MODE_RAW_KEY, NULL, 0,
+                           &ctx->header, ctx->tlv, ntohs(ctx->header.tlv_len), ctx->pt, &pt_len);
+}
+
+static int bench_blob_encrypt_inplace(void *arg) {
+    aead_ctx_t *ctx = (aead_ctx_t*)arg;
+    return encrypt_blob_inplace(ctx->pt, ctx->len, ctx->key, KEY_MODE_RAW_KEY, NULL, 0,
+                                &ctx->header, ctx->tlv, sizeof(ctx->tlv), ctx->tag);
+}
+
+static void bench_aead(void) {
+    aead_ctx_t ctx;
+    randombytes_buf(ctx.key, sizeof(ctx.key));
+
+    for (size_t size = 64; size <= options.max_size; size *= 4) {
+        ctx.len = size;
+        ctx.pt = (uint8_t*)malloc(size);
+        ctx.ct = (uint8_t*)malloc(size + crypto_aead_xchacha20poly1305_ietf_ABYTES);
+        if (!ctx.pt || !ctx.ct) {
+            fprintf(stderr, "aead: cannot allocate %zu bytes, stopping\n", size);
+            free(ctx.pt);
+            free(ctx.ct);
+            break;
+        }
+        memset(ctx.pt, 0x5a, size);
+
+        run_case("aead_encrypt", "raw_key", size, bench_blob_encrypt, &ctx);
+        run_case("aead_decrypt", "raw_key", size, bench_blob_decrypt, &ctx);
+        run_case("aead_encrypt_inplace", "raw_key", size, bench_blob_encrypt_inplace, &ctx);
+
+        free(ctx.pt);
+        free(ctx.ct);
+
+        // 64 B .. 1 GiB in steps of 4, ending exactly on the limit
+        if (size < options.max_size && size * 4 > options.max_size) size = options.max_size / 4;
+    }
+}
+
+// KDF latency
+typedef struct {
+    uint32_t ops;
+    uint32_t mem_limit_kib;
+    uint32_t parallelism;
+    uint8_t salt[16];
+} kdf_ctx_t;
+
+static int bench_kdf(void *arg) {
+    kdf_ctx_t *ctx = (kdf_ctx_t*)arg;
+    uint8_t key[32];
+    int result = derive_key_argon2id("benchmark password", ctx->salt, ctx->mem_limit_kib, ctx->ops,
+                                     ctx->parallelism, key);
+    sodium_memzero(key, sizeof key);
+    return result;
+}
+
+static void bench_kdf_params(void) {
+    static const kdf_ctx_t params[] = {
+        {1, 64 * 1024, 1, {0}},
+        {2, 64 * 1024, 1, {0}},
+        {3, 256 * 1024, 1, {0}},
+        {LRS_KDF_OPS_DEFAULT, LRS_KDF_MEM_LIMIT_KIB_DEFAULT, 1, {0}},
+        // Same memory hardness split over lanes (lrs_argon2id threads)
+        {LRS_KDF_OPS_DEFAULT, LRS_KDF_MEM_LIMIT_KIB_DEFAULT, 2, {0}},
+        {LRS_KDF_OPS_DEFAULT, LRS_KDF_MEM_LIMIT_KIB_DEFAULT, 4, {0}},
+    };
+
+    for (size_t i = 0; i < sizeof(params) / sizeof(params[0]); i++) {
+        kdf_ctx_t ctx = params[i];
+        randombytes_buf(ctx.salt, sizeof(ctx.salt));
+
+        char label[64];
+        snprintf(label, sizeof(label), "ops=%u,mem_kib=%u,p=%u", ctx.ops, ctx.mem_limit_kib, ctx.parallelism);
+        run_case("kdf_argon2id", label, 0, bench_kdf, &ctx);
+    }
+
+    // Same parameters on the persistent, pre-faulted arena (compare with the above)
+    lrs_kdf_arena_enable();
+    for (size_t i = 0; i < sizeof(params) / sizeof(params[0]); i++) {
+        kdf_ctx_t ctx = params[i];
+        randombytes_buf(ctx.salt, sizeof(ctx.salt));
+
+        char label[64];
+        snprintf(label, sizeof(label), "ops=%u,mem_kib=%u,p=%u", ctx.ops, ctx.mem_limit_kib, ctx.parallelism);
+        run_case("kdf_argon2id_arena", label, 0, bench_kdf, &ctx);
+    }
+
+    lrs_kdf_arena_stats_t stats;
+    lrs_kdf_arena_get_stats(&stats);
+    fprintf(stderr, "kdf arena: %llu maps (%llu hugetlb), %llu reuses\n",
+            (unsigned long long)stats.maps, (unsigned long long)stats.hugetlb_maps,
+            (unsigned long long)stats.reuses);
+    lrs_kdf_arena_disable();
+}
+
+// Hex codec
+typedef struct {
+    uint8_t *bin;
+    char *hex;
+    size_t len;
+} hex_ctx_t;
+
+static int bench_hex_encode(void *arg) {
+    hex_ctx_t *ctx = (hex_ctx_t*)arg;
+    lrs_hex_encode(ctx->hex, ctx->bin, ctx->len);
+    return 0;
+}
+
+static int bench_hex_decode(void *arg) {
+    hex_ctx_t *ctx = (hex_ctx_t*)arg;
+    return lrs_hex_decode(ctx->bin, ctx->hex, ctx->len * 2);
+}
+
+static void bench_hex(void) {
+    static const size_t sizes[] = {64, 4096, 1024 * 1024};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        hex_ctx_t ctx = { (uint8_t*)malloc(sizes[i]), (char*)malloc(sizes[i] * 2 + 1), sizes[i] };
+        if (ctx.bin && ctx.hex) {
+            randombytes_buf(ctx.bin, ctx.len);
+            run_case("hex_encode", "", ctx.len, bench_hex_encode, &ctx);
+            run_case("hex_decode", "", ctx.len, bench_hex_decode, &ctx);
+        }
+        free(ctx.bin);
+        free(ctx.hex);
+    }
+}
+
+// String API
+typedef struct {
+    const void *key_material;
+    int key_mode;
+    int encoding;
+    char *plaintext;
+    char *encrypted;
+    size_t encrypted_len;
+} string_ctx_t;
+
+static int bench_string_encrypt(void *arg) {
+    string_ctx_t *ctx = (string_ctx_t*)arg;
+    size_t len = 0;
+    char *encrypted = encrypt_string_ex(ctx->plaintext, ctx->key_material, ctx->key_mode, "bench",
+                                        ctx->encoding, &len);
+    lrs_free(encrypted);
+    return encrypted ? 0 : -1;
+}
+
+static int bench_string_decrypt(void *arg) {
+    string_ctx_t *ctx = (string_ctx_t*)arg;
+    char *decrypted = decrypt_string_ex(ctx->encrypted, ctx->encrypted_len, ctx->key_material, ctx->key_mode,
+                                        "bench", ctx->encoding);
+    lrs_free(decrypted);
+    return decrypted ? 0 : -1;
+}
+
+static void bench_strings(void) {
+    static const size_t sizes[] = {64, 512, 4096};
+    static const char *encoding_names[] = {"hex", "base64url", "binary"};
+    uint32_t key[8];
+    randombytes_buf(key, sizeof(key));
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        char *plaintext = (char*)malloc(sizes[i] + 1);
+        if (!plaintext) continue;
+        memset(plaintext, 'x', sizes[i]);
+        plaintext[sizes[i]] = '\0';
+
+        for (int encoding = LRS_ENCODING_HEX; encoding <= LRS_ENCODING_BINARY; encoding++) {
+            string_ctx_t ctx = { key, KEY_MODE_RAW_KEY, encoding, plaintext, NULL, 0 };
+            ctx.encrypted = encrypt_string_ex(plaintext, key, KEY_MODE_RAW_KEY, "bench", encoding,
+                                              &ctx.encrypted_len);
+
+            char label[64];
+            snprintf(label, sizeof(label), "raw_key,%s", encoding_names[encoding]);
+            run_case("string_encrypt", label, sizes[i], bench_string_encrypt, &ctx);
+            run_case("string_decrypt", label, sizes[i], bench_string_decrypt, &ctx);
+            lrs_free(ctx.encrypted);
+        }
+        free(plaintext);
+    }
+}
+
+// Password-mode string API and the legacy wrapper: one Argon2id run per call
+static int bench_encrypt_string_password(void *arg) {
+    char *encrypted = encrypt_string((const char*)arg, "benchmark password", NULL);
+    lrs_free(encrypted);
+    return encrypted ? 0 : -1;
+}
+
+static int bench_encrypt_message(void *arg) {
+    uint32_t output[1024];
+    int output_len = 0;
+    encrypt_message((const char*)arg, 0x12345678, output, &output_len);
+    return output_len > 0 ? 0 : -1;
+}
+
+static void bench_password_paths(void) {
+    const char *message = "legacy message of a typical size";
+    run_case("string_encrypt_password", "default_kdf", strlen(message),
+             bench_encrypt_string_password, (void*)message);
+    run_case("legacy_encrypt_message", "default_kdf", strlen(message),
+             bench_encrypt_message, (void*)message);
+}
+
+// File APIs
+typedef struct {
+    uint32_t key[8];
+    char input[512];
+    char encrypted[512];
+    char decrypted[512];
+    lrs_file_t *handle;           // For the random reads
+} file_ctx_t;
+
+static int bench_file_encrypt(void *arg) {
+    file_ctx_t *ctx = (file_ctx_t*)arg;
+    return encrypt_file_ex(ctx->input, ctx->encrypted, ctx->key, KEY_MODE_RAW_KEY, NULL, 0, options.threads);
+}
+
+static int bench_file_decrypt(void *arg) {
+    file_ctx_t *ctx = (file_ctx_t*)arg;
+    return decrypt_file_ex(ctx->encrypted, ctx->decrypted, ctx->key, KEY_MODE_RAW_KEY, NULL, 0, options.threads);
+}
+
+// Stream through stdio (the path taken for pipes)
+static int bench_stream_encrypt(void *arg) {
+    file_ctx_t *ctx = (file_ctx_t*)arg;
+    FILE *in = fopen(ctx->input, "rb");
+    FILE *out = fopen(ctx->encrypted, "wb");
+    int result = in && out ? encrypt_stream(in, out, ctx->key, KEY_MODE_RAW_KEY, NULL, 0, 0, options.threads) : -1;
+    if (in) fclose(in);
+    if (out && fclose(out) != 0) result = -1;
+    return result;
+}
+
+// 4 KiB at a random offset of an open container
+static int bench_file_pread(void *arg) {
+    file_ctx_t *ctx = (file_ctx_t*)arg;
+    uint8_t buf[4096];
+    uint64_t size = lrs_file_size(ctx->handle);
+    uint64_t offset = size > sizeof(buf) ? randombytes_uniform((uint32_t)(size - sizeof(buf))) : 0;
+    return lrs_pread(ctx->handle, buf, sizeof(buf), offset) >= 0 ? 0 : -1;
+}
+
+static int write_random_file(const char *path, size_t size) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+
+    uint8_t block[65536];
+    for (size_t done = 0; done < size; ) {
+        size_t n = size - done < sizeof(block) ? size - done : sizeof(block);
+        randombytes_buf(block, n);
+        if (fwrite(block, 1, n, f) != n) {
+            fclose(f);
+            return -1;
+        }
+        done += n;
+    }
+
+    return fclose(f);
+}
+
+static void bench_files(void) {
+    file_ctx_t ctx;
+    randombytes_buf(ctx.key, sizeof(ctx.key));
+    snprintf(ctx.input, sizeof(ctx.input), "%s/lrs_bench_%d.in", options.dir, (int)getpid());
+    snprintf(ctx.encrypted, sizeof(ctx.encrypted), "%s/lrs_bench_%d.lrs", options.dir, (int)getpid());
+    snprintf(ctx.decrypted, sizeof(ctx.decrypted), "%s/lrs_bench_%d.out", options.dir, (int)getpid());
+
+    for (size_t size = 4096; size <= options.max_file_size; size *= 16) {
+        if (write_random_file(ctx.input, size) != 0) {
+            fprintf(stderr, "files: cannot write %s\n", ctx.input);
+            break;
+        }
+
+        char label[32];
+        snprintf(label, sizeof(label), "threads=%u", options.threads);
+        run_case("file_encrypt", label, size, bench_file_encrypt, &ctx);
+        run_case("file_decrypt", label, size, bench_file_decrypt, &ctx);
+        run_case("stream_encrypt", label, size, bench_stream_encrypt, &ctx);
+        if (lrs_open(&ctx.handle, ctx.encrypted, ctx.key, KEY_MODE_RAW_KEY, NULL, 0) == 0) {
+            snprintf(label, sizeof(label), "file_bytes=%zu", size);
+            run_case("file_pread_4k", label, 4096, bench_file_pread, &ctx);
+            lrs_close(ctx.handle);
+        }
+    }
+
+    remove(ctx.input);
+    remove(ctx.encrypted);
+    remove(ctx.decrypted);
+}
+
+// The v1 format (lrs_encryption.c) lives in its own CLI, so it is measured as a
+// subprocess; peak RSS is the child's and allocations are not available
+static int run_v1(const char *command, const char *input, const char *output, long *child_rss_kib) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+        execl(options.v1_path, options.v1_path, command, "benchmark password", input, output, (char*)NULL);
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid) return -1;
+    if (usage.ru_maxrss > *child_rss_kib) *child_rss_kib = usage.ru_maxrss;
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+static void bench_v1(void) {
+    if (!selected("v1_") || access(options.v1_path, X_OK) != 0) {
+        if (selected("v1_")) fprintf(stderr, "v1: %s not found, skipped\n", options.v1_path);
+        return;
+    }
+
+    char input[512], encrypted[512], decrypted[512];
+    snprintf(input, sizeof(input), "%s/lrs_bench_v1_%d.in", options.dir, (int)getpid());
+    snprintf(encrypted, sizeof(encrypted), "%s/lrs_bench_v1_%d.lrs", options.dir, (int)getpid());
+    snprintf(decrypted, sizeof(decrypted), "%s/lrs_bench_v1_%d.out", options.dir, (int)getpid());
+
+    size_t size = 1024 * 1024;
+    if (write_random_file(input, size) == 0) {
+        static const char *commands[][2] = {{"encrypt-file", "v1_encrypt_file"}, {"decrypt-file", "v1_decrypt_file"}};
+        for (int i = 0; i < 2; i++) {
+            long child_rss = 0;
+            const char *from = i == 0 ? input : encrypted;
+            const char *to = i == 0 ? encrypted : decrypted;
+
+            double start = now_seconds();
+            int ok = run_v1(commands[i][0], from, to, &child_rss) == 0;
+            double seconds = now_seconds() - start;
+
+            print_result(commands[i][1], "subprocess", size, 1, seconds, -1, child_rss, ok);
+        }
+    }
+
+    remove(input);
+    remove(encrypted);
+    remove(decrypted);
+}
+
+static size_t parse_size(const char *text) {
+    char *end = NULL;
+    double value = strtod(text, &end);
+    switch (end && *end ? *end : ' ') {
+    case 'k': case 'K': value *= 1024; break;
+    case 'm': case 'M': value *= 1024 * 1024; break;
+    case 'g': case 'G': value *= 1024.0 * 1024 * 1024; break;
+    default: break;
+    }
+    return (size_t)value;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] > results.json\n", program);
+    fprintf(stderr, "  --quick            short runs, payloads up to 1M\n");
+    fprintf(stderr, "  --min-time SEC     minimum time per reported batch (default 0.2)\n");
+    fprintf(stderr, "  --max-size SIZE    largest AEAD payload, e.g. 64M (default 1G)\n");
+    fprintf(stderr, "  --max-file SIZE    largest file for the file APIs (default 256M)\n");
+    fprintf(stderr, "  --threads N        threads for the file APIs (default 0 = one per CPU)\n");
+    fprintf(stderr, "  --no-kdf           skip the Argon2id-bound cases\n");
+    fprintf(stderr, "  --filter TEXT      only run cases whose name contains TEXT\n");
+    fprintf(stderr, "  --v1 PATH          v1 CLI binary (default ./lrs_encryption)\n");
+    fprintf(stderr, "  --dir DIR          scratch directory (default /tmp)\n");
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--quick") == 0) {
+            options.min_time = 0.05;
+            options.max_size = 1024 * 1024;
+            options.max_file_size = 1024 * 1024;
+        } else if (strcmp(arg, "--no-kdf") == 0) {
+            options.kdf = 0;
+        } else if (value && strcmp(arg, "--min-time") == 0) {
+            options.min_time = atof(value); i++;
+        } else if (value && strcmp(arg, "--max-size") == 0) {
+            options.max_size = parse_size(value); i++;
+        } else if (value && strcmp(arg, "--max-file") == 0) {
+            options.max_file_size = parse_size(value); i++;
+        } else if (value && strcmp(arg, "--threads") == 0) {
+            options.threads = (unsigned)atoi(value); i++;
+        } else if (value && strcmp(arg, "--filter") == 0) {
+            options.filter = value; i++;
+        } else if (value && strcmp(arg, "--v1") == 0) {
+            options.v1_path = value; i++;
+        } else if (value && strcmp(arg, "--dir") == 0) {
+            options.dir = value; i++;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (sodium_init() < 0) {
+        fprintf(stderr, "Error: Failed to initialize libsodium\n");
+        return 1;
+    }
+
+    lrs_set_allocator(&counting_allocator);
+
+    printf("{\n  \"format\": \"lrs_bench/1\",\n  \"timestamp\": %lld,\n  \"cpus\": %u,\n"
+           "  \"min_time_s\": %.3f,\n  \"results\": [", (long long)time(NULL), lrs_cpu_count(), options.min_time);
+
+    bench_aead();
+    bench_hex();
+    bench_strings();
+    bench_files();
+    if (options.kdf) {
+        bench_kdf_params();
+        bench_password_paths();
+        bench_v1();
+    }
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sodium.h>
+#include "lrs_encryption_lib.h"
+
+// Command-line front end for the library (v2/v3 formats)
+// The standalone lrs_encryption tool keeps the original v1 format
+
+// Parse a positive 32-bit option value
+static int parse_u32(const char *text, uint32_t *value) {
+    char *end;
+    unsigned long parsed = strtoul(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || parsed == 0 || parsed > UINT32_MAX) return -1;
+    *value = (uint32_t)parsed;
+    return 0;
+}
+
+// Consume leading --ops/--mem-kib/--parallelism (and, where threads/paths are
+// given, --threads/--paths) options; returns the index of the first positional
+// argument, or -1 on a bad option
+static int parse_options(int argc, char *argv[], int first, lrs_kdf_params_t *params, uint32_t *threads,
+                         const char **paths) {
+    int i = first;
+    while (i + 1 < argc && strncmp(argv[i], "--", 2) == 0) {
+        uint32_t *field;
+        if (paths && strcmp(argv[i], "--paths") == 0) {
+            *paths = argv[i + 1];
+            i += 2;
+            continue;
+        }
+        if (strcmp(argv[i], "--ops") == 0) {
+            field = &params->ops;
+        } else if (strcmp(argv[i], "--mem-kib") == 0) {
+            field = &params->mem_limit_kib;
+        } else if (strcmp(argv[i], "--parallelism") == 0) {
+            field = &params->parallelism;
+        } else if (threads && strcmp(argv[i], "--threads") == 0) {
+            field = threads;
+        } else {
+            printf("Error: Unknown option %s\n", argv[i]);
+            return -1;
+        }
+        if (parse_u32(argv[i + 1], field) != 0) {
+            printf("Error: Invalid value for %s\n", argv[i]);
+            return -1;
+        }
+        i += 2;
+    }
+    return i;
+}
+
+// encrypt-dir / decrypt-dir
+static int run_dir_command(int argc, char *argv[], int decrypting) {
+    lrs_kdf_params_t params;
+    lrs_kdf_params_default(&params);
+    uint32_t threads = 0;
+    int arg = parse_options(argc, argv, 2, &params, &threads, NULL);
+    if (arg < 0) return 1;
+
+    if (argc - arg < 3) {
+        printf("Error: Missing parameters\n");
+        return 1;
+    }
+    if (lrs_set_kdf_params(&params) != 0) {
+        printf("Error: Invalid KDF parameters\n");
+        return 1;
+    }
+
+    const char *password = argv[arg];
+    const char *src_dir = argv[arg + 1];
+    const char *dst_dir = argv[arg + 2];
+    const char *paths = (argc > arg + 3) ? argv[arg + 3] : NULL;
+    const uint8_t *aad = (const uint8_t*)paths;
+    size_t aad_len = paths ? strlen(paths) : 0;
+
+    lrs_dir_stats_t stats;
+    int result = decrypting
+        ? lrs_decrypt_dir(src_dir, dst_dir, password, KEY_MODE_PASSWORD, aad, aad_len, threads, &stats)
+        : lrs_encrypt_dir(src_dir, dst_dir, password, KEY_MODE_PASSWORD, aad, aad_len, threads, &stats);
+    if (result < 0) {
+        printf("Error: Cannot walk %s or create %s\n", src_dir, dst_dir);
+        return 1;
+    }
+
+    double seconds = stats.seconds > 0 ? stats.seconds : 1e-9;
+    printf("%s %llu files (%.1f MB) in %.2f s: %.0f files/s, %.1f MB/s\n",
+           decrypting ? "Decrypted" : "Encrypted", (unsigned long long)stats.files, stats.bytes / 1e6,
+           stats.seconds, stats.files / seconds, stats.bytes / 1e6 / seconds);
+    if (stats.skipped) {
+        printf("Skipped %llu entries\n", (unsigned long long)stats.skipped);
+    }
+    if (stats.failed) {
+        printf("%llu files failed%s\n", (unsigned long long)stats.failed,
+               decrypting ? " (wrong password or tampered data)" : "");
+        return 1;
+    }
+    return 0;
+}
+
+// Why a file failed verification
+static const char *verify_error(int code) {
+    switch (code) {
+        case -1: return "cannot read or not an LRS file";
+        case -2: return "unsupported version";
+        case -7: return "key derivation failed";
+        case -8: return "authentication failed (wrong password or damaged data)";
+        case -9: return "invalid chunk layout";
+        case -11: return "memory budget exhausted";
+        default: return "invalid header";
+    }
+}
+
+// verify: authenticate files without writing plaintext
+static int run_verify_command(int argc, char *argv[]) {
+    lrs_kdf_params_t params;
+    lrs_kdf_params_default(&params);
+    uint32_t threads = 0;
+    const char *paths = NULL;
+    int arg = parse_options(argc, argv, 2, &params, &threads, &paths);
+    if (arg < 0) return 1;
+
+    if (argc - arg < 2) {
+        printf("Error: Missing parameters\n");
+        return 1;
+    }
+
+    const char *password = argv[arg];
+    const char *const *files = (const char *const *)(argv + arg + 1);
+    size_t count = (size_t)(argc - arg - 1);
+    int *results = (int*)calloc(count, sizeof(int));
+    if (!results) {
+        printf("Error: Out of memory\n");
+        return 1;
+    }
+
+    // Files of one session (e.g. a tree from encrypt-dir) share a salt, so the
+    // password is stretched once
+    lrs_key_cache_enable(64, 0);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int failed = lrs_verify_files(files, count, password, KEY_MODE_PASSWORD, (const uint8_t*)paths,
+                                  paths ? strlen(paths) : 0, threads, results);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    lrs_key_cache_disable();
+    if (failed < 0) {
+        printf("Error: Cannot verify (invalid arguments)\n");
+        free(results);
+        return 1;
+    }
+
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        struct stat st;
+        if (results[i] != 0) {
+            printf("%s: %s\n", files[i], verify_error(results[i]));
+        } else if (stat(files[i], &st) == 0) {
+            bytes += (uint64_t)st.st_size;
+        }
+    }
+
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    if (seconds <= 0) seconds = 1e-9;
+    printf("Verified %zu files (%.1f MB) in %.2f s: %.1f MB/s\n", count - (size_t)failed, bytes / 1e6,
+           seconds, bytes / 1e6 / seconds);
+    if (failed) {
+        printf("%d files failed\n", failed);
+    }
+    free(results);
+    return failed ? 1 : 0;
+}
+
+// rekey: change the password of containers in place, without touching payloads
+static int run_rekey_command(int argc, char *argv[]) {
+    lrs_kdf_params_t params;
+    lrs_kdf_params_default(&params);
+    uint32_t threads = 0;
+    int arg = parse_options(argc, argv, 2, &params, &threads, NULL);
+    if (arg < 0) return 1;
+
+    if (argc - arg < 3) {
+        printf("Error: Missing parameters\n");
+        return 1;
+    }
+    if (lrs_set_kdf_params(&params) != 0) {
+        printf("Error: Invalid KDF parameters\n");
+        return 1;
+    }
+
+    const char *old_password = argv[arg];
+    const char *new_password = argv[arg + 1];
+    const char *const *files = (const char *const *)(argv + arg + 2);
+    size_t count = (size_t)(argc - arg - 2);
+    int *results = (int*)calloc(count, sizeof(int));
+    if (!results) {
+        printf("Error: Out of memory\n");
+        return 1;
+    }
+
+    // The new password is stretched once for all files (they become objects of
+    // one session, as encrypt-dir writes them); files sharing an old salt share
+    // the old derivation through the cache
+    lrs_session_t session;
+    if (lrs_session_open(&session, new_password, KEY_MODE_PASSWORD) != 0) {
+        printf("Error: Key derivation failed\n");
+        free(results);
+        return 1;
+    }
+    lrs_key_cache_enable(64, 0);
+    int failed = lrs_rekey_files(files, count, old_password, KEY_MODE_PASSWORD, &session, KEY_MODE_SESSION,
+                                 threads, results);
+    lrs_key_cache_disable();
+    lrs_session_close(&session);
+    if (failed < 0) {
+        printf("Error: Invalid arguments\n");
+        free(results);
+        return 1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (results[i] == -12) {
+            printf("%s: no key slot (written by an older version; re-encrypt it)\n", files[i]);
+        } else if (results[i] != 0) {
+            printf("%s: %s\n", files[i], verify_error(results[i]));
+        }
+    }
+    printf("Rekeyed %zu files\n", count - (size_t)failed);
+    if (failed) {
+        printf("%d files failed\n", failed);
+    }
+    free(results);
+    return failed ? 1 : 0;
+}
+
+// Paths inspected per pass, so a listing of millions streams in bounded memory
+#define INSPECT_BATCH 65536
+
+// Next path: from the argument list, or one per line from stdin for "-"
+static char *next_inspect_path(int argc, char *argv[], int *arg, int *from_stdin) {
+    while (!*from_stdin && *arg < argc) {
+        char *path = argv[(*arg)++];
+        if (strcmp(path, "-") != 0) return strdup(path);
+        *from_stdin = 1;
+    }
+    if (!*from_stdin) return NULL;
+
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    while ((length = getline(&line, &capacity, stdin)) >= 0) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) line[--length] = '\0';
+        if (length > 0) return line;
+    }
+    free(line);
+    *from_stdin = 0; // Done with stdin, continue with the arguments
+    return next_inspect_path(argc, argv, arg, from_stdin);
+}
+
+// inspect: list header fields of containers as JSON Lines or CSV
+static int run_inspect_command(int argc, char *argv[]) {
+    uint32_t threads = 0;
+    int format = LRS_INSPECT_JSON;
+    int arg = 2;
+    while (arg + 1 < argc && strncmp(argv[arg], "--", 2) == 0) {
+        if (strcmp(argv[arg], "--threads") == 0 && parse_u32(argv[arg + 1], &threads) == 0) {
+            arg += 2;
+        } else if (strcmp(argv[arg], "--format") == 0 &&
+                   (strcmp(argv[arg + 1], "json") == 0 || strcmp(argv[arg + 1], "csv") == 0)) {
+            format = strcmp(argv[arg + 1], "csv") == 0 ? LRS_INSPECT_CSV : LRS_INSPECT_JSON;
+            arg += 2;
+        } else {
+            printf("Error: Invalid option %s\n", argv[arg]);
+            return 1;
+        }
+    }
+    if (arg >= argc) {
+        printf("Error: Missing parameters\n");
+        return 1;
+    }
+
+    char **paths = (char**)malloc(INSPECT_BATCH * sizeof(char*));
+    lrs_inspect_t *infos = (lrs_inspect_t*)malloc(INSPECT_BATCH * sizeof(lrs_inspect_t));
+    if (!paths || !infos) {
+        printf("Error: Out of memory\n");
+        free(paths);
+        free(infos);
+        return 1;
+    }
+
+    lrs_inspect_write_header(stdout, format);
+    int from_stdin = 0;
+    size_t failed = 0;
+    for (;;) {
+        size_t count = 0;
+        while (count < INSPECT_BATCH && (paths[count] = next_inspect_path(argc, argv, &arg, &from_stdin)) != NULL) {
+            count++;
+        }
+        if (count == 0) break;
+
+        failed += lrs_inspect_files((const char *const *)paths, count, infos, threads);
+        for (size_t i = 0; i < count; i++) {
+            lrs_inspect_write(stdout, paths[i], &infos[i], format);
+            free(paths[i]);
+        }
+        if (count < INSPECT_BATCH) break;
+    }
+
+    free(paths);
+    free(infos);
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (sodium_init() < 0) {
+        printf("Error initializing libsodium\n");
+        return 1;
+    }
+
+    if (argc < 2) {
+        printf("Usage:\n");
+        printf("  %s calibrate [target_ms] [max_mem_mib]\n", argv[0]);
+        printf("  %s encrypt-file [--ops N] [--mem-kib N] [--parallelism N] <password> <input_file> <output_file> [paths]\n", argv[0]);
+        printf("  %s decrypt-file <password> <input_file> <output_file> [paths]\n", argv[0]);
+        printf("  %s encrypt-dir [--threads N] [--ops N] [--mem-kib N] [--parallelism N] <password> <src_dir> <dst_dir> [paths]\n", argv[0]);
+        printf("  %s decrypt-dir [--threads N] <password> <src_dir> <dst_dir> [paths]\n", argv[0]);
+        printf("  %s verify [--threads N] [--paths P] <password> <file> [file...]\n", argv[0]);
+        printf("  %s inspect [--threads N] [--format json|csv] <file|-> [file...]\n", argv[0]);
+        printf("  %s rekey [--threads N] [--ops N] [--mem-kib N] [--parallelism N] <old_password> <new_password> <file> [file...]\n", argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "calibrate") == 0) {
+        uint32_t target_ms = 1000;
+        uint32_t max_mem_mib = LRS_KDF_MEM_LIMIT_KIB_DEFAULT / 1024;
+        if ((argc > 2 && parse_u32(argv[2], &target_ms) != 0) ||
+            (argc > 3 && parse_u32(argv[3], &max_mem_mib) != 0) ||
+            max_mem_mib > UINT32_MAX / 1024) {
+            printf("Error: Invalid target or memory limit\n");
+            return 1;
+        }
+
+        lrs_kdf_params_t params;
+        uint32_t measured_ms = 0;
+        int result = lrs_kdf_calibrate(target_ms, max_mem_mib * 1024, &params, &measured_ms);
+        if (result == -1) {
+            printf("Calibration failed\n");
+            return 1;
+        }
+
+        if (result == -2) {
+            printf("Warning: target %u ms not reachable, fastest setting takes %u ms\n",
+                   target_ms, measured_ms);
+        }
+        printf("ops=%u mem_kib=%u parallelism=%u measured_ms=%u\n",
+               params.ops, params.mem_limit_kib, params.parallelism, measured_ms);
+        printf("Use: %s encrypt-file --ops %u --mem-kib %u --parallelism %u ...\n",
+               argv[0], params.ops, params.mem_limit_kib, params.parallelism);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "encrypt-file") == 0) {
+        lrs_kdf_params_t params;
+        lrs_kdf_params_default(&params);
+        int arg = parse_options(argc, argv, 2, &params, NULL, NULL);
+        if (arg < 0) return 1;
+
+        if (argc - arg < 3) {
+            printf("Error: Missing parameters\n");
+            return 1;
+        }
+        if (lrs_set_kdf_params(&params) != 0) {
+            printf("Error: Invalid KDF parameters\n");
+            return 1;
+        }
+
+        const char *password = argv[arg];
+        const char *input_file = argv[arg + 1];
+        const char *output_file = argv[arg + 2];
+        const char *paths = (argc > arg + 3) ? argv[arg + 3] : NULL;
+
+        if (encrypt_file(input_file, output_file, password, paths) == 0) {
+            printf("File encrypted successfully: %s -> %s\n", input_file, output_file);
+            return 0;
+        } else {
+            printf("File encryption failed\n");
+            return 1;
+        }
+    }
+
+    if (strcmp(argv[1], "decrypt-file") == 0) {
+        if (argc < 5) {
+            printf("Error: Missing parameters\n");
+            return 1;
+        }
+
+        const char *password = argv[2];
+        const char *input_file = argv[3];
+        const char *output_file = argv[4];
+        const char *paths = (argc > 5) ? argv[5] : NULL;
+
+        // KDF parameters come from the file header
+        if (decrypt_file(input_file, output_file, password, paths) == 0) {
+            printf("File decrypted successfully: %s -> %s\n", input_file, output_file);
+            return 0;
+        } else {
+            printf("File decryption failed (wrong password or tampered data)\n");
+            return 1;
+        }
+    }
+
+    if (strcmp(argv[1], "encrypt-dir") == 0) {
+        return run_dir_command(argc, argv, 0);
+    }
+
+    if (strcmp(argv[1], "decrypt-dir") == 0) {
+        return run_dir_command(argc, argv, 1);
+    }
+
+    if (strcmp(argv[1], "verify") == 0) {
+        return run_verify_command(argc, argv);
+    }
+
+    if (strcmp(argv[1], "inspect") == 0) {
+        return run_inspect_command(argc, argv);
+    }
+
+    if (strcmp(argv[1], "rekey") == 0) {
+        return run_rekey_command(argc, argv);
+    }
+
+    printf("Error: Unknown command '%s'\n", argv[1]);
+    return 1;
+}
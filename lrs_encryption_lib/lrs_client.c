@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include "lrs_encryption_lib.h"
+#include "lrs_client.h"
+
+// Client side of the lrsd protocol (see lrs_client.h)
+struct lrs_client {
+    int fd;
+    uint32_t next_request_id;
+};
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const uint8_t *p = (const uint8_t*)buf;
+    while (len > 0) {
+        ssize_t written = send(fd, p, len, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return -1;
+        p += written;
+        len -= (size_t)written;
+    }
+    return 0;
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+    uint8_t *p = (uint8_t*)buf;
+    while (len > 0) {
+        ssize_t got = read(fd, p, len);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return -1;
+        p += got;
+        len -= (size_t)got;
+    }
+    return 0;
+}
+
+lrs_client_t *lrs_client_connect(const char *socket_path) {
+    struct sockaddr_un addr;
+    if (!socket_path || strlen(socket_path) >= sizeof(addr.sun_path)) return NULL;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return NULL;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    lrs_client_t *client = (lrs_client_t*)malloc(sizeof(lrs_client_t));
+    if (!client) {
+        close(fd);
+        return NULL;
+    }
+    client->fd = fd;
+    client->next_request_id = 1;
+    return client;
+}
+
+void lrs_client_close(lrs_client_t *client) {
+    if (!client) return;
+
+    close(client->fd);
+    free(client);
+}
+
+int lrs_client_submit(lrs_client_t *client, uint8_t op, const void *key_material, int key_mode,
+                      const uint8_t *aad, size_t aad_len, const uint8_t *data, size_t data_len,
+                      uint32_t *request_id) {
+    if (!client || (aad_len && !aad) || (data_len && !data)) return -1;
+    if (aad_len > LRSD_PAYLOAD_MAX || data_len > LRSD_PAYLOAD_MAX - aad_len) return -5;
+
+    size_t key_len = 0;
+    if (op != LRSD_OP_STATS) {
+        if (!key_material) return -1;
+        if (key_mode == KEY_MODE_PASSWORD) {
+            key_len = strlen((const char*)key_material);
+        } else if (key_mode == KEY_MODE_RAW_KEY) {
+            key_len = 8 * sizeof(uint32_t);
+        } else {
+            return -6; // Sessions live in the daemon
+        }
+        if (key_len > LRSD_KEY_MAX) return -5;
+    }
+
+    uint32_t id = client->next_request_id++;
+    uint8_t header[LRSD_REQUEST_HEADER_SIZE];
+    uint16_t key_len_n = htons((uint16_t)key_len);
+    uint32_t id_n = htonl(id);
+    uint32_t aad_len_n = htonl((uint32_t)aad_len);
+    uint32_t data_len_n = htonl((uint32_t)data_len);
+    header[0] = op;
+    header[1] = (uint8_t)key_mode;
+    memcpy(header + 2, &key_len_n, 2);
+    memcpy(header + 4, &id_n, 4);
+    memcpy(header + 8, &aad_len_n, 4);
+    memcpy(header + 12, &data_len_n, 4);
+
+    if (write_full(client->fd, header, sizeof(header)) != 0 ||
+        write_full(client->fd, key_material, key_len) != 0 ||
+        write_full(client->fd, aad, aad_len) != 0 ||
+        write_full(client->fd, data, data_len) != 0) {
+        return -1;
+    }
+
+    if (request_id) *request_id = id;
+    return 0;
+}
+
+int lrs_client_receive(lrs_client_t *client, uint32_t *request_id, uint8_t **out, size_t *out_len) {
+    if (!client || !out || !out_len) return -1;
+    *out = NULL;
+    *out_len = 0;
+
+    uint8_t header[LRSD_RESPONSE_HEADER_SIZE];
+    if (read_full(client->fd, header, sizeof(header)) != 0) return -1;
+
+    uint16_t status_n;
+    uint32_t id_n, len_n;
+    memcpy(&status_n, header + 2, 2);
+    memcpy(&id_n, header + 4, 4);
+    memcpy(&len_n, header + 8, 4);
+    int status = (int16_t)ntohs(status_n);
+    size_t len = ntohl(len_n);
+    if (request_id) *request_id = ntohl(id_n);
+    if (len > LRSD_PAYLOAD_MAX + LRS_TLV_MAX + sizeof(header_t) + crypto_aead_xchacha20poly1305_ietf_ABYTES) {
+        return -1; // Not a response we could have asked for
+    }
+
+    uint8_t *data = (uint8_t*)malloc(len ? len : 1);
+    if (!data) return -1;
+    if (read_full(client->fd, data, len) != 0) {
+        free(data);
+        return -1;
+    }
+
+    if (status != 0) {
+        free(data);
+        return status;
+    }
+    *out = data;
+    *out_len = len;
+    return 0;
+}
+
+// Submit one request and wait for its response
+static int round_trip(lrs_client_t *client, uint8_t op, const void *key_material, int key_mode,
+                      const uint8_t *aad, size_t aad_len, const uint8_t *data, size_t data_len,
+                      uint8_t **out, size_t *out_len) {
+    int result = lrs_client_submit(client, op, key_material, key_mode, aad, aad_len, data, data_len, NULL);
+    if (result != 0) return result;
+
+    return lrs_client_receive(client, NULL, out, out_len);
+}
+
+int lrs_client_encrypt(lrs_client_t *client, const void *key_material, int key_mode,
+                       const uint8_t *aad, size_t aad_len, const uint8_t *plaintext, size_t pt_len,
+                       uint8_t **out, size_t *out_len) {
+    return round_trip(client, LRSD_OP_ENCRYPT, key_material, key_mode, aad, aad_len,
+                      plaintext, pt_len, out, out_len);
+}
+
+int lrs_client_decrypt(lrs_client_t *client, const void *key_material, int key_mode,
+                       const uint8_t *aad, size_t aad_len, const uint8_t *blob, size_t blob_len,
+                       uint8_t **out, size_t *out_len) {
+    return round_trip(client, LRSD_OP_DECRYPT, key_material, key_mode, aad, aad_len,
+                      blob, blob_len, out, out_len);
+}
+
+int lrs_client_stats(lrs_client_t *client, lrsd_stats_t *stats) {
+    if (!stats) return -1;
+
+    uint8_t *data = NULL;
+    size_t len = 0;
+    int result = round_trip(client, LRSD_OP_STATS, NULL, 0, NULL, 0, NULL, 0, &data, &len);
+    if (result != 0) return result;
+
+    uint64_t *fields = (uint64_t*)stats;
+    size_t count = sizeof(*stats) / sizeof(uint64_t);
+    memset(stats, 0, sizeof(*stats));
+    for (size_t i = 0; i < count && (i + 1) * 8 <= len; i++) {
+        uint64_t value = 0;
+        for (int b = 0; b < 8; b++) value = (value << 8) | data[i * 8 + b];
+        fields[i] = value;
+    }
+    free(data);
+    return 0;
+}
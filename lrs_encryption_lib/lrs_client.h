@@ -0,0 +1,66 @@
+#ifndef LRS_CLIENT_H
+#define LRS_CLIENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Client for lrsd, the encryption daemon (lrsd.c)
+//
+// Wire protocol on a Unix stream socket; integers in network byte order.
+// Request:  op(1) key_mode(1) key_len(2) request_id(4) aad_len(4) data_len(4),
+//           then key_len bytes of key material, the AAD and the data.
+// Response: op(1) reserved(1) status(2, signed) request_id(4) data_len(4), then data.
+// Requests on one connection may be pipelined; responses come back in order.
+// ENCRYPT returns a standalone v2 blob (header, TLV section, ciphertext) under a
+// session the daemon keeps for the key; DECRYPT takes such a blob (from the
+// daemon or from encrypt_blob_ex) and returns the plaintext. Status is 0 or a
+// decrypt_blob_ex error code.
+#define LRSD_OP_ENCRYPT 1
+#define LRSD_OP_DECRYPT 2
+#define LRSD_OP_STATS 3
+
+#define LRSD_REQUEST_HEADER_SIZE 16
+#define LRSD_RESPONSE_HEADER_SIZE 12
+#define LRSD_KEY_MAX 1024
+#define LRSD_PAYLOAD_MAX (16 * 1024 * 1024) // AAD + data of one request
+
+// Daemon counters (LRSD_OP_STATS returns them in this order as 64-bit integers)
+typedef struct {
+    uint64_t connections;         // Accepted
+    uint64_t active_connections;
+    uint64_t requests;
+    uint64_t errors;              // Answered with a non-zero status
+    uint64_t bytes_in;            // Request payload bytes
+    uint64_t bytes_out;           // Response payload bytes
+    uint64_t sessions;            // Cached now
+    uint64_t session_opens;       // Key derivations for new sessions
+    uint64_t session_hits;
+    uint64_t uptime_ms;
+} lrsd_stats_t;
+
+typedef struct lrs_client lrs_client_t;
+
+// Connect to a daemon; NULL on failure
+lrs_client_t* lrs_client_connect(const char* socket_path);
+void lrs_client_close(lrs_client_t* client);
+
+// One request, one response. *out is malloc'd (free it) and set only on success.
+// Returns 0, a daemon status (decrypt_blob_ex codes) or -1 on connection errors.
+int lrs_client_encrypt(lrs_client_t* client, const void* key_material, int key_mode,
+                       const uint8_t* aad, size_t aad_len, const uint8_t* plaintext, size_t pt_len,
+                       uint8_t** out, size_t* out_len);
+int lrs_client_decrypt(lrs_client_t* client, const void* key_material, int key_mode,
+                       const uint8_t* aad, size_t aad_len, const uint8_t* blob, size_t blob_len,
+                       uint8_t** out, size_t* out_len);
+int lrs_client_stats(lrs_client_t* client, lrsd_stats_t* stats);
+
+// Pipelining: submit any number of requests, then receive the responses in
+// submission order. Keep what is in flight within the socket buffers (a few
+// hundred KiB each way) or receive on another thread, or both sides block.
+// Passwords are NUL-terminated strings; raw keys are uint32_t[8] as for encrypt_blob_ex.
+int lrs_client_submit(lrs_client_t* client, uint8_t op, const void* key_material, int key_mode,
+                      const uint8_t* aad, size_t aad_len, const uint8_t* data, size_t data_len,
+                      uint32_t* request_id);
+int lrs_client_receive(lrs_client_t* client, uint32_t* request_id, uint8_t** out, size_t* out_len);
+
+#endif // LRS_CLIENT_H
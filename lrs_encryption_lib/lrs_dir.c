@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "lrs_encryption_lib.h"
+
+// Directory trees
+// The tree is walked once up front; directories are created, then the files are
+// handed to a pool largest first, so one big file does not end up as the tail
+// of the run. Every file is a single-threaded file operation (mmap where
+// possible); the parallelism comes from running one file per thread.
+
+#define LRS_DIR_SUFFIX ".lrs"
+
+typedef struct {
+    char *path;                   // Relative to the tree root
+    mode_t mode;
+    off_t size;
+} dir_entry_t;
+
+typedef struct {
+    dir_entry_t *entries;
+    size_t count;
+    size_t capacity;
+} dir_list_t;
+
+typedef struct {
+    const char *src_root;
+    const char *dst_root;
+    const dir_entry_t *files;
+    const lrs_session_t *session; // Shared by every file (decrypt: NULL if none could be opened)
+    const void *fallback_key;     // Decrypt: password or raw key for other sessions (NULL if none)
+    int fallback_mode;
+    const uint8_t *aad;
+    size_t aad_len;
+    int decrypting;
+    uint64_t failed;
+    uint64_t bytes;
+} dir_job_t;
+
+// Copy a string with the library allocator (release with lrs_free)
+static char *dup_string(const char *text) {
+    size_t length = strlen(text) + 1;
+    char *copy = (char*)lrs_alloc(length);
+    if (copy) memcpy(copy, text, length);
+    return copy;
+}
+
+static int dir_list_add(dir_list_t *list, const char *path, mode_t mode, off_t size) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        dir_entry_t *grown = (dir_entry_t*)lrs_alloc(capacity * sizeof(dir_entry_t));
+        if (!grown) return -1;
+        if (list->count) memcpy(grown, list->entries, list->count * sizeof(dir_entry_t));
+        lrs_free(list->entries);
+        list->entries = grown;
+        list->capacity = capacity;
+    }
+
+    char *copy = dup_string(path);
+    if (!copy) return -1;
+    list->entries[list->count++] = (dir_entry_t){ copy, mode, size };
+    return 0;
+}
+
+static void dir_list_free(dir_list_t *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        lrs_free(list->entries[i].path);
+    }
+    lrs_free(list->entries);
+}
+
+// Join root and relative path into a new string
+static char *join_path(const char *root, const char *relative) {
+    size_t root_len = strlen(root);
+    size_t length = root_len + 1 + strlen(relative) + 1;
+    char *path = (char*)lrs_alloc(length);
+    if (path) {
+        snprintf(path, length, "%s%s%s", root, root_len && root[root_len - 1] == '/' ? "" : "/", relative);
+    }
+    return path;
+}
+
+// Collect directories (parents first) and regular files below root/relative;
+// symlinks and special files are counted as skipped
+static int walk_tree(const char *root, const char *relative, dir_list_t *dirs, dir_list_t *files,
+                     uint64_t *skipped) {
+    char *path = relative[0] ? join_path(root, relative) : dup_string(root);
+    DIR *dir = path ? opendir(path) : NULL;
+    if (!dir) {
+        lrs_free(path);
+        return -1;
+    }
+
+    int result = 0;
+    struct dirent *entry;
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        struct stat st;
+        if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            result = -1;
+            break;
+        }
+
+        char *child = relative[0] ? join_path(relative, entry->d_name) : dup_string(entry->d_name);
+        if (!child) {
+            result = -1;
+        } else if (S_ISDIR(st.st_mode)) {
+            result = dir_list_add(dirs, child, st.st_mode & 07777, 0);
+            if (result == 0) result = walk_tree(root, child, dirs, files, skipped);
+        } else if (S_ISREG(st.st_mode)) {
+            result = dir_list_add(files, child, st.st_mode & 07777, st.st_size);
+        } else {
+            (*skipped)++;
+        }
+        lrs_free(child);
+    }
+
+    closedir(dir);
+    lrs_free(path);
+    return result;
+}
+
+static int larger_first(const void *a, const void *b) {
+    off_t size_a = ((const dir_entry_t*)a)->size;
+    off_t size_b = ((const dir_entry_t*)b)->size;
+    return size_a < size_b ? 1 : size_a > size_b ? -1 : 0;
+}
+
+// Encrypt or decrypt one file of the job
+static void process_file(void *arg, size_t index) {
+    dir_job_t *job = (dir_job_t*)arg;
+    const dir_entry_t *file = &job->files[index];
+
+    // Output name: add the suffix when encrypting, strip it when decrypting
+    char *src = join_path(job->src_root, file->path);
+    char *dst = join_path(job->dst_root, file->path);
+    if (dst && job->decrypting) {
+        dst[strlen(dst) - strlen(LRS_DIR_SUFFIX)] = '\0';
+    } else if (dst) {
+        char *suffixed = (char*)lrs_alloc(strlen(dst) + sizeof(LRS_DIR_SUFFIX));
+        if (suffixed) sprintf(suffixed, "%s%s", dst, LRS_DIR_SUFFIX);
+        lrs_free(dst);
+        dst = suffixed;
+    }
+
+    int result = -1;
+    if (src && dst) {
+        if (job->decrypting) {
+            result = job->session ? decrypt_file_ex(src, dst, job->session, KEY_MODE_SESSION,
+                                                    job->aad, job->aad_len, 1) : -10;
+            if (result == -10 && job->fallback_key) {
+                // Written by another session: derive this file's own key
+                result = decrypt_file_ex(src, dst, job->fallback_key, job->fallback_mode,
+                                         job->aad, job->aad_len, 1);
+            }
+        } else {
+            result = encrypt_file_ex(src, dst, job->session, KEY_MODE_SESSION,
+                                     job->aad, job->aad_len, 1);
+        }
+    }
+    if (result == 0 && chmod(dst, file->mode) != 0) {
+        result = -1;
+    }
+
+    if (result == 0) {
+        __atomic_fetch_add(&job->bytes, (uint64_t)file->size, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+    lrs_free(src);
+    lrs_free(dst);
+}
+
+// Open the session recorded in a container's header
+static int session_from_file(lrs_session_t *session, const char *path, const void *key_material, int key_mode) {
+    FILE *in = fopen(path, "rb");
+    if (!in) return -1;
+
+    header_t header;
+    int result = fread(&header, sizeof(header), 1, in) == 1 ? 0 : -1;
+    fclose(in);
+    if (result != 0 || memcmp(header.magic, MAGIC, 3) != 0) return -1;
+
+    return lrs_session_open_header(session, key_material, key_mode, &header);
+}
+
+static int has_suffix(const char *path) {
+    size_t length = strlen(path);
+    return length > strlen(LRS_DIR_SUFFIX) &&
+           strcmp(path + length - strlen(LRS_DIR_SUFFIX), LRS_DIR_SUFFIX) == 0;
+}
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int process_tree(const char *src_dir, const char *dst_dir, const void *key_material, int key_mode,
+                        const uint8_t *aad, size_t aad_len, unsigned threads, int decrypting,
+                        lrs_dir_stats_t *stats) {
+    lrs_dir_stats_t local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    if (!src_dir || !dst_dir || !key_material) return -1;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    dir_list_t dirs = {0}, files = {0};
+    if (walk_tree(src_dir, "", &dirs, &files, &stats->skipped) != 0) {
+        dir_list_free(&dirs);
+        dir_list_free(&files);
+        return -1;
+    }
+
+    // Only containers are decrypted
+    if (decrypting) {
+        size_t kept = 0;
+        for (size_t i = 0; i < files.count; i++) {
+            if (has_suffix(files.entries[i].path)) {
+                files.entries[kept++] = files.entries[i];
+            } else {
+                lrs_free(files.entries[i].path);
+                stats->skipped++;
+            }
+        }
+        files.count = kept;
+    }
+
+    // Directories stay writable until every file is in place
+    int result = mkdir(dst_dir, 0700) == 0 || errno == EEXIST ? 0 : -1;
+    for (size_t i = 0; i < dirs.count && result == 0; i++) {
+        char *path = join_path(dst_dir, dirs.entries[i].path);
+        result = path && (mkdir(path, 0700) == 0 || errno == EEXIST) ? 0 : -1;
+        lrs_free(path);
+    }
+
+    // One session for the whole tree: a single KDF, then one subkey per file
+    qsort(files.entries, files.count, sizeof(dir_entry_t), larger_first);
+    lrs_session_t own_session = {0};
+    const void *session = key_mode == KEY_MODE_SESSION ? key_material : NULL;
+    if (result == 0 && !session) {
+        if (!decrypting) {
+            result = lrs_session_open(&own_session, key_material, key_mode) == 0 ? 0 : -1;
+            session = result == 0 ? &own_session : NULL;
+        } else if (files.count > 0) {
+            // A tree written by lrs_encrypt_dir has its session in every header
+            char *path = join_path(src_dir, files.entries[0].path);
+            if (path && session_from_file(&own_session, path, key_material, key_mode) == 0) {
+                session = &own_session;
+            }
+            lrs_free(path);
+        }
+    }
+
+    dir_job_t job = {
+        .src_root = src_dir, .dst_root = dst_dir, .files = files.entries, .session = session,
+        .fallback_key = key_mode != KEY_MODE_SESSION ? key_material : NULL, .fallback_mode = key_mode,
+        .aad = aad, .aad_len = aad_len, .decrypting = decrypting,
+    };
+    if (result == 0) {
+        lrs_parallel_for(threads, files.count, process_file, &job);
+        stats->files = files.count - job.failed;
+        stats->failed = job.failed;
+        stats->bytes = job.bytes;
+    }
+    if (own_session.master_key) {
+        lrs_session_close(&own_session);
+    }
+
+    // Directory permissions last, deepest first
+    struct stat root;
+    for (size_t i = dirs.count; i-- > 0 && result == 0;) {
+        char *path = join_path(dst_dir, dirs.entries[i].path);
+        if (!path || chmod(path, dirs.entries[i].mode) != 0) result = -1;
+        lrs_free(path);
+    }
+    if (result == 0 && (stat(src_dir, &root) != 0 || chmod(dst_dir, root.st_mode & 07777) != 0)) {
+        result = -1;
+    }
+
+    dir_list_free(&dirs);
+    dir_list_free(&files);
+    stats->seconds = seconds_since(&start);
+    return result != 0 ? -1 : (int)job.failed;
+}
+
+// Encrypt every regular file under src_dir into dst_dir
+int lrs_encrypt_dir(const char *src_dir, const char *dst_dir, const void *key_material, int key_mode,
+                    const uint8_t *aad, size_t aad_len, unsigned threads, lrs_dir_stats_t *stats) {
+    return process_tree(src_dir, dst_dir, key_material, key_mode, aad, aad_len, threads, 0, stats);
+}
+
+// Decrypt every container under src_dir into dst_dir
+int lrs_decrypt_dir(const char *src_dir, const char *dst_dir, const void *key_material, int key_mode,
+                    const uint8_t *aad, size_t aad_len, unsigned threads, lrs_dir_stats_t *stats) {
+    return process_tree(src_dir, dst_dir, key_material, key_mode, aad, aad_len, threads, 1, stats);
+}
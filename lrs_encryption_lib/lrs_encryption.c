@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <sodium.h>
 
 #define MAGIC "LRS1"
@@ -29,11 +31,8 @@ int derive_key_argon2id(const char *pwd, const uint8_t salt[16],
         crypto_pwhash_ALG_ARGON2ID13);
 }
 
-// Encrypt data using XChaCha20-Poly1305
-int encrypt_blob(const uint8_t *pt, size_t pt_len,
-                const char *pwd, const uint8_t *aad, size_t aad_len,
-                header_t *hdr, uint8_t *ct, size_t *ct_len) {
-    // Set up header
+// Fill in a fresh header: parameters, random salt and nonce, paths hash
+static void init_header(header_t *hdr, const uint8_t *aad, size_t aad_len) {
     memcpy(hdr->magic, MAGIC, 4);
     hdr->version = VERSION;
     hdr->kdf_mem_log2 = 28;  // ~256MB
@@ -51,27 +50,54 @@ int encrypt_blob(const uint8_t *pt, size_t pt_len,
     } else {
         memset(hdr->paths_hash, 0, sizeof(hdr->paths_hash));
     }
+}
 
-    // Derive key using Argon2id
-    uint8_t key[32];
-    if (derive_key_argon2id(pwd, hdr->salt, hdr->kdf_mem_log2, hdr->kdf_ops, hdr->kdf_parallel, key) != 0) {
-        return -1;
-    }
-
-    // Encrypt using XChaCha20-Poly1305
+// Encrypt using XChaCha20-Poly1305 with an already derived key
+static int seal_blob(const uint8_t key[32], const uint8_t *pt, size_t pt_len,
+                     const uint8_t *aad, size_t aad_len, const header_t *hdr, uint8_t *ct, size_t *ct_len) {
     unsigned long long clen = 0;
     if (crypto_aead_xchacha20poly1305_ietf_encrypt(ct, &clen,
             pt, pt_len, aad, aad_len,
             NULL, hdr->nonce, key) != 0) {
-        sodium_memzero(key, sizeof key);
         return -1;
     }
 
     *ct_len = (size_t)clen;
-    sodium_memzero(key, sizeof key);
     return 0;
 }
 
+// Decrypt using XChaCha20-Poly1305 with an already derived key
+static int open_blob(const uint8_t key[32], const uint8_t *ct, size_t ct_len,
+                     const uint8_t *aad, size_t aad_len, const header_t *hdr, uint8_t *pt, size_t *pt_len) {
+    unsigned long long plen = 0;
+    if (crypto_aead_xchacha20poly1305_ietf_decrypt(pt, &plen,
+            NULL, ct, ct_len, aad, aad_len, hdr->nonce, key) != 0) {
+        return -1; // auth fail => no output
+    }
+
+    *pt_len = (size_t)plen;
+    return 0;
+}
+
+// Encrypt data using XChaCha20-Poly1305
+int encrypt_blob(const uint8_t *pt, size_t pt_len,
+                const char *pwd, const uint8_t *aad, size_t aad_len,
+                header_t *hdr, uint8_t *ct, size_t *ct_len) {
+    // Set up header
+    init_header(hdr, aad, aad_len);
+
+    // Derive key using Argon2id
+    uint8_t key[32];
+    if (derive_key_argon2id(pwd, hdr->salt, hdr->kdf_mem_log2, hdr->kdf_ops, hdr->kdf_parallel, key) != 0) {
+        return -1;
+    }
+
+    // Encrypt using XChaCha20-Poly1305
+    int result = seal_blob(key, pt, pt_len, aad, aad_len, hdr, ct, ct_len);
+    sodium_memzero(key, sizeof key);
+    return result;
+}
+
 // Decrypt data using XChaCha20-Poly1305
 int decrypt_blob(const uint8_t *ct, size_t ct_len,
                 const char *pwd, const uint8_t *aad, size_t aad_len,
@@ -88,16 +114,9 @@ int decrypt_blob(const uint8_t *ct, size_t ct_len,
     }
 
     // Decrypt using XChaCha20-Poly1305
-    unsigned long long plen = 0;
-    if (crypto_aead_xchacha20poly1305_ietf_decrypt(pt, &plen,
-            NULL, ct, ct_len, aad, aad_len, hdr->nonce, key) != 0) {
-        sodium_memzero(key, sizeof key);
-        return -1; // auth fail => no output
-    }
-
-    *pt_len = (size_t)plen;
+    int result = open_blob(key, ct, ct_len, aad, aad_len, hdr, pt, pt_len);
     sodium_memzero(key, sizeof key);
-    return 0;
+    return result;
 }
 
 // Encrypt a file
@@ -405,6 +424,488 @@ void paths_to_kdf_params(const char *paths, uint8_t *mem_log2, uint8_t *ops, uin
     *parallel = 1 + (hash[2] % 4);
 }
 
+// Batch mode
+// `batch [threads]` reads one request per line from stdin, tab-separated:
+//   encrypt      <key> <paths> <message>
+//   decrypt      <key> <paths> <hex_data>
+//   encrypt-file <key> <paths> <input_file> <output_file>
+//   decrypt-file <key> <paths> <input_file> <output_file>
+// <key> is pass:<password>, env:<variable> or file:<path> (its first line); an
+// empty <paths> means none. \t, \n, \r and \\ are unescaped in every field.
+// Every line gets one result line, in input order: "ok<TAB>result" (hex data,
+// message or output file, escaped the same way) or "error<TAB>message".
+// Each password is derived once per batch: what it encrypts shares one salt (every
+// item still gets a fresh nonce), and decryption reuses keys by salt and parameters.
+
+#define BATCH_LINES_PER_THREAD 64
+
+enum { BATCH_ENCRYPT, BATCH_DECRYPT, BATCH_ENCRYPT_FILE, BATCH_DECRYPT_FILE };
+
+// A derived key, shared by every item with the same password, salt and parameters
+typedef struct batch_key {
+    uint8_t password_id[32];      // Keyed hash of the password
+    uint8_t salt[16];
+    uint8_t mem_log2;
+    uint8_t ops;
+    uint8_t parallel;
+    int for_encryption;           // The salt this batch encrypts under for the password
+    int state;                    // 0 = deriving, 1 = ready, -1 = failed
+    uint8_t key[32];
+    struct batch_key *next;
+} batch_key_t;
+
+// A resolved key reference
+typedef struct batch_password {
+    char *ref;
+    char *password;
+    struct batch_password *next;
+} batch_password_t;
+
+typedef struct {
+    int op;
+    const char *password;
+    const char *paths;
+    const char *arg1;             // Message, hex data or input file
+    const char *arg2;             // Output file
+    char *line;                   // Owns the fields above
+    char *result;                 // Escaped, malloc'd
+    int ok;
+} batch_item_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t derived;
+    batch_key_t *keys;
+    uint8_t id_key[crypto_generichash_KEYBYTES];
+} batch_keys = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, {0} };
+
+// Find or derive the key for a header. Encryption takes the salt of the password's
+// encryption key (the header's own salt starts it); decryption matches the header.
+// Returns NULL if the derivation failed.
+static const batch_key_t *batch_key(const char *password, header_t *hdr, int for_encryption) {
+    uint8_t password_id[32];
+    crypto_generichash(password_id, sizeof(password_id), (const uint8_t*)password, strlen(password),
+                       batch_keys.id_key, sizeof(batch_keys.id_key));
+
+    pthread_mutex_lock(&batch_keys.lock);
+    batch_key_t *entry = batch_keys.keys;
+    for (; entry; entry = entry->next) {
+        if (sodium_memcmp(entry->password_id, password_id, sizeof(password_id)) != 0) continue;
+        if (for_encryption ? entry->for_encryption
+                           : memcmp(entry->salt, hdr->salt, sizeof(hdr->salt)) == 0 &&
+                             entry->mem_log2 == hdr->kdf_mem_log2 && entry->ops == hdr->kdf_ops &&
+                             entry->parallel == hdr->kdf_parallel) {
+            break;
+        }
+    }
+
+    if (!entry) {
+        // Derive outside the lock; items needing the same key wait for it
+        entry = (batch_key_t*)sodium_malloc(sizeof(batch_key_t));
+        if (!entry) {
+            pthread_mutex_unlock(&batch_keys.lock);
+            return NULL;
+        }
+        memcpy(entry->password_id, password_id, sizeof(password_id));
+        memcpy(entry->salt, hdr->salt, sizeof(entry->salt));
+        entry->mem_log2 = hdr->kdf_mem_log2;
+        entry->ops = hdr->kdf_ops;
+        entry->parallel = hdr->kdf_parallel;
+        entry->for_encryption = for_encryption;
+        entry->state = 0;
+        entry->next = batch_keys.keys;
+        batch_keys.keys = entry;
+        pthread_mutex_unlock(&batch_keys.lock);
+
+        int result = derive_key_argon2id(password, entry->salt, entry->mem_log2, entry->ops,
+                                         entry->parallel, entry->key);
+
+        pthread_mutex_lock(&batch_keys.lock);
+        entry->state = result == 0 ? 1 : -1;
+        pthread_cond_broadcast(&batch_keys.derived);
+    }
+    while (entry->state == 0) {
+        pthread_cond_wait(&batch_keys.derived, &batch_keys.lock);
+    }
+    pthread_mutex_unlock(&batch_keys.lock);
+
+    if (entry->state != 1) return NULL;
+    if (for_encryption) {
+        memcpy(hdr->salt, entry->salt, sizeof(hdr->salt));
+    }
+    return entry;
+}
+
+// Wipe and free every derived key
+static void batch_keys_clear(void) {
+    while (batch_keys.keys) {
+        batch_key_t *next = batch_keys.keys->next;
+        sodium_free(batch_keys.keys); // Zeroes the memory
+        batch_keys.keys = next;
+    }
+}
+
+// Decode \t, \n, \r and \\ in place
+static void batch_unescape(char *field) {
+    char *out = field;
+    for (char *in = field; *in; in++) {
+        if (*in == '\\' && in[1]) {
+            in++;
+            *out++ = *in == 't' ? '\t' : *in == 'n' ? '\n' : *in == 'r' ? '\r' : *in;
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+}
+
+// Build "ok\t<escaped data>"; NULL if out of memory
+static char *batch_ok(const uint8_t *data, size_t len) {
+    char *result = malloc(3 + 2 * len + 1);
+    if (!result) return NULL;
+
+    char *out = result + 3;
+    memcpy(result, "ok\t", 3);
+    for (size_t i = 0; i < len; i++) {
+        char c = (char)data[i];
+        if (c == '\t' || c == '\n' || c == '\r' || c == '\\') {
+            *out++ = '\\';
+            c = c == '\t' ? 't' : c == '\n' ? 'n' : c == '\r' ? 'r' : '\\';
+        }
+        *out++ = c;
+    }
+    *out = '\0';
+    return result;
+}
+
+// Read a whole file; NULL on failure
+static uint8_t *batch_read_file(const char *path, size_t *len) {
+    FILE *in = fopen(path, "rb");
+    if (!in) return NULL;
+
+    uint8_t *data = NULL;
+    long size = -1;
+    if (fseek(in, 0, SEEK_END) == 0) size = ftell(in);
+    if (size >= 0 && fseek(in, 0, SEEK_SET) == 0) {
+        data = malloc(size ? (size_t)size : 1);
+        if (data && fread(data, 1, (size_t)size, in) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(in);
+
+    *len = (size_t)size;
+    return data;
+}
+
+// Write a header and body to a file
+static int batch_write_file(const char *path, const void *head, size_t head_len, const uint8_t *body, size_t len) {
+    FILE *out = fopen(path, "wb");
+    if (!out) return -1;
+
+    int ok = (head_len == 0 || fwrite(head, 1, head_len, out) == head_len) &&
+             fwrite(body, 1, len, out) == len;
+    if (fclose(out) != 0 || !ok) {
+        remove(path);
+        return -1;
+    }
+    return 0;
+}
+
+// Run one item; returns an error message, or NULL with item->result set
+static const char *batch_run_item(batch_item_t *item) {
+    const uint8_t *aad = (const uint8_t*)item->paths;
+    size_t aad_len = item->paths ? strlen(item->paths) : 0;
+    header_t header;
+
+    if (item->op == BATCH_ENCRYPT || item->op == BATCH_ENCRYPT_FILE) {
+        size_t pt_len = strlen(item->arg1);
+        uint8_t *pt = (uint8_t*)item->arg1;
+        if (item->op == BATCH_ENCRYPT_FILE) {
+            pt = batch_read_file(item->arg1, &pt_len);
+            if (!pt) return "Cannot read input file";
+        }
+
+        // Header and ciphertext in one buffer
+        size_t blob_len = sizeof(header) + pt_len + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+        uint8_t *blob = malloc(blob_len);
+        const batch_key_t *key = NULL;
+        size_t ct_len = 0;
+        const char *error = NULL;
+        init_header(&header, aad, aad_len);
+        if (!blob) {
+            error = "Memory allocation failed";
+        } else if (!(key = batch_key(item->password, &header, 1))) {
+            error = "Key derivation failed";
+        } else if (seal_blob(key->key, pt, pt_len, aad, aad_len, &header, blob + sizeof(header), &ct_len) != 0) {
+            error = "Encryption failed";
+        }
+        if (pt != (uint8_t*)item->arg1) {
+            sodium_memzero(pt, pt_len);
+            free(pt);
+        }
+
+        if (!error) {
+            memcpy(blob, &header, sizeof(header));
+            if (item->op == BATCH_ENCRYPT) {
+                item->result = malloc(3 + 2 * blob_len + 1);
+                if (item->result) {
+                    memcpy(item->result, "ok\t", 3);
+                    sodium_bin2hex(item->result + 3, 2 * blob_len + 1, blob, blob_len);
+                    for (char *c = item->result + 3; *c; c++) {
+                        if (*c >= 'a') *c -= 'a' - 'A'; // Same case as encrypt_string
+                    }
+                }
+            } else if (batch_write_file(item->arg2, NULL, 0, blob, blob_len) != 0) {
+                error = "Cannot write output file";
+            } else {
+                item->result = batch_ok((const uint8_t*)item->arg2, strlen(item->arg2));
+            }
+        }
+        free(blob);
+        return error ? error : item->result ? NULL : "Memory allocation failed";
+    }
+
+    // Decryption: header and ciphertext from hex data or a file
+    size_t blob_len = 0;
+    uint8_t *blob = NULL;
+    if (item->op == BATCH_DECRYPT) {
+        size_t hex_len = strlen(item->arg1);
+        blob = malloc(hex_len / 2 + 1);
+        if (!blob || sodium_hex2bin(blob, hex_len / 2 + 1, item->arg1, hex_len, NULL, &blob_len, NULL) != 0 ||
+            blob_len * 2 != hex_len) {
+            free(blob);
+            return "Invalid hex data";
+        }
+    } else {
+        blob = batch_read_file(item->arg1, &blob_len);
+        if (!blob) return "Cannot read input file";
+    }
+
+    const char *error = NULL;
+    const batch_key_t *key = NULL;
+    uint8_t *pt = NULL;
+    size_t pt_len = 0;
+    if (blob_len < sizeof(header) + crypto_aead_xchacha20poly1305_ietf_ABYTES) {
+        error = "Invalid data";
+    } else {
+        memcpy(&header, blob, sizeof(header));
+        pt = malloc(blob_len - sizeof(header));
+        if (memcmp(header.magic, MAGIC, 4) != 0 || header.version != VERSION) {
+            error = "Invalid format or version";
+        } else if (!pt) {
+            error = "Memory allocation failed";
+        } else if (!(key = batch_key(item->password, &header, 0))) {
+            error = "Key derivation failed";
+        } else if (open_blob(key->key, blob + sizeof(header), blob_len - sizeof(header), aad, aad_len,
+                             &header, pt, &pt_len) != 0) {
+            error = "Decryption failed (wrong password or tampered data)";
+        }
+    }
+    free(blob);
+
+    if (!error) {
+        if (item->op == BATCH_DECRYPT) {
+            item->result = batch_ok(pt, pt_len);
+        } else if (batch_write_file(item->arg2, NULL, 0, pt, pt_len) != 0) {
+            error = "Cannot write output file";
+        } else {
+            item->result = batch_ok((const uint8_t*)item->arg2, strlen(item->arg2));
+        }
+        if (!error && !item->result) error = "Memory allocation failed";
+    }
+    if (pt) {
+        sodium_memzero(pt, blob_len - sizeof(header));
+        free(pt);
+    }
+    return error;
+}
+
+typedef struct {
+    batch_item_t *items;
+    size_t count;
+    size_t next;
+} batch_job_t;
+
+static void *batch_worker(void *arg) {
+    batch_job_t *job = (batch_job_t*)arg;
+
+    for (;;) {
+        size_t index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (index >= job->count) break;
+
+        batch_item_t *item = &job->items[index];
+        if (item->result) continue; // Rejected while parsing
+
+        const char *error = batch_run_item(item);
+        if (error) {
+            free(item->result);
+            item->result = malloc(strlen(error) + 7);
+            if (item->result) sprintf(item->result, "error\t%s", error);
+        } else {
+            item->ok = 1;
+        }
+    }
+    return NULL;
+}
+
+// Resolve a key reference, once per distinct reference; NULL if invalid
+static const char *batch_password(batch_password_t **passwords, const char *ref) {
+    for (batch_password_t *p = *passwords; p; p = p->next) {
+        if (strcmp(p->ref, ref) == 0) return p->password;
+    }
+
+    char *password = NULL;
+    if (strncmp(ref, "pass:", 5) == 0) {
+        password = strdup(ref + 5);
+    } else if (strncmp(ref, "env:", 4) == 0) {
+        const char *value = getenv(ref + 4);
+        password = value ? strdup(value) : NULL;
+    } else if (strncmp(ref, "file:", 5) == 0) {
+        FILE *f = fopen(ref + 5, "r");
+        char buffer[1024];
+        if (f && fgets(buffer, sizeof(buffer), f)) {
+            buffer[strcspn(buffer, "\r\n")] = '\0';
+            password = strdup(buffer);
+            sodium_memzero(buffer, sizeof(buffer));
+        }
+        if (f) fclose(f);
+    }
+    if (!password || !*password) {
+        free(password);
+        return NULL;
+    }
+
+    batch_password_t *entry = malloc(sizeof(batch_password_t));
+    char *ref_copy = strdup(ref);
+    if (!entry || !ref_copy) {
+        free(entry);
+        free(ref_copy);
+        sodium_memzero(password, strlen(password));
+        free(password);
+        return NULL;
+    }
+    entry->ref = ref_copy;
+    entry->password = password;
+    entry->next = *passwords;
+    *passwords = entry;
+    return password;
+}
+
+// Split a request line into its item; sets item->result on a malformed line
+static void batch_parse(batch_item_t *item, char *line, batch_password_t **passwords) {
+    static const char *const ops[] = { "encrypt", "decrypt", "encrypt-file", "decrypt-file" };
+    char *fields[5] = {0};
+    size_t count = 0;
+
+    memset(item, 0, sizeof(*item));
+    item->line = line;
+    line[strcspn(line, "\r\n")] = '\0';
+    for (char *field = line; field && count < 5; count++) {
+        fields[count] = field;
+        field = strchr(field, '\t');
+        if (field) *field++ = '\0';
+    }
+    for (size_t i = 0; i < count; i++) batch_unescape(fields[i]);
+
+    const char *error = NULL;
+    item->op = -1;
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(fields[0], ops[i]) == 0) item->op = i;
+    }
+    size_t wanted = item->op == BATCH_ENCRYPT_FILE || item->op == BATCH_DECRYPT_FILE ? 5 : 4;
+    if (item->op < 0) {
+        error = "error\tUnknown operation";
+    } else if (count != wanted) {
+        error = "error\tWrong number of fields";
+    } else if (!(item->password = batch_password(passwords, fields[1]))) {
+        error = "error\tInvalid key reference";
+    }
+    if (error) {
+        item->result = strdup(error);
+        return;
+    }
+
+    item->paths = fields[2][0] ? fields[2] : NULL;
+    item->arg1 = fields[3];
+    item->arg2 = fields[4];
+}
+
+// Process stdin a window at a time, printing results in input order
+// Returns 0 if every request succeeded
+static int run_batch(unsigned threads) {
+    size_t window = (size_t)threads * BATCH_LINES_PER_THREAD;
+    batch_item_t *items = calloc(window, sizeof(batch_item_t));
+    pthread_t *workers = calloc(threads, sizeof(pthread_t));
+    if (!items || !workers) {
+        free(items);
+        free(workers);
+        printf("Error: Memory allocation failed\n");
+        return 1;
+    }
+
+    randombytes_buf(batch_keys.id_key, sizeof(batch_keys.id_key));
+    batch_password_t *passwords = NULL;
+    int failed = 0;
+    int eof = 0;
+
+    while (!eof) {
+        // Read a window of requests
+        size_t count = 0;
+        while (count < window) {
+            char *line = NULL;
+            size_t capacity = 0;
+            if (getline(&line, &capacity, stdin) < 0) {
+                free(line);
+                eof = 1;
+                break;
+            }
+            if (line[0] == '\n' || line[0] == '\0') {
+                free(line); // Blank lines are skipped
+                continue;
+            }
+            batch_parse(&items[count++], line, &passwords);
+        }
+        if (count == 0) break;
+
+        // Run it on the pool
+        batch_job_t job = { items, count, 0 };
+        unsigned started = 0;
+        unsigned wanted = threads < count ? threads : (unsigned)count;
+        for (unsigned i = 1; i < wanted; i++) {
+            if (pthread_create(&workers[started], NULL, batch_worker, &job) == 0) started++;
+        }
+        batch_worker(&job);
+        for (unsigned i = 0; i < started; i++) {
+            pthread_join(workers[i], NULL);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            puts(items[i].result ? items[i].result : "error\tMemory allocation failed");
+            failed |= !items[i].ok;
+            if (items[i].result) sodium_memzero(items[i].result, strlen(items[i].result));
+            free(items[i].result);
+            sodium_memzero(items[i].line, strlen(items[i].line));
+            free(items[i].line);
+        }
+        fflush(stdout);
+    }
+
+    batch_keys_clear();
+    while (passwords) {
+        batch_password_t *next = passwords->next;
+        sodium_memzero(passwords->password, strlen(passwords->password));
+        free(passwords->password);
+        free(passwords->ref);
+        free(passwords);
+        passwords = next;
+    }
+    free(items);
+    free(workers);
+    return failed;
+}
+
 // Main function for testing
 int main(int argc, char *argv[]) {
     if (sodium_init() < 0) {
@@ -418,6 +919,7 @@ int main(int argc, char *argv[]) {
         printf("  %s decrypt <password> <hex_data> [paths]\n", argv[0]);
         printf("  %s encrypt-file <password> <input_file> <output_file> [paths]\n", argv[0]);
         printf("  %s decrypt-file <password> <input_file> <output_file> [paths]\n", argv[0]);
+        printf("  %s batch [threads] < requests\n", argv[0]);
         printf("  %s test\n", argv[0]);
         return 1;
     }
@@ -506,6 +1008,16 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    if (strcmp(argv[1], "batch") == 0) {
+        long threads = argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+        if (threads < 1 || threads > 256) {
+            printf("Error: Invalid thread count\n");
+            return 1;
+        }
+        
+        return run_batch((unsigned)threads);
+    }
+    
     if (strcmp(argv[1], "test") == 0) {
         printf("=== Running LRS Encryption Tests ===\n\n");
         
@@ -627,6 +1139,38 @@ int main(int argc, char *argv[]) {
             free(wrong_paths_decrypted);
         }
         
+        // Test batch mode: one derivation per password, results usable on their own
+        printf("Testing batch requests...\n");
+        randombytes_buf(batch_keys.id_key, sizeof(batch_keys.id_key));
+        batch_item_t batch[3] = {
+            { .op = BATCH_ENCRYPT, .password = password, .paths = paths, .arg1 = "first" },
+            { .op = BATCH_ENCRYPT, .password = password, .paths = paths, .arg1 = "second" },
+        };
+        batch_job_t job = { batch, 2, 0 };
+        batch_worker(&job);
+        
+        int shared_salt = batch[0].ok && batch[1].ok &&
+                          memcmp(batch[0].result + 3 + 22, batch[1].result + 3 + 22, 32) == 0;
+        char *batch_decrypted = batch[1].ok ? decrypt_string(batch[1].result + 3, password, paths) : NULL;
+        if (shared_salt && batch_decrypted && strcmp(batch_decrypted, "second") == 0) {
+            printf("✓ Batch encryption shares one key per password\n");
+        } else {
+            printf("✗ Batch encryption FAILED\n");
+        }
+        free(batch_decrypted);
+        
+        batch[2] = (batch_item_t){ .op = BATCH_DECRYPT, .password = "wrong_password", .paths = paths,
+                                   .arg1 = batch[0].ok ? batch[0].result + 3 : "" };
+        job = (batch_job_t){ batch + 2, 1, 0 };
+        batch_worker(&job);
+        if (!batch[2].ok && batch[2].result && strncmp(batch[2].result, "error\t", 6) == 0) {
+            printf("✓ Batch decryption with wrong password correctly failed\n");
+        } else {
+            printf("✗ Batch decryption with wrong password unexpectedly succeeded\n");
+        }
+        for (int i = 0; i < 3; i++) free(batch[i].result);
+        batch_keys_clear();
+        
         // Clean up test files
         remove("test_file.txt");
         remove("test_file.lrs");
@@ -2,52 +2,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <time.h>
+#include <endian.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <arpa/inet.h>
 #include <sodium.h>
-
-#define MAGIC "LRS"
-#define VERSION 2
-
-// Algorithm and KDF identifiers
-#define CIPHER_XCHACHA20POLY1305 1
-#define KDF_ARGON2ID 1
-#define HASH_BLAKE2B 1
-
-// TLV types
-#define TLV_KEY_MODE 1
-#define TLV_TIMESTAMP 2
-#define TLV_FILE_ID 3
-#define TLV_COMMENT 4
-
-// Key modes
-#define KEY_MODE_PASSWORD 0
-#define KEY_MODE_RAW_KEY 1
-
-// TLV structure for extensible header
-typedef struct {
-    uint8_t type;
-    uint8_t length;
-    uint8_t value[0]; // Flexible array member
-} __attribute__((packed)) tlv_t;
-
-// Header structure for encrypted data with self-describing fields
-typedef struct {
-    char magic[3];                // "LRS"
-    uint8_t version;              // 2
-    uint8_t cipher_suite_id;      // 1 = xchacha20poly1305
-    uint8_t kdf_id;               // 1 = argon2id
-    uint32_t kdf_ops;             // Time cost parameter (network byte order)
-    uint32_t kdf_mem_limit_kib;   // Memory cost in KiB (network byte order)
-    uint32_t kdf_parallelism;     // Parallelism parameter (network byte order)
-    uint8_t salt_len;             // Length of salt (typically 16)
-    uint8_t salt[16];             // Random salt for KDF
-    uint8_t nonce_len;            // Length of nonce (typically 24)
-    uint8_t nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES]; // 24 bytes
-    uint8_t aad_hash_id;          // 1 = blake2b-256, 0 = none
-    uint8_t aad_hash_len;         // Length of AAD hash (typically 32 or 0)
-    uint8_t aad_hash[32];         // Hash of AAD (paths/doubts)
-    uint16_t tlv_len;             // Length of TLV section (network byte order)
-    // TLV data would follow here in the actual encrypted data
-} header_t;
+#include "lrs_encryption_lib.h"
 
 // Add TLV data to a buffer
 size_t add_tlv(uint8_t *buffer, size_t max_size, uint8_t type, const uint8_t *value, uint8_t length) {
@@ -85,62 +51,503 @@ const uint8_t *find_tlv(const uint8_t *buffer, size_t size, uint8_t type, uint8_
     return NULL; // TLV not found
 }
 
+// Work to start once this thread's KDF holds its memory (the stream read-ahead):
+// anything reserved for it is reserved after the KDF's own reservation, which
+// may wait, so it is never held while that reservation waits
+static __thread void (*kdf_overlap_fn)(void *arg);
+static __thread void *kdf_overlap_arg;
+
+void lrs_kdf_memory_held(void) {
+    void (*fn)(void *arg) = kdf_overlap_fn;
+    
+    kdf_overlap_fn = NULL; // Once per derivation
+    if (fn) fn(kdf_overlap_arg);
+}
+
 // Derive key using Argon2id (password mode)
 int derive_key_argon2id(const char *pwd, const uint8_t salt[16],
                        uint32_t mem_limit_kib, uint32_t ops, uint32_t parallel,
                        uint8_t out_key[32]) {
+    // libsodium only implements one lane and allocates its own memory; more lanes
+    // run on lrs_argon2id's threads, which can also reuse a persistent arena
+    if (parallel > 1 || lrs_kdf_arena_enabled()) {
+        return lrs_argon2id(out_key, 32, (const uint8_t*)pwd, strlen(pwd), salt, 16,
+                            NULL, 0, NULL, 0, ops, mem_limit_kib, parallel);
+    }
+    
     // Convert memory limit from KiB to bytes
     unsigned long long mem = (unsigned long long)mem_limit_kib * 1024ULL;
     
-    return crypto_pwhash(out_key, 32, pwd, strlen(pwd), salt,
+    // Hold the memory governor reservation while libsodium's buffer exists
+    if (lrs_memory_reserve((size_t)mem) != 0) {
+        return -11; // Memory budget exhausted
+    }
+    lrs_kdf_memory_held();
+    
+    int kdf_result = crypto_pwhash(out_key, 32, pwd, strlen(pwd), salt,
         ops,
         mem,
         crypto_pwhash_ALG_ARGON2ID13);
+    
+    lrs_memory_release((size_t)mem);
+    return kdf_result;
 }
 
 // Derive key from raw key material (raw key mode)
 int derive_key_from_raw(const uint32_t *raw_key, size_t raw_key_len, uint8_t out_key[32]) {
-    // Convert uint32_t array to bytes in big-endian format
-    size_t bytes_len = raw_key_len * sizeof(uint32_t);
-    uint8_t *bytes = (uint8_t*)malloc(bytes_len);
-    if (!bytes) return -1;
-    
-    for (size_t i = 0; i < raw_key_len; i++) {
-        uint32_t value = htonl(raw_key[i]); // Convert to big-endian
-        memcpy(bytes + (i * sizeof(uint32_t)), &value, sizeof(uint32_t));
-    }
-    
     // Use BLAKE2b with a domain separation constant
     const char *domain = "LRS-AEAD-KEY";
     crypto_generichash_state state;
     crypto_generichash_init(&state, (const uint8_t*)domain, strlen(domain), 32);
-    crypto_generichash_update(&state, bytes, bytes_len);
+    
+    // Hash the uint32_t array as bytes in big-endian format
+    for (size_t i = 0; i < raw_key_len; i++) {
+        uint32_t value = htonl(raw_key[i]); // Convert to big-endian
+        crypto_generichash_update(&state, (const uint8_t*)&value, sizeof(uint32_t));
+        sodium_memzero(&value, sizeof value);
+    }
     crypto_generichash_final(&state, out_key, 32);
     
     // Clean up
-    sodium_memzero(bytes, bytes_len);
-    free(bytes);
+    sodium_memzero(&state, sizeof state);
     
     return 0;
 }
 
-// Encrypt data using XChaCha20-Poly1305 with support for password or raw key modes
-int encrypt_blob_ex(const uint8_t *pt, size_t pt_len,
-                  const void *key_material, int key_mode, const uint8_t *aad, size_t aad_len,
-                  header_t *hdr, uint8_t *tlv_buffer, size_t tlv_buffer_size, uint8_t *ct, size_t *ct_len) {
+// KDF parameters
+// New objects and sessions use the process-wide parameters; decryption always
+// follows the header
+static pthread_mutex_t kdf_params_lock = PTHREAD_MUTEX_INITIALIZER;
+static lrs_kdf_params_t kdf_params = {
+    LRS_KDF_OPS_DEFAULT, LRS_KDF_MEM_LIMIT_KIB_DEFAULT, LRS_KDF_PARALLELISM_DEFAULT
+};
+
+void lrs_kdf_params_default(lrs_kdf_params_t *params) {
+    params->ops = LRS_KDF_OPS_DEFAULT;
+    params->mem_limit_kib = LRS_KDF_MEM_LIMIT_KIB_DEFAULT;
+    params->parallelism = LRS_KDF_PARALLELISM_DEFAULT;
+}
+
+static int kdf_params_valid(const lrs_kdf_params_t *params) {
+    return params->ops >= crypto_pwhash_OPSLIMIT_MIN &&
+           (size_t)params->mem_limit_kib * 1024 >= crypto_pwhash_MEMLIMIT_MIN &&
+           params->parallelism >= 1 && params->parallelism <= LRS_KDF_PARALLELISM_MAX &&
+           params->mem_limit_kib >= 8 * params->parallelism; // Argon2 needs 8 blocks per lane
+}
+
+// Set the parameters for new objects; NULL restores the defaults
+int lrs_set_kdf_params(const lrs_kdf_params_t *params) {
+    lrs_kdf_params_t value;
+    if (params) {
+        if (!kdf_params_valid(params)) return -1;
+        value = *params;
+    } else {
+        lrs_kdf_params_default(&value);
+    }
+    
+    pthread_mutex_lock(&kdf_params_lock);
+    kdf_params = value;
+    pthread_mutex_unlock(&kdf_params_lock);
+    
+    return 0;
+}
+
+void lrs_get_kdf_params(lrs_kdf_params_t *params) {
+    pthread_mutex_lock(&kdf_params_lock);
+    *params = kdf_params;
+    pthread_mutex_unlock(&kdf_params_lock);
+}
+
+// Wall-clock milliseconds for one derivation, or -1 if it failed (e.g. out of memory)
+static double time_kdf(uint32_t ops, uint32_t mem_limit_kib, uint32_t lanes) {
+    uint8_t salt[16], key[32];
+    randombytes_buf(salt, sizeof salt);
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int kdf_result = derive_key_argon2id("lrs calibration", salt, mem_limit_kib, ops, lanes, key);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    sodium_memzero(key, sizeof key);
+    
+    if (kdf_result != 0) return -1;
+    return (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+// Find the strongest parameters that fit a latency target and memory ceiling
+// Memory hardness comes first: take the most memory for which a single pass
+// fits, then spend what is left of the budget on extra passes. Lanes follow the
+// CPU count (up to 8; past that memory bandwidth rather than cores is the limit)
+int lrs_kdf_calibrate(uint32_t target_ms, uint32_t max_mem_kib, lrs_kdf_params_t *params,
+                      uint32_t *measured_ms) {
+    if (!params || target_ms == 0) return -1;
+    if (max_mem_kib == 0) max_mem_kib = LRS_KDF_MEM_LIMIT_KIB_DEFAULT;
+    if (max_mem_kib < LRS_KDF_MEM_LIMIT_KIB_MIN) return -1;
+    
+    uint32_t lanes = lrs_cpu_count();
+    if (lanes > 8) lanes = 8;
+    
+    // Shrink memory (in whole MiB) until one pass fits the target
+    uint32_t mem_limit_kib = max_mem_kib;
+    double ms = time_kdf(1, mem_limit_kib, lanes);
+    while ((ms < 0 || ms > target_ms) && mem_limit_kib > LRS_KDF_MEM_LIMIT_KIB_MIN) {
+        double scale = ms < 0 ? 0.5 : 0.9 * target_ms / ms;
+        uint32_t next = (uint32_t)(mem_limit_kib * scale) / 1024 * 1024;
+        if (next >= mem_limit_kib) next = mem_limit_kib / 2 / 1024 * 1024;
+        mem_limit_kib = next > LRS_KDF_MEM_LIMIT_KIB_MIN ? next : LRS_KDF_MEM_LIMIT_KIB_MIN;
+        ms = time_kdf(1, mem_limit_kib, lanes);
+    }
+    if (ms < 0) return -1;
+    
+    params->ops = 1;
+    params->mem_limit_kib = mem_limit_kib;
+    params->parallelism = lanes;
+    
+    if (ms > target_ms) {
+        if (measured_ms) *measured_ms = (uint32_t)ms;
+        return -2; // Target unreachable on this host
+    }
+    
+    // Passes cost about the same each; back off if the estimate overshoots
+    uint32_t ops = (uint32_t)(target_ms / ms);
+    while (ops > 1) {
+        double ops_ms = time_kdf(ops, mem_limit_kib, lanes);
+        if (ops_ms >= 0 && ops_ms <= target_ms) {
+            ms = ops_ms;
+            break;
+        }
+        ops--;
+    }
+    
+    params->ops = ops > 1 ? ops : 1;
+    if (measured_ms) *measured_ms = (uint32_t)ms;
+    
+    return 0;
+}
+
+// Derived-key cache
+// Opt-in, bounded LRU of Argon2id outputs so repeated decrypts under the same
+// salt and parameters skip the KDF. Entries live in sodium_malloc'd (guarded,
+// mlocked) memory and are looked up by a keyed BLAKE2b hash of the inputs, so
+// the cache never holds the passwords themselves.
+typedef struct {
+    uint8_t id[32];               // Keyed hash of password, salt, KDF params, key mode
+    uint8_t key[32];
+    uint64_t last_used;           // LRU tick
+    uint64_t expires_ns;          // Monotonic deadline, 0 = never
+    int in_use;
+} key_cache_entry_t;
+
+static struct {
+    pthread_mutex_t lock;
+    key_cache_entry_t *entries;
+    size_t capacity;
+    uint64_t ttl_ns;
+    uint64_t tick;
+    uint8_t hash_key[32];
+    lrs_key_cache_stats_t stats;
+} key_cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Enable the cache with room for `capacity` keys, each kept for at most
+// `ttl_seconds` (0 = until purged or evicted). Re-enabling purges it.
+int lrs_key_cache_enable(size_t capacity, unsigned ttl_seconds) {
+    if (capacity == 0) return -1;
+    
+    // Process-wide and long-lived, so not taken from the (possibly request-scoped) allocator
+    key_cache_entry_t *entries = (key_cache_entry_t*)sodium_allocarray(capacity, sizeof(key_cache_entry_t));
+    if (!entries) return -1;
+    memset(entries, 0, capacity * sizeof(key_cache_entry_t));
+    
+    pthread_mutex_lock(&key_cache.lock);
+    if (key_cache.entries) {
+        sodium_free(key_cache.entries); // Zeroes before freeing
+    }
+    key_cache.entries = entries;
+    key_cache.capacity = capacity;
+    key_cache.ttl_ns = (uint64_t)ttl_seconds * 1000000000ULL;
+    key_cache.tick = 0;
+    randombytes_buf(key_cache.hash_key, sizeof(key_cache.hash_key));
+    memset(&key_cache.stats, 0, sizeof(key_cache.stats));
+    pthread_mutex_unlock(&key_cache.lock);
+    
+    return 0;
+}
+
+// Wipe every cached key but keep the cache enabled
+void lrs_key_cache_purge(void) {
+    pthread_mutex_lock(&key_cache.lock);
+    if (key_cache.entries) {
+        sodium_memzero(key_cache.entries, key_cache.capacity * sizeof(key_cache_entry_t));
+    }
+    key_cache.stats.entries = 0;
+    pthread_mutex_unlock(&key_cache.lock);
+}
+
+// Wipe and release the cache
+void lrs_key_cache_disable(void) {
+    pthread_mutex_lock(&key_cache.lock);
+    if (key_cache.entries) {
+        sodium_free(key_cache.entries);
+    }
+    key_cache.entries = NULL;
+    key_cache.capacity = 0;
+    sodium_memzero(key_cache.hash_key, sizeof(key_cache.hash_key));
+    key_cache.stats.entries = 0;
+    pthread_mutex_unlock(&key_cache.lock);
+}
+
+void lrs_key_cache_get_stats(lrs_key_cache_stats_t *stats) {
+    pthread_mutex_lock(&key_cache.lock);
+    *stats = key_cache.stats;
+    pthread_mutex_unlock(&key_cache.lock);
+}
+
+// Cache id for one set of KDF inputs (caller holds the lock)
+static void key_cache_id(const char *pwd, const uint8_t salt[16], uint32_t mem_limit_kib,
+                         uint32_t ops, uint32_t parallel, int key_mode, uint8_t id[32]) {
+    uint64_t pwd_len_be = htobe64((uint64_t)strlen(pwd));
+    uint32_t params_be[3] = { htonl(ops), htonl(mem_limit_kib), htonl(parallel) };
+    uint8_t key_mode_value = (uint8_t)key_mode;
+    
+    crypto_generichash_state state;
+    crypto_generichash_init(&state, key_cache.hash_key, sizeof(key_cache.hash_key), 32);
+    crypto_generichash_update(&state, &key_mode_value, 1);
+    crypto_generichash_update(&state, (const uint8_t*)&pwd_len_be, sizeof(pwd_len_be));
+    crypto_generichash_update(&state, (const uint8_t*)pwd, strlen(pwd));
+    crypto_generichash_update(&state, salt, 16);
+    crypto_generichash_update(&state, (const uint8_t*)params_be, sizeof(params_be));
+    crypto_generichash_final(&state, id, 32);
+}
+
+// Look up a cached key; returns 1 on a hit
+static int key_cache_lookup(const uint8_t id[32], uint8_t out_key[32]) {
+    int hit = 0;
+    uint64_t now = monotonic_ns();
+    
+    for (size_t i = 0; i < key_cache.capacity; i++) {
+        key_cache_entry_t *entry = &key_cache.entries[i];
+        if (!entry->in_use) continue;
+        
+        // Drop expired keys as they are encountered
+        if (entry->expires_ns && entry->expires_ns <= now) {
+            sodium_memzero(entry, sizeof(*entry));
+            key_cache.stats.entries--;
+            key_cache.stats.expirations++;
+            continue;
+        }
+        
+        if (!hit && sodium_memcmp(entry->id, id, 32) == 0) {
+            memcpy(out_key, entry->key, 32);
+            entry->last_used = ++key_cache.tick;
+            hit = 1;
+        }
+    }
+    
+    return hit;
+}
+
+// Insert a key, evicting the least recently used entry when full
+static void key_cache_insert(const uint8_t id[32], const uint8_t key[32]) {
+    key_cache_entry_t *slot = NULL;
+    
+    for (size_t i = 0; i < key_cache.capacity; i++) {
+        key_cache_entry_t *entry = &key_cache.entries[i];
+        if (entry->in_use && sodium_memcmp(entry->id, id, 32) == 0) {
+            slot = entry; // Another thread already inserted it
+            break;
+        }
+        if (!entry->in_use) {
+            if (!slot || slot->in_use) slot = entry;
+        } else if (!slot || (slot->in_use && entry->last_used < slot->last_used)) {
+            slot = entry;
+        }
+    }
+    
+    if (!slot->in_use) {
+        key_cache.stats.entries++;
+    } else if (sodium_memcmp(slot->id, id, 32) != 0) {
+        key_cache.stats.evictions++;
+    }
+    
+    memcpy(slot->id, id, 32);
+    memcpy(slot->key, key, 32);
+    slot->last_used = ++key_cache.tick;
+    slot->expires_ns = key_cache.ttl_ns ? monotonic_ns() + key_cache.ttl_ns : 0;
+    slot->in_use = 1;
+}
+
+// Argon2id through the derived-key cache (a plain KDF run when the cache is off)
+// Only keys that will be looked up again go through it (use_cache): decryption
+// and session opens. Encryption stretches under a fresh random salt, so caching
+// its key would only keep another copy of it in memory.
+static int derive_password_key(const char *pwd, const uint8_t salt[16],
+                               uint32_t mem_limit_kib, uint32_t ops, uint32_t parallel,
+                               int use_cache, uint8_t out_key[32]) {
+    uint8_t id[32];
+    int cached = 0;
+    
+    pthread_mutex_lock(&key_cache.lock);
+    if (use_cache && key_cache.capacity > 0) {
+        cached = 1;
+        key_cache_id(pwd, salt, mem_limit_kib, ops, parallel, KEY_MODE_PASSWORD, id);
+        if (key_cache_lookup(id, out_key)) {
+            key_cache.stats.hits++;
+            pthread_mutex_unlock(&key_cache.lock);
+            sodium_memzero(id, sizeof id);
+            return 0;
+        }
+        key_cache.stats.misses++;
+    }
+    pthread_mutex_unlock(&key_cache.lock);
+    
+    // Run the KDF without holding the lock
+    int kdf_result = derive_key_argon2id(pwd, salt, mem_limit_kib, ops, parallel, out_key);
+    
+    if (kdf_result == 0 && cached) {
+        pthread_mutex_lock(&key_cache.lock);
+        if (key_cache.capacity > 0) { // Might have been disabled meanwhile
+            key_cache_insert(id, out_key);
+        }
+        pthread_mutex_unlock(&key_cache.lock);
+    }
+    
+    sodium_memzero(id, sizeof id);
+    return kdf_result;
+}
+
+// Derive a session master key with the given salt and KDF parameters
+static int session_init(lrs_session_t *session, const void *key_material, int key_mode,
+                        const uint8_t salt[16], uint32_t ops, uint32_t mem_limit_kib,
+                        uint32_t parallelism) {
+    if (!session || !key_material) return -1;
+    if (key_mode != KEY_MODE_PASSWORD && key_mode != KEY_MODE_RAW_KEY) return -1;
+    
+    memset(session, 0, sizeof(*session));
+    
+    // Keep the master key in guarded, locked memory for the life of the session
+    session->allocator = lrs_current_allocator();
+    session->master_key = (uint8_t*)session->allocator->secure_alloc(session->allocator->ctx, 32);
+    if (!session->master_key) return -1;
+    
+    session->key_mode = key_mode;
+    memcpy(session->salt, salt, sizeof(session->salt));
+    session->kdf_ops = ops;
+    session->kdf_mem_limit_kib = mem_limit_kib;
+    session->kdf_parallelism = parallelism;
+    
+    int kdf_result;
+    if (key_mode == KEY_MODE_PASSWORD) {
+        kdf_result = derive_password_key((const char*)key_material, session->salt,
+                                        mem_limit_kib, ops, parallelism, 1, session->master_key);
+    } else {
+        kdf_result = derive_key_from_raw((const uint32_t*)key_material, 8, session->master_key);
+    }
+    
+    if (kdf_result != 0) {
+        lrs_session_close(session);
+        return kdf_result == -11 ? -11 : -2; // Memory budget exhausted / key derivation failed
+    }
+    
+    // Start subkey ids at a random point so sessions reopened on the same salt
+    // are unlikely to reuse ids
+    randombytes_buf(&session->next_subkey_id, sizeof(session->next_subkey_id));
+    
+    return 0;
+}
+
+// Open a session for encryption: one KDF run with a fresh salt and the given parameters
+int lrs_session_open_params(lrs_session_t *session, const void *key_material, int key_mode,
+                            const lrs_kdf_params_t *params) {
+    if (!params || !kdf_params_valid(params)) return -1;
+    
+    uint8_t salt[16];
+    randombytes_buf(salt, sizeof salt);
+    
+    return session_init(session, key_material, key_mode, salt,
+                        params->ops, params->mem_limit_kib, params->parallelism);
+}
+
+// Open a session for encryption with the current KDF parameters
+int lrs_session_open(lrs_session_t *session, const void *key_material, int key_mode) {
+    lrs_kdf_params_t params;
+    lrs_get_kdf_params(&params);
+    
+    return lrs_session_open_params(session, key_material, key_mode, &params);
+}
+
+// Open a session matching an existing header, e.g. to decrypt the objects of another session
+int lrs_session_open_header(lrs_session_t *session, const void *key_material, int key_mode,
+                            const header_t *hdr) {
+    if (!hdr || hdr->salt_len != 16) return -1;
+    
+    return session_init(session, key_material, key_mode, hdr->salt,
+                        ntohl(hdr->kdf_ops), ntohl(hdr->kdf_mem_limit_kib),
+                        ntohl(hdr->kdf_parallelism));
+}
+
+// Hand out the next subkey id; safe to call from several threads
+uint64_t lrs_session_next_subkey_id(lrs_session_t *session) {
+    return __atomic_fetch_add(&session->next_subkey_id, 1, __ATOMIC_RELAXED);
+}
+
+// Wipe and release the master key
+void lrs_session_close(lrs_session_t *session) {
+    if (!session) return;
+    
+    if (session->master_key) {
+        session->allocator->secure_free(session->allocator->ctx, session->master_key);
+    }
+    sodium_memzero(session, sizeof(*session));
+}
+
+// Record the AAD hash in a header
+// Always hash the AAD to prevent length-based leaks
+static void set_aad_hash(header_t *hdr, const uint8_t *aad, size_t aad_len) {
+    if (aad != NULL && aad_len > 0) {
+        // Hash the AAD using BLAKE2b
+        hdr->aad_hash_id = HASH_BLAKE2B;
+        hdr->aad_hash_len = 32; // BLAKE2b-256 output size
+        crypto_generichash(hdr->aad_hash, hdr->aad_hash_len,
+                          aad, aad_len, NULL, 0);
+    } else {
+        // No AAD provided
+        hdr->aad_hash_id = 0;
+        hdr->aad_hash_len = 0;
+        sodium_memzero(hdr->aad_hash, sizeof(hdr->aad_hash));
+    }
+}
+
+// Fill in the self-describing header fields and the common TLV entries
+// Returns the number of TLV bytes written; hdr->tlv_len is set accordingly
+static size_t init_header(header_t *hdr, uint8_t version,
+                          const void *key_material, int key_mode,
+                          const uint8_t *aad, size_t aad_len,
+                          uint8_t *tlv_buffer, size_t tlv_buffer_size) {
+    const lrs_session_t *session = key_mode == KEY_MODE_SESSION ? (const lrs_session_t*)key_material : NULL;
+    lrs_kdf_params_t params;
+    lrs_get_kdf_params(&params);
+
+    // Start from a zeroed header so struct padding never leaks stack contents
+    memset(hdr, 0, sizeof(*hdr));
+
     // Set up header with self-describing fields
     memcpy(hdr->magic, MAGIC, 3);
-    hdr->version = VERSION;
+    hdr->version = version;
     hdr->cipher_suite_id = CIPHER_XCHACHA20POLY1305;
     hdr->kdf_id = KDF_ARGON2ID;
     
     // Use configurable KDF parameters - stored in header for future compatibility
-    // These can be adjusted based on the target system's capabilities
+    // These can be adjusted based on the target system's capabilities (lrs_set_kdf_params)
     // Convert to network byte order for cross-platform compatibility
-    uint32_t mem_limit_kib = 512 * 1024; // 512MB in KiB
-    hdr->kdf_ops = htonl(3);
-    hdr->kdf_mem_limit_kib = htonl(mem_limit_kib);
-    hdr->kdf_parallelism = htonl(1);
+    // Session objects record the parameters the session master key was derived with
+    hdr->kdf_ops = htonl(session ? session->kdf_ops : params.ops);
+    hdr->kdf_mem_limit_kib = htonl(session ? session->kdf_mem_limit_kib : params.mem_limit_kib);
+    hdr->kdf_parallelism = htonl(session ? session->kdf_parallelism : params.parallelism);
 
     // Set explicit lengths for salt and nonce
     hdr->salt_len = 16;
@@ -149,29 +556,21 @@ int encrypt_blob_ex(const uint8_t *pt, size_t pt_len,
     // Generate cryptographically secure random salt and nonce
     // XChaCha20 uses a 24-byte nonce which is large enough that random generation
     // is safe from collision even with the same key
-    randombytes_buf(hdr->salt, hdr->salt_len);
+    if (session) {
+        memcpy(hdr->salt, session->salt, hdr->salt_len);
+    } else {
+        randombytes_buf(hdr->salt, hdr->salt_len);
+    }
     randombytes_buf(hdr->nonce, hdr->nonce_len); // Ensures unique nonce per encryption
 
     // Handle AAD (paths/doubts) consistently
-    // Always hash the AAD to prevent length-based leaks
-    if (aad != NULL && aad_len > 0) {
-        // Hash the AAD using BLAKE2b
-        hdr->aad_hash_id = HASH_BLAKE2B;
-        hdr->aad_hash_len = 32; // BLAKE2b-256 output size
-        crypto_generichash(hdr->aad_hash, hdr->aad_hash_len,
-                          aad, aad_len, NULL, 0);
-    } else {
-        // No AAD provided
-        hdr->aad_hash_id = 0;
-        hdr->aad_hash_len = 0;
-        sodium_memzero(hdr->aad_hash, sizeof(hdr->aad_hash));
-    }
+    set_aad_hash(hdr, aad, aad_len);
 
     // Add TLV data
     size_t tlv_pos = 0;
     
-    // Add key mode TLV
-    uint8_t key_mode_value = (uint8_t)key_mode;
+    // Add key mode TLV (for session objects, the mode the master key came from)
+    uint8_t key_mode_value = (uint8_t)(session ? session->key_mode : key_mode);
     tlv_pos += add_tlv(tlv_buffer + tlv_pos, tlv_buffer_size - tlv_pos, 
                       TLV_KEY_MODE, &key_mode_value, 1);
     
@@ -183,75 +582,34 @@ int encrypt_blob_ex(const uint8_t *pt, size_t pt_len,
                           TLV_TIMESTAMP, (uint8_t*)&timestamp_be, 8);
     }
     
-    // Set TLV length in header
-    hdr->tlv_len = htons((uint16_t)tlv_pos);
-
-    // Derive key based on mode
-    uint8_t key[32];
-    int kdf_result;
-    
-    if (key_mode == KEY_MODE_PASSWORD) {
-        // Password mode - use Argon2id
-        kdf_result = derive_key_argon2id((const char*)key_material, hdr->salt, 
-                                        ntohl(hdr->kdf_mem_limit_kib), 
-                                        ntohl(hdr->kdf_ops), 
-                                        ntohl(hdr->kdf_parallelism), 
-                                        key);
-    } else if (key_mode == KEY_MODE_RAW_KEY) {
-        // Raw key mode - use direct key derivation
-        const uint32_t *raw_key = (const uint32_t*)key_material;
-        size_t raw_key_len = 8; // Assuming 8 uint32_t values (32 bytes)
-        kdf_result = derive_key_from_raw(raw_key, raw_key_len, key);
-    } else {
-        return -1; // Invalid key mode
-    }
-    
-    if (kdf_result != 0) {
-        // Key derivation failed
-        return -1;
+    // Add the subkey id for session objects; each object gets its own subkey
+    if (session) {
+        uint64_t subkey_id = lrs_session_next_subkey_id((lrs_session_t*)session);
+        uint64_t subkey_id_be = htobe64(subkey_id);
+        tlv_pos += add_tlv(tlv_buffer + tlv_pos, tlv_buffer_size - tlv_pos,
+                          TLV_SUBKEY_ID, (uint8_t*)&subkey_id_be, 8);
     }
-
-    // Encrypt using XChaCha20-Poly1305
-    unsigned long long clen = 0;
-    int encrypt_result = crypto_aead_xchacha20poly1305_ietf_encrypt(
-        ct, &clen, pt, pt_len, aad, aad_len, NULL, hdr->nonce, key);
     
-    // Always zero out the key immediately after use
-    sodium_memzero(key, sizeof key);
-    
-    // Check encryption result
-    if (encrypt_result != 0) {
-        return -2; // Encryption failed
-    }
+    // Set TLV length in header
+    hdr->tlv_len = htons((uint16_t)tlv_pos);
 
-    *ct_len = (size_t)clen;
-    return 0;
+    return tlv_pos;
 }
 
-// Backward compatibility wrapper for encrypt_blob
-int encrypt_blob(const uint8_t *pt, size_t pt_len,
-                const char *pwd, const uint8_t *aad, size_t aad_len,
-                header_t *hdr, uint8_t *ct, size_t *ct_len) {
-    // Allocate a small buffer for TLV data
-    uint8_t tlv_buffer[64] = {0};
-    
-    return encrypt_blob_ex(pt, pt_len, pwd, KEY_MODE_PASSWORD, aad, aad_len,
-                         hdr, tlv_buffer, sizeof(tlv_buffer), ct, ct_len);
+// Container layout (1, VERSION or VERSION_STREAM), without feature flags
+uint8_t header_layout(const header_t *hdr) {
+    return hdr->version & (uint8_t)~VERSION_KEY_SLOT;
 }
 
-// Decrypt data using XChaCha20-Poly1305 with support for password or raw key modes
-int decrypt_blob_ex(const uint8_t *ct, size_t ct_len,
-                  const void *key_material, int key_mode, const uint8_t *aad, size_t aad_len,
-                  const header_t *hdr, const uint8_t *tlv_data, size_t tlv_len,
-                  uint8_t *pt, size_t *pt_len) {
+// Validate the fixed header fields shared by every container version
+// Refuse to process unknown versions for forward compatibility
+static int check_header(const header_t *hdr) {
     // Verify header magic and version
-    // Refuse to process unknown versions for forward compatibility
     if (memcmp(hdr->magic, MAGIC, 3) != 0) {
         return -1; // Invalid magic bytes
     }
     
-    // Version 2 is our target, but we can also handle version 1 for backward compatibility
-    if (hdr->version != VERSION && hdr->version != 1) {
+    if (hdr->version != 1 && header_layout(hdr) != VERSION && header_layout(hdr) != VERSION_STREAM) {
         return -2; // Unsupported version
     }
 
@@ -269,67 +627,407 @@ int decrypt_blob_ex(const uint8_t *ct, size_t ct_len,
         return -5; // Invalid salt or nonce length
     }
 
-    // Check for key mode in TLV data if available
-    int detected_key_mode = key_mode; // Default to provided mode
-    
+    return 0;
+}
+
+// Use the key mode recorded in the TLV data when present, otherwise the caller's
+// This allows for automatic detection of the correct mode
+static int detect_key_mode(const uint8_t *tlv_data, size_t tlv_len, int key_mode) {
     if (tlv_data && tlv_len > 0) {
         uint8_t tlv_key_mode_len = 0;
         const uint8_t *tlv_key_mode = find_tlv(tlv_data, tlv_len, TLV_KEY_MODE, &tlv_key_mode_len);
         
         if (tlv_key_mode && tlv_key_mode_len == 1) {
-            detected_key_mode = *tlv_key_mode;
-            
-            // If key modes don't match, use the one from the TLV
-            if (detected_key_mode != key_mode) {
-                // We'll use the detected key mode instead of the provided one
-                // This allows for automatic detection of the correct mode
-            }
+            return *tlv_key_mode;
         }
     }
 
-    // Derive key based on detected mode
-    uint8_t key[32];
+    return key_mode;
+}
+
+// Derive the AEAD key for a header according to the key mode
+// use_cache: passwords go through the derived-key cache (decryption only)
+// Returns -1 for an invalid key mode, -2 if key derivation failed and -11 if the
+// memory budget was exhausted
+static int derive_key_for_header(const void *key_material, int key_mode,
+                                 const header_t *hdr, int use_cache, uint8_t key[32]) {
     int kdf_result;
     
-    if (detected_key_mode == KEY_MODE_PASSWORD) {
-        // Password mode - use Argon2id
-        kdf_result = derive_key_argon2id((const char*)key_material, hdr->salt, 
+    if (key_mode == KEY_MODE_PASSWORD) {
+        // Password mode - use Argon2id (through the derived-key cache if enabled)
+        kdf_result = derive_password_key((const char*)key_material, hdr->salt, 
                                         ntohl(hdr->kdf_mem_limit_kib), 
                                         ntohl(hdr->kdf_ops), 
                                         ntohl(hdr->kdf_parallelism), 
-                                        key);
-    } else if (detected_key_mode == KEY_MODE_RAW_KEY) {
+                                        use_cache, key);
+    } else if (key_mode == KEY_MODE_RAW_KEY) {
         // Raw key mode - use direct key derivation
         const uint32_t *raw_key = (const uint32_t*)key_material;
         size_t raw_key_len = 8; // Assuming 8 uint32_t values (32 bytes)
         kdf_result = derive_key_from_raw(raw_key, raw_key_len, key);
     } else {
-        return -6; // Invalid key mode
+        return -1; // Invalid key mode
     }
     
     if (kdf_result != 0) {
-        return -7; // Key derivation failed
+        sodium_memzero(key, 32);
+        return kdf_result == -11 ? -11 : -2; // Memory budget exhausted / key derivation failed
     }
 
-    // Decrypt using XChaCha20-Poly1305
-    unsigned long long plen = 0;
-    int decrypt_result = crypto_aead_xchacha20poly1305_ietf_decrypt(
-        pt, &plen, NULL, ct, ct_len, aad, aad_len, hdr->nonce, key);
+    return 0;
+}
+
+// Read the session subkey id recorded in the TLV data; returns 1 if present
+static int tlv_subkey_id(const uint8_t *tlv_data, size_t tlv_len, uint64_t *subkey_id) {
+    uint8_t length = 0;
+    const uint8_t *value = tlv_data ? find_tlv(tlv_data, tlv_len, TLV_SUBKEY_ID, &length) : NULL;
+    if (!value || length != 8) return 0;
     
-    // Always zero out the key immediately after use
-    sodium_memzero(key, sizeof key);
+    uint64_t subkey_id_be;
+    memcpy(&subkey_id_be, value, 8);
+    *subkey_id = be64toh(subkey_id_be);
     
-    // Check decryption result - return nothing on failure
-    if (decrypt_result != 0) {
-        // Authentication or decryption failed - no partial output
-        return -8; // auth fail => no output
-    }
+    return 1;
+}
 
-    *pt_len = (size_t)plen;
+// Check that a header was written under this session's salt and KDF parameters
+static int session_matches_header(const lrs_session_t *session, const header_t *hdr) {
+    return sodium_memcmp(session->salt, hdr->salt, sizeof(session->salt)) == 0 &&
+           ntohl(hdr->kdf_ops) == session->kdf_ops &&
+           ntohl(hdr->kdf_mem_limit_kib) == session->kdf_mem_limit_kib &&
+           ntohl(hdr->kdf_parallelism) == session->kdf_parallelism;
+}
+
+// Find the subkey id of a session object; returns -3 unless the object was
+// encrypted under this session
+static int session_object_subkey_id(const lrs_session_t *session, const header_t *hdr,
+                                    const uint8_t *tlv_data, size_t tlv_len, uint64_t *subkey_id) {
+    if (!tlv_subkey_id(tlv_data, tlv_len, subkey_id) ||
+        detect_key_mode(tlv_data, tlv_len, session->key_mode) != session->key_mode ||
+        !session_matches_header(session, hdr)) {
+        return -3;
+    }
+    
     return 0;
 }
 
-// Backward compatibility wrapper for decrypt_blob
+// Derive the AEAD key for a container from its header and TLV data
+// Password/raw key material is stretched per header; a session only derives the
+// per-object subkey named by TLV_SUBKEY_ID. Objects carrying a subkey id can also be
+// opened with the password or raw key alone (master key, then subkey). Objects
+// rekeyed onto a session without a subkey id have their key slot wrapped by the
+// master key itself. use_cache as for derive_key_for_header.
+// Returns -1 for an invalid key mode, -2 if key derivation failed, -3 if the
+// object does not belong to the session and -11 if the memory budget was exhausted
+static int derive_container_key(const void *key_material, int key_mode, const header_t *hdr,
+                                const uint8_t *tlv_data, size_t tlv_len, int use_cache, uint8_t key[32]) {
+    uint64_t subkey_id = 0;
+    
+    if (key_mode == KEY_MODE_SESSION) {
+        const lrs_session_t *session = (const lrs_session_t*)key_material;
+        if (!session || !session->master_key) {
+            return -1; // Invalid key mode
+        }
+        if (session_object_subkey_id(session, hdr, tlv_data, tlv_len, &subkey_id) != 0) {
+            uint8_t length = 0;
+            if (tlv_subkey_id(tlv_data, tlv_len, &subkey_id) || !tlv_data ||
+                !find_tlv(tlv_data, tlv_len, TLV_KEY_SLOT, &length) ||
+                detect_key_mode(tlv_data, tlv_len, session->key_mode) != session->key_mode ||
+                !session_matches_header(session, hdr)) {
+                return -3; // Not an object of this session
+            }
+            memcpy(key, session->master_key, 32);
+            return 0;
+        }
+        
+        if (crypto_kdf_derive_from_key(key, 32, subkey_id, LRS_SUBKEY_CONTEXT, session->master_key) != 0) {
+            return -2;
+        }
+        return 0;
+    }
+    
+    int has_subkey = tlv_subkey_id(tlv_data, tlv_len, &subkey_id);
+    
+    // Check for key mode in TLV data if available
+    int kdf_result = derive_key_for_header(key_material, detect_key_mode(tlv_data, tlv_len, key_mode),
+                                           hdr, use_cache, key);
+    if (kdf_result != 0 || !has_subkey) {
+        return kdf_result;
+    }
+    
+    // Session object opened without a session: the derived key is the master key
+    uint8_t master_key[32];
+    memcpy(master_key, key, sizeof master_key);
+    kdf_result = crypto_kdf_derive_from_key(key, 32, subkey_id, LRS_SUBKEY_CONTEXT, master_key);
+    sodium_memzero(master_key, sizeof master_key);
+    
+    return kdf_result == 0 ? 0 : -2;
+}
+
+// Key check value: a keyed BLAKE2b of the header nonce under the container key
+// Recorded in TLV_KEY_CHECK, it lets a reader reject a wrong key right after the
+// KDF instead of after reading and failing to open the payload. It reveals
+// nothing about the key and differs for every object, since the nonce does.
+static void key_check_value(const uint8_t key[32], const header_t *hdr, uint8_t out[LRS_KEY_CHECK_BYTES]) {
+    static const uint8_t label[] = "LRS key check";
+    crypto_generichash_state state;
+    
+    crypto_generichash_init(&state, key, 32, LRS_KEY_CHECK_BYTES);
+    crypto_generichash_update(&state, label, sizeof(label));
+    crypto_generichash_update(&state, hdr->nonce, sizeof(hdr->nonce));
+    crypto_generichash_final(&state, out, LRS_KEY_CHECK_BYTES);
+    sodium_memzero(&state, sizeof(state));
+}
+
+// Append TLV_KEY_CHECK for a freshly derived key, if the TLV buffer has room
+// Returns the new TLV length; hdr->tlv_len is updated
+static size_t add_key_check(const uint8_t key[32], header_t *hdr, uint8_t *tlv_buffer,
+                            size_t tlv_len, size_t tlv_buffer_size) {
+    uint8_t check[LRS_KEY_CHECK_BYTES];
+    key_check_value(key, hdr, check);
+    tlv_len += add_tlv(tlv_buffer + tlv_len, tlv_buffer_size - tlv_len, TLV_KEY_CHECK, check, sizeof(check));
+    hdr->tlv_len = htons((uint16_t)tlv_len);
+    
+    return tlv_len;
+}
+
+// Chunk root MAC: keyed with the payload key, so only a key holder can
+// produce a root that lrs_verify_file and lrs_open accept
+static void chunk_root_mac(const uint8_t key[32], const header_t *hdr,
+                           const uint8_t root[LRS_MERKLE_HASH_BYTES], uint8_t out[LRS_ROOT_MAC_BYTES]) {
+    static const uint8_t label[] = "LRS chunk root";
+    crypto_generichash_state state;
+    
+    crypto_generichash_init(&state, key, 32, LRS_ROOT_MAC_BYTES);
+    crypto_generichash_update(&state, label, sizeof(label));
+    crypto_generichash_update(&state, hdr->nonce, sizeof(hdr->nonce));
+    crypto_generichash_update(&state, root, LRS_MERKLE_HASH_BYTES);
+    crypto_generichash_final(&state, out, LRS_ROOT_MAC_BYTES);
+    sodium_memzero(&state, sizeof(state));
+}
+
+// TLV_CHUNK_ROOT's value followed by the TLV_ROOT_MAC entry reserved after it
+#define ROOT_FIELD_BYTES (LRS_MERKLE_HASH_BYTES + 2 + LRS_ROOT_MAC_BYTES)
+
+// Fill in a reserved root field: the root, then its MAC
+static void seal_chunk_root(const uint8_t key[32], const header_t *hdr,
+                            const uint8_t root[LRS_MERKLE_HASH_BYTES], uint8_t field[ROOT_FIELD_BYTES]) {
+    memcpy(field, root, LRS_MERKLE_HASH_BYTES);
+    field[LRS_MERKLE_HASH_BYTES] = TLV_ROOT_MAC;
+    field[LRS_MERKLE_HASH_BYTES + 1] = LRS_ROOT_MAC_BYTES;
+    chunk_root_mac(key, hdr, root, field + LRS_MERKLE_HASH_BYTES + 2);
+}
+
+// Read a container's chunk root, checking its MAC under the payload key
+// Returns 1 with root filled in, 0 if there is no root, or -8 if the root has
+// no MAC or the MAC does not match (root or MAC altered)
+static int read_chunk_root(const uint8_t key[32], const header_t *hdr, const uint8_t *tlv_data,
+                           size_t tlv_len, uint8_t root[LRS_MERKLE_HASH_BYTES]) {
+    uint8_t length = 0;
+    const uint8_t *value = find_tlv(tlv_data, tlv_len, TLV_CHUNK_ROOT, &length);
+    if (!value || length != LRS_MERKLE_HASH_BYTES) return 0;
+    memcpy(root, value, LRS_MERKLE_HASH_BYTES);
+    
+    const uint8_t *mac = find_tlv(tlv_data, tlv_len, TLV_ROOT_MAC, &length);
+    if (!mac || length != LRS_ROOT_MAC_BYTES) return -8;
+    uint8_t expected[LRS_ROOT_MAC_BYTES];
+    chunk_root_mac(key, hdr, root, expected);
+    return sodium_memcmp(expected, mac, sizeof(expected)) == 0 ? 1 : -8;
+}
+
+// Key slot: payloads are sealed under a random data key, which TLV_KEY_SLOT
+// holds wrapped (XChaCha20-Poly1305, own nonce, bound to the header nonce) by
+// the key derived from the password, raw key or session. A new password only
+// rewrites the slot (lrs_rekey); the payload and the key check value stay.
+static void key_slot_ad(const header_t *hdr, uint8_t ad[12 + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES]) {
+    memcpy(ad, "LRS key slot", 12);
+    memcpy(ad + 12, hdr->nonce, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
+}
+
+static void wrap_data_key(const uint8_t wrapping_key[32], const header_t *hdr, const uint8_t data_key[32],
+                          uint8_t slot[LRS_KEY_SLOT_BYTES]) {
+    uint8_t ad[12 + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
+    key_slot_ad(hdr, ad);
+    randombytes_buf(slot, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
+    crypto_aead_xchacha20poly1305_ietf_encrypt(slot + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES, NULL,
+                                               data_key, 32, ad, sizeof(ad), NULL, slot, wrapping_key);
+}
+
+// Returns 0, or -1 if the slot does not open under wrapping_key
+static int unwrap_data_key(const uint8_t wrapping_key[32], const header_t *hdr, const uint8_t slot[LRS_KEY_SLOT_BYTES],
+                           uint8_t data_key[32]) {
+    uint8_t ad[12 + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
+    key_slot_ad(hdr, ad);
+    return crypto_aead_xchacha20poly1305_ietf_decrypt(data_key, NULL, NULL,
+                                                      slot + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES,
+                                                      LRS_KEY_SLOT_BYTES - crypto_aead_xchacha20poly1305_ietf_NPUBBYTES,
+                                                      ad, sizeof(ad), slot, wrapping_key) == 0 ? 0 : -1;
+}
+
+// Derive the key of a container being written
+// With key_slot set (files and streams, which lrs_rekey can rewrite) the payload
+// gets a random data key, wrapped in TLV_KEY_SLOT; without it, or without room
+// for the slot (and the check value), the derived key seals the payload directly.
+// TLV_KEY_CHECK follows, over the payload key. Updates *tlv_len and
+// hdr->tlv_len; returns as derive_container_key
+static int seal_container_key(const void *key_material, int key_mode, header_t *hdr, uint8_t *tlv_buffer,
+                              size_t *tlv_len, size_t tlv_buffer_size, int key_slot, uint8_t key[32]) {
+    int kdf_result = derive_container_key(key_material, key_mode, hdr, tlv_buffer, *tlv_len, 0, key);
+    if (kdf_result != 0) return kdf_result;
+    
+    if (key_slot && tlv_buffer_size - *tlv_len >= 2 + LRS_KEY_SLOT_BYTES + 2 + LRS_KEY_CHECK_BYTES) {
+        uint8_t data_key[32];
+        uint8_t slot[LRS_KEY_SLOT_BYTES];
+        randombytes_buf(data_key, sizeof data_key);
+        wrap_data_key(key, hdr, data_key, slot);
+        *tlv_len += add_tlv(tlv_buffer + *tlv_len, tlv_buffer_size - *tlv_len, TLV_KEY_SLOT, slot, sizeof(slot));
+        hdr->version |= VERSION_KEY_SLOT;
+        memcpy(key, data_key, sizeof data_key);
+        sodium_memzero(data_key, sizeof data_key);
+    }
+    *tlv_len = add_key_check(key, hdr, tlv_buffer, *tlv_len, tlv_buffer_size);
+    
+    return 0;
+}
+
+// Derive the key of a container to open: unwrap the data key from its key slot
+// if it has one, then compare against TLV_KEY_CHECK if present. -4 (and a
+// wiped key) for a wrong key, otherwise as derive_container_key
+static int derive_checked_key(const void *key_material, int key_mode, const header_t *hdr,
+                              const uint8_t *tlv_data, size_t tlv_len, uint8_t key[32]) {
+    int kdf_result = derive_container_key(key_material, key_mode, hdr, tlv_data, tlv_len, 1, key);
+    if (kdf_result != 0) return kdf_result;
+    
+    uint8_t length = 0;
+    const uint8_t *slot = tlv_data ? find_tlv(tlv_data, tlv_len, TLV_KEY_SLOT, &length) : NULL;
+    if (slot && length == LRS_KEY_SLOT_BYTES) {
+        uint8_t wrapping_key[32];
+        memcpy(wrapping_key, key, sizeof wrapping_key);
+        int unwrap_result = unwrap_data_key(wrapping_key, hdr, slot, key);
+        sodium_memzero(wrapping_key, sizeof wrapping_key);
+        if (unwrap_result != 0) {
+            sodium_memzero(key, 32);
+            return -4; // Wrong key
+        }
+    }
+    
+    const uint8_t *recorded = tlv_data ? find_tlv(tlv_data, tlv_len, TLV_KEY_CHECK, &length) : NULL;
+    if (!recorded || length != LRS_KEY_CHECK_BYTES) return 0;
+    
+    uint8_t check[LRS_KEY_CHECK_BYTES];
+    key_check_value(key, hdr, check);
+    if (sodium_memcmp(check, recorded, sizeof(check)) != 0) {
+        sodium_memzero(key, 32);
+        return -4; // Wrong key
+    }
+    return 0;
+}
+
+// Map a derive_checked_key failure onto the decrypt_blob_ex error codes
+static int kdf_error(int kdf_result) {
+    if (kdf_result == -1) return -6;  // Invalid key mode
+    if (kdf_result == -3) return -10; // Object not from this session
+    if (kdf_result == -4) return -8;  // Key check failed, as an authentication failure would
+    if (kdf_result == -11) return -11; // Memory budget exhausted
+    return -7;                        // Key derivation failed
+}
+
+// Encrypt data using XChaCha20-Poly1305 with support for password or raw key modes
+int encrypt_blob_ex(const uint8_t *pt, size_t pt_len,
+                  const void *key_material, int key_mode, const uint8_t *aad, size_t aad_len,
+                  header_t *hdr, uint8_t *tlv_buffer, size_t tlv_buffer_size, uint8_t *ct, size_t *ct_len) {
+    size_t tlv_len = init_header(hdr, VERSION, key_material, key_mode, aad, aad_len,
+                                 tlv_buffer, tlv_buffer_size);
+
+    // Derive key based on mode
+    uint8_t key[32];
+    int kdf_result = seal_container_key(key_material, key_mode, hdr, tlv_buffer, &tlv_len, tlv_buffer_size,
+                                        0, key);
+    if (kdf_result != 0) {
+        // Invalid key mode, key derivation failed or memory budget exhausted
+        return kdf_result == -11 ? -11 : -1;
+    }
+
+    // Encrypt using XChaCha20-Poly1305
+    unsigned long long clen = 0;
+    int encrypt_result = crypto_aead_xchacha20poly1305_ietf_encrypt(
+        ct, &clen, pt, pt_len, aad, aad_len, NULL, hdr->nonce, key);
+    
+    // Always zero out the key immediately after use
+    sodium_memzero(key, sizeof key);
+    
+    // Check encryption result
+    if (encrypt_result != 0) {
+        return -2; // Encryption failed
+    }
+
+    *ct_len = (size_t)clen;
+    return 0;
+}
+
+// Backward compatibility wrapper for encrypt_blob
+int encrypt_blob(const uint8_t *pt, size_t pt_len,
+                const char *pwd, const uint8_t *aad, size_t aad_len,
+                header_t *hdr, uint8_t *ct, size_t *ct_len) {
+    // Allocate a small buffer for TLV data
+    uint8_t tlv_buffer[64] = {0};
+    
+    return encrypt_blob_ex(pt, pt_len, pwd, KEY_MODE_PASSWORD, aad, aad_len,
+                         hdr, tlv_buffer, sizeof(tlv_buffer), ct, ct_len);
+}
+
+// Decrypt data using XChaCha20-Poly1305 with support for password or raw key modes
+// Open a single-blob (v1/v2) payload with an already derived key
+static int open_blob(const uint8_t *ct, size_t ct_len, const uint8_t key[32],
+                     const uint8_t *aad, size_t aad_len,
+                     const uint8_t nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES],
+                     uint8_t *pt, size_t *pt_len) {
+    // Decrypt using XChaCha20-Poly1305
+    unsigned long long plen = 0;
+    int decrypt_result = crypto_aead_xchacha20poly1305_ietf_decrypt(
+        pt, &plen, NULL, ct, ct_len, aad, aad_len, nonce, key);
+    
+    // Check decryption result - return nothing on failure
+    if (decrypt_result != 0) {
+        // Authentication or decryption failed - no partial output
+        return -8; // auth fail => no output
+    }
+
+    *pt_len = (size_t)plen;
+    return 0;
+}
+
+int decrypt_blob_ex(const uint8_t *ct, size_t ct_len,
+                  const void *key_material, int key_mode, const uint8_t *aad, size_t aad_len,
+                  const header_t *hdr, const uint8_t *tlv_data, size_t tlv_len,
+                  uint8_t *pt, size_t *pt_len) {
+    int header_result = check_header(hdr);
+    if (header_result != 0) {
+        return header_result;
+    }
+
+    // Version 2 is our target, but we can also handle version 1 for backward compatibility
+    // Chunked (v3) payloads must go through decrypt_stream
+    if (header_layout(hdr) == VERSION_STREAM) {
+        return -2; // Unsupported version
+    }
+
+    // Derive key based on the key mode detected from the TLV data
+    uint8_t key[32];
+    int kdf_result = derive_checked_key(key_material, key_mode, hdr, tlv_data, tlv_len, key);
+    if (kdf_result != 0) {
+        return kdf_error(kdf_result);
+    }
+
+    int result = open_blob(ct, ct_len, key, aad, aad_len, hdr->nonce, pt, pt_len);
+    
+    // Always zero out the key immediately after use
+    sodium_memzero(key, sizeof key);
+    
+    return result;
+}
+
+// Backward compatibility wrapper for decrypt_blob
 int decrypt_blob(const uint8_t *ct, size_t ct_len,
                 const char *pwd, const uint8_t *aad, size_t aad_len,
                 const header_t *hdr, uint8_t *pt, size_t *pt_len) {
@@ -337,7 +1035,7 @@ int decrypt_blob(const uint8_t *ct, size_t ct_len,
     const uint8_t *tlv_data = NULL;
     size_t tlv_len = 0;
     
-    if (hdr->version >= 2) {
+    if (header_layout(hdr) >= 2) {
         tlv_len = ntohs(hdr->tlv_len);
         // TLV data would be located after the header in the actual encrypted data
         // But we don't have access to it in this compatibility wrapper
@@ -347,15 +1045,72 @@ int decrypt_blob(const uint8_t *ct, size_t ct_len,
                          hdr, tlv_data, tlv_len, pt, pt_len);
 }
 
+// In-place variants with a detached tag
+// The ciphertext overwrites the plaintext (and back) in `buf`, which keeps its
+// length; the 16-byte tag goes to a separate buffer so it can be stored in a
+// side table or next to the header. encrypt_blob_ex's ciphertext is exactly
+// buf followed by the tag.
+int encrypt_blob_inplace(uint8_t *buf, size_t len,
+                       const void *key_material, int key_mode, const uint8_t *aad, size_t aad_len,
+                       header_t *hdr, uint8_t *tlv_buffer, size_t tlv_buffer_size,
+                       uint8_t tag[crypto_aead_xchacha20poly1305_ietf_ABYTES]) {
+    size_t tlv_len = init_header(hdr, VERSION, key_material, key_mode, aad, aad_len,
+                                 tlv_buffer, tlv_buffer_size);
+    
+    uint8_t key[32];
+    int kdf_result = seal_container_key(key_material, key_mode, hdr, tlv_buffer, &tlv_len, tlv_buffer_size,
+                                        0, key);
+    if (kdf_result != 0) {
+        return kdf_result == -11 ? -11 : -1;
+    }
+    
+    int encrypt_result = crypto_aead_xchacha20poly1305_ietf_encrypt_detached(
+        buf, tag, NULL, buf, len, aad, aad_len, NULL, hdr->nonce, key);
+    
+    sodium_memzero(key, sizeof key);
+    
+    return encrypt_result == 0 ? 0 : -2;
+}
+
+// Decrypt `len` bytes of ciphertext in place; error codes as for decrypt_blob_ex
+// On authentication failure `buf` is wiped rather than left holding ciphertext
+int decrypt_blob_inplace(uint8_t *buf, size_t len,
+                       const void *key_material, int key_mode, const uint8_t *aad, size_t aad_len,
+                       const header_t *hdr, const uint8_t *tlv_data, size_t tlv_len,
+                       const uint8_t tag[crypto_aead_xchacha20poly1305_ietf_ABYTES]) {
+    int header_result = check_header(hdr);
+    if (header_result != 0) {
+        return header_result;
+    }
+    if (header_layout(hdr) == VERSION_STREAM) {
+        return -2; // Unsupported version
+    }
+    
+    uint8_t key[32];
+    int kdf_result = derive_checked_key(key_material, key_mode, hdr, tlv_data, tlv_len, key);
+    if (kdf_result != 0) {
+        return kdf_error(kdf_result);
+    }
+    
+    int decrypt_result = crypto_aead_xchacha20poly1305_ietf_decrypt_detached(
+        buf, NULL, buf, len, tag, aad, aad_len, hdr->nonce, key);
+    
+    sodium_memzero(key, sizeof key);
+    
+    if (decrypt_result != 0) {
+        sodium_memzero(buf, len);
+        return -8; // auth fail => no output
+    }
+    
+    return 0;
+}
+
 // Convert binary data to hexadecimal string
 char* bin_to_hex(const uint8_t *data, size_t len) {
-    char *hex = (char*)malloc(len * 2 + 1);
+    char *hex = (char*)lrs_alloc(len * 2 + 1);
     if (!hex) return NULL;
     
-    for (size_t i = 0; i < len; i++) {
-        sprintf(hex + (i * 2), "%02x", data[i]);
-    }
-    hex[len * 2] = '\0';
+    lrs_hex_encode(hex, data, len);
     
     return hex;
 }
@@ -368,22 +1123,18 @@ int hex_to_bin(const char *hex, uint8_t *bin, size_t *bin_len) {
     size_t len = hex_len / 2;
     if (len > *bin_len) return -1; // Buffer too small
     
-    for (size_t i = 0; i < len; i++) {
-        unsigned int val;
-        if (sscanf(hex + (i * 2), "%02x", &val) != 1) {
-            return -1; // Invalid hex character
-        }
-        bin[i] = (uint8_t)val;
+    if (lrs_hex_decode(bin, hex, hex_len) != 0) {
+        return -1; // Invalid hex character
     }
     
     *bin_len = len;
     return 0;
 }
 
-// Encrypt a string and return the result as a hex string
-char* encrypt_string(const char *plaintext, const char *password, const char *paths) {
-    if (!plaintext || !password) return NULL;
-    
+// Encrypt a string into a serialized blob: header, TLV section, ciphertext
+// Returns a buffer of *blob_len bytes from the current allocator, or NULL on failure
+static uint8_t *seal_string(const char *plaintext, const void *key_material, int key_mode,
+                            const char *paths, size_t *blob_len) {
     // Initialize header
     header_t header;
     
@@ -391,15 +1142,11 @@ char* encrypt_string(const char *plaintext, const char *password, const char *pa
     size_t pt_len = strlen(plaintext);
     size_t ct_len = pt_len + crypto_aead_xchacha20poly1305_ietf_ABYTES; // Ciphertext + auth tag
     
-    // Allocate space for TLV data (up to 64 bytes)
-    uint8_t tlv_buffer[64] = {0};
-    size_t tlv_len = 0;
-    
-    // Calculate total length including header, TLV data, and ciphertext
-    size_t total_len = sizeof(header) + 64 + ct_len; // Allocate max TLV space
-    
-    // Allocate memory for the encrypted data
-    uint8_t *encrypted = (uint8_t*)malloc(total_len);
+    // Allocate for the largest TLV section; the ciphertext is moved up once
+    // the actual TLV length is known
+    uint8_t tlv_buffer[LRS_TLV_MAX] = {0};
+    size_t total_len = sizeof(header) + LRS_TLV_MAX + ct_len;
+    uint8_t *encrypted = (uint8_t*)lrs_alloc(total_len);
     if (!encrypted) return NULL;
     
     // Encrypt the plaintext
@@ -412,56 +1159,36 @@ char* encrypt_string(const char *plaintext, const char *password, const char *pa
     }
     
     int encrypt_result = encrypt_blob_ex((const uint8_t*)plaintext, pt_len,
-                    password, KEY_MODE_PASSWORD, aad, aad_len,
+                    key_material, key_mode, aad, aad_len,
                     &header, tlv_buffer, sizeof(tlv_buffer), 
-                    encrypted + sizeof(header) + ntohs(header.tlv_len), &ct_len);
+                    encrypted + sizeof(header) + LRS_TLV_MAX, &ct_len);
     
     if (encrypt_result != 0) {
         // Clean up on encryption failure
         sodium_memzero(encrypted, total_len);
-        free(encrypted);
+        lrs_free(encrypted);
         return NULL;
     }
     
     // Get actual TLV length from header
-    tlv_len = ntohs(header.tlv_len);
+    size_t tlv_len = ntohs(header.tlv_len);
     
-    // Copy the header to the beginning of the encrypted data
+    // Copy the header to the beginning of the encrypted data, the TLV data
+    // after it and the ciphertext after that
     memcpy(encrypted, &header, sizeof(header));
+    memcpy(encrypted + sizeof(header), tlv_buffer, tlv_len);
+    memmove(encrypted + sizeof(header) + tlv_len, encrypted + sizeof(header) + LRS_TLV_MAX, ct_len);
     
-    // Copy the TLV data after the header
-    if (tlv_len > 0) {
-        memcpy(encrypted + sizeof(header), tlv_buffer, tlv_len);
-    }
-    
-    // Calculate actual total length
-    total_len = sizeof(header) + tlv_len + ct_len;
-    
-    // Convert the encrypted data to a hex string
-    char *hex = bin_to_hex(encrypted, total_len);
-    free(encrypted);
-    
-    return hex;
+    *blob_len = sizeof(header) + tlv_len + ct_len;
+    return encrypted;
 }
 
-// Decrypt a hex string and return the plaintext
-char* decrypt_string(const char *hex_string, const char *password, const char *paths) {
-    if (!hex_string || !password) return NULL;
-    
-    // Calculate the maximum possible size of the binary data
-    size_t hex_len = strlen(hex_string);
-    size_t bin_max_len = hex_len / 2;
-    
-    // Allocate memory for the binary data
-    uint8_t *encrypted = (uint8_t*)malloc(bin_max_len);
-    if (!encrypted) return NULL;
-    
-    // Convert the hex string to binary data
-    size_t bin_len = bin_max_len;
-    if (hex_to_bin(hex_string, encrypted, &bin_len) != 0 || bin_len < sizeof(header_t)) {
-        free(encrypted);
-        return NULL;
-    }
+// Decrypt a serialized blob in place into a NUL-terminated string
+// The plaintext is moved to the start of `encrypted`, which is returned; on
+// failure the buffer is wiped and NULL returned (the caller still owns it)
+static char *open_string(uint8_t *encrypted, size_t bin_len, const void *key_material,
+                         int key_mode, const char *paths) {
+    if (bin_len < sizeof(header_t)) return NULL;
     
     // Extract the header
     header_t header;
@@ -469,20 +1196,14 @@ char* decrypt_string(const char *hex_string, const char *password, const char *p
     
     // Get TLV length from header if version 2+
     size_t tlv_len = 0;
-    if (header.version >= 2) {
+    if (header_layout(&header) >= 2) {
         tlv_len = ntohs(header.tlv_len);
     }
     
-    // Calculate the ciphertext offset and length
+    // Calculate the ciphertext offset and length (tag included)
     size_t header_offset = sizeof(header) + tlv_len;
-    size_t ct_len = bin_len - header_offset;
-    
-    // Allocate memory for the plaintext (will be smaller than ciphertext)
-    uint8_t *plaintext = (uint8_t*)malloc(ct_len);
-    if (!plaintext) {
-        free(encrypted);
-        return NULL;
-    }
+    if (bin_len < header_offset + crypto_aead_xchacha20poly1305_ietf_ABYTES) return NULL;
+    size_t pt_len = bin_len - header_offset - crypto_aead_xchacha20poly1305_ietf_ABYTES;
     
     // Decrypt the ciphertext
     // Handle paths/AAD consistently - NULL and empty string are treated the same
@@ -499,171 +1220,1413 @@ char* decrypt_string(const char *hex_string, const char *password, const char *p
         tlv_data = encrypted + sizeof(header);
     }
     
-    size_t pt_len;
-    int result = decrypt_blob_ex(encrypted + header_offset, ct_len,
-                             password, KEY_MODE_PASSWORD,
-                             aad, aad_len,
-                             &header, tlv_data, tlv_len, plaintext, &pt_len);
-    
-    free(encrypted);
+    uint8_t *ct = encrypted + header_offset;
+    int result = decrypt_blob_inplace(ct, pt_len, key_material, key_mode, aad, aad_len,
+                                      &header, tlv_data, tlv_len, ct + pt_len);
     
     if (result != 0) {
         // On decryption failure, return nothing - no partial plaintext
-        // Use the buffer size we allocated earlier
-        sodium_memzero(plaintext, ct_len);
-        free(plaintext);
+        sodium_memzero(encrypted, bin_len);
         return NULL;
     }
     
-    // Ensure the plaintext is null-terminated
-    char *output = (char*)realloc(plaintext, pt_len + 1);
-    if (!output) {
-        free(plaintext);
-        return NULL;
-    }
-    output[pt_len] = '\0';
+    // Move the plaintext over the header and null-terminate it; the tag leaves
+    // room for the terminator
+    memmove(encrypted, ct, pt_len);
+    encrypted[pt_len] = '\0';
     
-    return output;
+    return (char*)encrypted;
 }
 
-// Encrypt a file
-int encrypt_file(const char *input_file, const char *output_file, const char *password, const char *paths) {
-    if (!input_file || !output_file || !password) return -1;
-    
-    // Open input file
-    FILE *in = fopen(input_file, "rb");
-    if (!in) return -1;
-    
-    // Get file size
-    fseek(in, 0, SEEK_END);
-    long file_size = ftell(in);
-    fseek(in, 0, SEEK_SET);
-    
-    if (file_size < 0) {
-        fclose(in);
-        return -1;
-    }
-    
-    // Read file content
-    uint8_t *plaintext = (uint8_t*)malloc(file_size);
-    if (!plaintext) {
-        fclose(in);
-        return -1;
-    }
-    
-    size_t bytes_read = fread(plaintext, 1, file_size, in);
-    fclose(in);
-    
-    if (bytes_read != (size_t)file_size) {
-        free(plaintext);
-        return -1;
-    }
-    
-    // Initialize header
-    header_t header;
-    
-    // Allocate space for TLV data (up to 64 bytes)
-    uint8_t tlv_buffer[64] = {0};
-    
-    // Calculate ciphertext size
-    size_t ct_len = file_size + crypto_aead_xchacha20poly1305_ietf_ABYTES;
-    uint8_t *ciphertext = (uint8_t*)malloc(ct_len);
-    if (!ciphertext) {
-        free(plaintext);
-        return -1;
-    }
+// Encrypt a string and return the result in the requested encoding
+// Hex and base64url results are NUL-terminated; *out_len (optional for those,
+// required for LRS_ENCODING_BINARY) receives the length without the NUL
+char* encrypt_string_ex(const char *plaintext, const void *key_material, int key_mode,
+                      const char *paths, int encoding, size_t *out_len) {
+    if (!plaintext || !key_material) return NULL;
+    if (encoding == LRS_ENCODING_BINARY && !out_len) return NULL;
+    
+    size_t bin_len = 0;
+    uint8_t *encrypted = seal_string(plaintext, key_material, key_mode, paths, &bin_len);
+    if (!encrypted) return NULL;
     
-    // Encrypt the file content
-    // Handle paths/AAD consistently - NULL and empty string are treated the same
-    const uint8_t *aad = NULL;
-    size_t aad_len = 0;
-    if (paths != NULL && paths[0] != '\0') {
-        aad = (const uint8_t*)paths;
-        aad_len = strlen(paths);
+    char *output = NULL;
+    size_t output_len = 0;
+    
+    switch (encoding) {
+    case LRS_ENCODING_HEX:
+        output = bin_to_hex(encrypted, bin_len);
+        output_len = bin_len * 2;
+        break;
+    case LRS_ENCODING_BASE64URL: {
+        size_t b64_size = sodium_base64_encoded_len(bin_len, sodium_base64_VARIANT_URLSAFE_NO_PADDING);
+        output = (char*)lrs_alloc(b64_size);
+        if (output) {
+            sodium_bin2base64(output, b64_size, encrypted, bin_len, sodium_base64_VARIANT_URLSAFE_NO_PADDING);
+            output_len = b64_size - 1;
+        }
+        break;
     }
-    
-    int encrypt_result = encrypt_blob_ex(plaintext, file_size,
-                    password, KEY_MODE_PASSWORD,
-                    aad, aad_len,
-                    &header, tlv_buffer, sizeof(tlv_buffer), ciphertext, &ct_len);
-                    
-    if (encrypt_result != 0) {
-        // Clean up on encryption failure
-        sodium_memzero(plaintext, file_size);
-        free(plaintext);
-        free(ciphertext);
-        return -1;
+    case LRS_ENCODING_BINARY:
+        // Hand over the serialized blob as is
+        output = (char*)encrypted;
+        output_len = bin_len;
+        encrypted = NULL;
+        break;
+    default:
+        break; // Unknown encoding
     }
     
-    free(plaintext);
-    
-    // Get actual TLV length from header
-    size_t tlv_len = ntohs(header.tlv_len);
+    lrs_free(encrypted);
     
-    // Open output file
-    FILE *out = fopen(output_file, "wb");
-    if (!out) {
-        free(ciphertext);
-        return -1;
+    if (output && out_len) {
+        *out_len = output_len;
     }
+    return output;
+}
+
+// Decrypt `input_len` bytes in the given encoding and return the plaintext
+char* decrypt_string_ex(const char *input, size_t input_len, const void *key_material, int key_mode,
+                      const char *paths, int encoding) {
+    if (!input || !key_material) return NULL;
+    
+    // Decode into a buffer large enough for any encoding; it is decrypted in
+    // place and becomes the returned string
+    size_t bin_max_len = encoding == LRS_ENCODING_HEX ? input_len / 2 :
+                         encoding == LRS_ENCODING_BASE64URL ? input_len / 4 * 3 + 2 : input_len;
+    uint8_t *encrypted = (uint8_t*)lrs_alloc(bin_max_len ? bin_max_len : 1);
+    if (!encrypted) return NULL;
     
-    // Write header
-    if (fwrite(&header, sizeof(header), 1, out) != 1) {
-        fclose(out);
-        free(ciphertext);
-        return -1;
+    size_t bin_len = 0;
+    int decode_result = -1;
+    if (encoding == LRS_ENCODING_BINARY) {
+        memcpy(encrypted, input, input_len);
+        bin_len = input_len;
+        decode_result = 0;
+    } else if (encoding == LRS_ENCODING_HEX) {
+        decode_result = lrs_hex_decode(encrypted, input, input_len);
+        bin_len = input_len / 2;
+    } else if (encoding == LRS_ENCODING_BASE64URL) {
+        decode_result = sodium_base642bin(encrypted, bin_max_len, input, input_len, NULL, &bin_len,
+                                          NULL, sodium_base64_VARIANT_URLSAFE_NO_PADDING);
     }
     
-    // Write TLV data if present
-    if (tlv_len > 0) {
-        if (fwrite(tlv_buffer, 1, tlv_len, out) != tlv_len) {
-            fclose(out);
-            free(ciphertext);
-            return -1;
-        }
+    char *output = NULL;
+    if (decode_result == 0) {
+        output = open_string(encrypted, bin_len, key_material, key_mode, paths);
     }
     
-    // Write ciphertext
-    if (fwrite(ciphertext, 1, ct_len, out) != ct_len) {
-        fclose(out);
-        free(ciphertext);
-        return -1;
+    if (!output) {
+        lrs_free(encrypted);
     }
-    
-    fclose(out);
-    free(ciphertext);
-    
-    return 0; // Success
+    return output;
 }
 
-// Decrypt a file
-int decrypt_file(const char *input_file, const char *output_file, const char *password, const char *paths) {
-    if (!input_file || !output_file || !password) return -1;
+// Encrypt a string and return the result as a hex string
+char* encrypt_string(const char *plaintext, const char *password, const char *paths) {
+    return encrypt_string_ex(plaintext, password, KEY_MODE_PASSWORD, paths, LRS_ENCODING_HEX, NULL);
+}
+
+// Decrypt a hex string and return the plaintext
+char* decrypt_string(const char *hex_string, const char *password, const char *paths) {
+    if (!hex_string) return NULL;
+    
+    return decrypt_string_ex(hex_string, strlen(hex_string), password, KEY_MODE_PASSWORD,
+                             paths, LRS_ENCODING_HEX);
+}
+
+// Check whether a stream has no more data, without consuming anything
+static int stream_at_eof(FILE *in) {
+    int c = fgetc(in);
+    if (c == EOF) return 1;
+    
+    ungetc(c, in);
+    return 0;
+}
+
+// Background I/O
+// A password KDF keeps a core busy for hundreds of milliseconds before any byte
+// of payload is needed. The file and stream paths run it on the calling thread,
+// where the KDF arena and allocator live, while a helper thread reads or faults
+// in the payload, so a cold file costs about max(KDF, I/O) rather than the sum.
+// Raw keys and sessions derive in microseconds and skip the helper.
+typedef struct io_helper {
+    void (*fn)(struct io_helper *helper);
+    void *arg;
+    int stop;               // Set once the caller has its key
+    int started;
+    pthread_t thread;
+} io_helper_t;
+
+static void *io_helper_main(void *ptr) {
+    io_helper_t *helper = (io_helper_t*)ptr;
+    helper->fn(helper);
+    return NULL;
+}
+
+// Whether deriving this container's key runs Argon2id
+static int kdf_is_slow(int key_mode, const uint8_t *tlv_data, size_t tlv_len) {
+    return key_mode != KEY_MODE_SESSION &&
+           detect_key_mode(tlv_data, tlv_len, key_mode) == KEY_MODE_PASSWORD;
+}
+
+// Run fn on a helper thread; returns 0 if no thread could be started
+static int io_helper_start(io_helper_t *helper, void (*fn)(io_helper_t*), void *arg) {
+    helper->fn = fn;
+    helper->arg = arg;
+    helper->stop = 0;
+    helper->started = pthread_create(&helper->thread, NULL, io_helper_main, helper) == 0;
+    return helper->started;
+}
+
+static int io_helper_stopping(const io_helper_t *helper) {
+    return __atomic_load_n(&helper->stop, __ATOMIC_ACQUIRE);
+}
+
+// Tell the helper to stop and wait for it (no-op if it never started)
+static void io_helper_finish(io_helper_t *helper) {
+    if (!helper->started) return;
+    
+    __atomic_store_n(&helper->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(helper->thread, NULL);
+    helper->started = 0;
+}
+
+// A mapped payload to fault in
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+} map_range_t;
+
+// Touch a mapping front to back until stopped, pulling it into the page cache
+// (the mapping is MADV_SEQUENTIAL, so each fault also reads ahead)
+static void prefetch_mapping(io_helper_t *helper) {
+    const map_range_t *range = (const map_range_t*)helper->arg;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    volatile uint8_t sink = 0;
+    
+    for (size_t offset = 0; offset < range->len && !io_helper_stopping(helper); offset += page) {
+        sink ^= range->data[offset];
+    }
+    (void)sink;
+}
+
+// A whole payload to read in one go
+typedef struct {
+    FILE *in;
+    uint8_t *buf;
+    size_t len;
+    size_t bytes_read;
+} whole_read_t;
+
+static void read_whole(io_helper_t *helper) {
+    whole_read_t *reader = (whole_read_t*)helper->arg;
+    reader->bytes_read = fread(reader->buf, 1, reader->len, reader->in);
+}
+
+// Start faulting in a mapped payload if the key derivation is worth overlapping
+static void prefetch_mapping_begin(io_helper_t *helper, map_range_t *range, int slow_kdf) {
+    helper->started = 0;
+    if (slow_kdf && range->len > 0) {
+        io_helper_start(helper, prefetch_mapping, range);
+    }
+}
+
+// Stream input read ahead into a bounded buffer while the key is derived;
+// reads drain the buffer before going back to the stream
+typedef struct {
+    FILE *in;
+    io_helper_t *helper;
+    const lrs_allocator_t *allocator; // The caller's: the buffer grows on the helper thread
+    uint8_t *data;
+    size_t capacity;        // Allocated and reserved
+    size_t limit;           // LRS_READAHEAD_MAX, or what is left of a regular file
+    size_t initial;         // First allocation: LRS_READAHEAD_MIN, or all of the limit for a file
+    size_t len;             // Bytes read ahead
+    size_t pos;             // Bytes handed out
+    size_t step;            // fread size: one chunk, so a slow pipe stalls no longer than necessary
+    size_t batch_size;      // The caller's batch buffers, reserved along with the read-ahead
+    size_t batch_reserved;
+} readahead_t;
+
+// Double the buffer up to the limit; only reserves what fits, as the read-ahead
+// is an optimisation and never waits
+static int readahead_grow(readahead_t *ahead) {
+    size_t capacity = ahead->capacity ? 2 * ahead->capacity : ahead->initial;
+    if (capacity > ahead->limit) capacity = ahead->limit;
+    if (lrs_memory_try_reserve(capacity - ahead->capacity) != 0) return -1;
+    
+    uint8_t *data = (uint8_t*)ahead->allocator->alloc(ahead->allocator->ctx, capacity);
+    if (!data) {
+        lrs_memory_release(capacity - ahead->capacity);
+        return -1;
+    }
+    if (ahead->data) {
+        memcpy(data, ahead->data, ahead->len);
+        sodium_memzero(ahead->data, ahead->len);
+        ahead->allocator->free(ahead->allocator->ctx, ahead->data);
+    }
+    ahead->data = data;
+    ahead->capacity = capacity;
+    
+    return 0;
+}
+
+static void readahead_fill(io_helper_t *helper) {
+    readahead_t *ahead = (readahead_t*)helper->arg;
+    
+    while (ahead->len < ahead->limit && !io_helper_stopping(helper)) {
+        if (ahead->len == ahead->capacity && readahead_grow(ahead) != 0) break;
+        
+        size_t wanted = ahead->capacity - ahead->len;
+        if (wanted > ahead->step) wanted = ahead->step;
+        
+        size_t bytes_read = fread(ahead->data + ahead->len, 1, wanted, ahead->in);
+        ahead->len += bytes_read;
+        if (bytes_read < wanted) break; // EOF or error; the reader sees it on the stream
+    }
+}
+
+// Runs from lrs_kdf_memory_held once the KDF has its memory: the batch buffers
+// are taken now if they fit, so nothing is reserved while the read-ahead is held
+// that could wait
+static void readahead_start(void *arg) {
+    readahead_t *ahead = (readahead_t*)arg;
+    
+    if (lrs_memory_try_reserve(ahead->batch_size) != 0) return;
+    ahead->batch_reserved = ahead->batch_size;
+    io_helper_start(ahead->helper, readahead_fill, ahead);
+}
+
+// Read ahead while the key is derived if the derivation is worth overlapping;
+// nothing is reserved until the KDF holds its own memory
+static void readahead_begin(readahead_t *ahead, io_helper_t *helper, FILE *in, size_t step,
+                            size_t batch_size, int slow_kdf) {
+    memset(ahead, 0, sizeof(*ahead));
+    ahead->in = in;
+    ahead->helper = helper;
+    ahead->allocator = lrs_current_allocator();
+    ahead->limit = LRS_READAHEAD_MAX;
+    ahead->initial = LRS_READAHEAD_MIN;
+    ahead->step = step;
+    ahead->batch_size = batch_size;
+    helper->started = 0;
+    
+    // A regular file is never read ahead past its end, and a pipe's buffer grows
+    // with what arrives, so small inputs pin little of the budget
+    struct stat st;
+    off_t position = ftello(in);
+    if (fstat(fileno(in), &st) == 0 && S_ISREG(st.st_mode) && position >= 0) {
+        off_t left = st.st_size > position ? st.st_size - position : 0;
+        if ((uint64_t)left < ahead->limit) ahead->limit = (size_t)left;
+        ahead->initial = ahead->limit;
+    }
+    
+    if (slow_kdf && ahead->limit > 0) {
+        kdf_overlap_fn = readahead_start;
+        kdf_overlap_arg = ahead;
+    }
+}
+
+// Stop reading ahead once the key is derived (or the derivation failed)
+static void readahead_wait(readahead_t *ahead) {
+    kdf_overlap_fn = NULL;
+    io_helper_finish(ahead->helper);
+}
+
+// Reserve the caller's batch buffers, unless that was done with the read-ahead
+static int readahead_reserve_batch(readahead_t *ahead) {
+    if (ahead->batch_reserved) {
+        ahead->batch_reserved = 0;
+        return 0;
+    }
+    
+    return lrs_memory_reserve(ahead->batch_size);
+}
+
+// fread through the read-ahead buffer
+static size_t readahead_read(readahead_t *ahead, uint8_t *buf, size_t wanted) {
+    size_t bytes_read = 0;
+    
+    if (ahead->pos < ahead->len) {
+        bytes_read = ahead->len - ahead->pos;
+        if (bytes_read > wanted) bytes_read = wanted;
+        memcpy(buf, ahead->data + ahead->pos, bytes_read);
+        ahead->pos += bytes_read;
+    }
+    if (bytes_read < wanted) {
+        bytes_read += fread(buf + bytes_read, 1, wanted - bytes_read, ahead->in);
+    }
+    
+    return bytes_read;
+}
+
+static int readahead_at_eof(readahead_t *ahead) {
+    return ahead->pos == ahead->len && stream_at_eof(ahead->in);
+}
+
+// Release the buffer (wiped: when encrypting it holds plaintext) and a batch
+// reservation the caller did not take over
+static void readahead_end(readahead_t *ahead) {
+    if (ahead->batch_reserved) {
+        lrs_memory_release(ahead->batch_reserved);
+        ahead->batch_reserved = 0;
+    }
+    if (!ahead->data) return;
+    
+    sodium_memzero(ahead->data, ahead->len);
+    ahead->allocator->free(ahead->allocator->ctx, ahead->data);
+    lrs_memory_release(ahead->capacity);
+    ahead->data = NULL;
+}
+
+// Build the nonce for chunk `index` of a chunked (v3) payload
+// The chunk index is folded into the last 8 bytes of the header nonce and the
+// final chunk is flagged separately, so chunks cannot be reordered, dropped or
+// truncated without failing authentication
+static void chunk_nonce(const uint8_t base[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES],
+                        uint64_t index, int final,
+                        uint8_t nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES]) {
+    uint64_t index_be = htobe64(index);
+    const uint8_t *index_bytes = (const uint8_t*)&index_be;
+    
+    memcpy(nonce, base, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
+    for (size_t i = 0; i < sizeof(index_be); i++) {
+        nonce[16 + i] ^= index_bytes[i];
+    }
+    if (final) {
+        nonce[15] ^= 0x01;
+    }
+}
+
+// Read the chunk size recorded in a v3 TLV section (0 if missing or invalid)
+static uint32_t tlv_chunk_size(const uint8_t *tlv_data, size_t tlv_len) {
+    uint8_t length = 0;
+    const uint8_t *value = tlv_data ? find_tlv(tlv_data, tlv_len, TLV_CHUNK_SIZE, &length) : NULL;
+    if (!value || length != 4) return 0;
+    
+    uint32_t chunk_size_be;
+    memcpy(&chunk_size_be, value, 4);
+    uint32_t chunk_size = ntohl(chunk_size_be);
+    if (chunk_size == 0 || chunk_size > LRS_CHUNK_SIZE_MAX) return 0;
+    
+    return chunk_size;
+}
+
+// A run of consecutive chunks sealed or opened in one pool job
+typedef struct {
+    const uint8_t *key;
+    const uint8_t *base_nonce;
+    const uint8_t *aad;
+    size_t aad_len;
+    uint8_t *plaintext;     // chunk j at j * chunk_size
+    uint8_t *ciphertext;    // chunk j at j * (chunk_size + ABYTES)
+    size_t chunk_size;
+    uint64_t first_index;   // stream index of chunk 0 in this batch
+    size_t chunk_count;
+    size_t last_len;        // plaintext (seal) or sealed (open) length of the last chunk
+    int final;              // the last chunk of the batch ends the stream
+    int failed;
+} chunk_batch_t;
+
+static void seal_chunk(void *arg, size_t j) {
+    chunk_batch_t *batch = (chunk_batch_t*)arg;
+    int last = j == batch->chunk_count - 1;
+    size_t len = last ? batch->last_len : batch->chunk_size;
+    
+    uint8_t nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
+    chunk_nonce(batch->base_nonce, batch->first_index + j, batch->final && last, nonce);
+    
+    if (crypto_aead_xchacha20poly1305_ietf_encrypt(
+            batch->ciphertext + j * (batch->chunk_size + crypto_aead_xchacha20poly1305_ietf_ABYTES),
+            NULL, batch->plaintext + j * batch->chunk_size, len,
+            batch->aad, batch->aad_len, NULL, nonce, batch->key) != 0) {
+        __atomic_store_n(&batch->failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void open_chunk(void *arg, size_t j) {
+    chunk_batch_t *batch = (chunk_batch_t*)arg;
+    int last = j == batch->chunk_count - 1;
+    size_t sealed_size = batch->chunk_size + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    size_t len = last ? batch->last_len : sealed_size;
+    
+    uint8_t nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
+    chunk_nonce(batch->base_nonce, batch->first_index + j, batch->final && last, nonce);
+    
+    if (crypto_aead_xchacha20poly1305_ietf_decrypt(
+            batch->plaintext + j * batch->chunk_size, NULL, NULL,
+            batch->ciphertext + j * sealed_size, len,
+            batch->aad, batch->aad_len, nonce, batch->key) != 0) {
+        __atomic_store_n(&batch->failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Chunks buffered per batch: a single chunk when running serially, otherwise
+// enough to keep every thread busy between reads
+static size_t batch_chunk_count(const lrs_pool_t *pool) {
+    unsigned threads = lrs_pool_size(pool);
+    return threads > 1 ? (size_t)threads * LRS_CHUNKS_PER_THREAD : 1;
+}
+
+// Set up a v3 header, recording the chunk size in the TLV section for the reader
+// With root_offset set, a zeroed TLV_CHUNK_ROOT and TLV_ROOT_MAC are reserved and
+// *root_offset is where the root field starts in the TLV section (0 if it did not fit)
+static size_t init_stream_header(header_t *hdr, const void *key_material, int key_mode,
+                                 const uint8_t *aad, size_t aad_len, uint32_t chunk_size,
+                                 uint8_t *tlv_buffer, size_t tlv_buffer_size, size_t *root_offset) {
+    size_t tlv_len = init_header(hdr, VERSION_STREAM, key_material, key_mode, aad, aad_len,
+                                 tlv_buffer, tlv_buffer_size);
+    uint32_t chunk_size_be = htonl(chunk_size);
+    tlv_len += add_tlv(tlv_buffer + tlv_len, tlv_buffer_size - tlv_len,
+                       TLV_CHUNK_SIZE, (uint8_t*)&chunk_size_be, 4);
+    if (root_offset) {
+        uint8_t placeholder[LRS_MERKLE_HASH_BYTES] = {0};
+        *root_offset = 0;
+        if (tlv_buffer_size - tlv_len >= 2 + ROOT_FIELD_BYTES) {
+            tlv_len += add_tlv(tlv_buffer + tlv_len, tlv_buffer_size - tlv_len,
+                               TLV_CHUNK_ROOT, placeholder, sizeof(placeholder));
+            *root_offset = tlv_len - sizeof(placeholder);
+            tlv_len += add_tlv(tlv_buffer + tlv_len, tlv_buffer_size - tlv_len,
+                               TLV_ROOT_MAC, placeholder, LRS_ROOT_MAC_BYTES);
+        }
+    }
+    hdr->tlv_len = htons((uint16_t)tlv_len);
+    
+    return tlv_len;
+}
+
+// Fold the tags of a sealed run of chunks into the chunk Merkle tree
+static void merkle_add_chunks(lrs_merkle_t *tree, const uint8_t *sealed, size_t sealed_size,
+                              uint64_t first_index, size_t chunk_count, size_t last_len) {
+    for (size_t j = 0; j < chunk_count; j++) {
+        size_t len = j == chunk_count - 1 ? last_len : sealed_size;
+        uint8_t leaf[LRS_MERKLE_HASH_BYTES];
+        const uint8_t *tag = sealed + j * sealed_size + len - crypto_aead_xchacha20poly1305_ietf_ABYTES;
+        lrs_merkle_leaf(first_index + j, tag, leaf);
+        lrs_merkle_add(tree, leaf);
+    }
+}
+
+// Whether the header of a stream written at the current position can be patched
+// once the payload is out (not for pipes, nor for append mode, where writes
+// ignore the file position)
+static int stream_patchable(FILE *out, off_t *position) {
+    *position = ftello(out);
+    int flags = fcntl(fileno(out), F_GETFL);
+    return *position >= 0 && flags >= 0 && !(flags & O_APPEND) && fseeko(out, *position, SEEK_SET) == 0;
+}
+
+// Encrypt everything readable from `in` into a chunked (v3) container on `out`
+int encrypt_stream(FILE *in, FILE *out, const void *key_material, int key_mode,
+                 const uint8_t *aad, size_t aad_len, uint32_t chunk_size, unsigned threads) {
+    if (!in || !out || !key_material) return -1;
+    
+    if (chunk_size == 0) chunk_size = LRS_CHUNK_SIZE_DEFAULT;
+    if (chunk_size > LRS_CHUNK_SIZE_MAX) return -1;
+    
+    // Build header and TLV section; the chunk root is filled in at the end if
+    // the output allows going back to it
+    header_t header;
+    uint8_t tlv_buffer[LRS_TLV_MAX] = {0};
+    off_t header_position = 0;
+    size_t root_offset = 0;
+    size_t tlv_len = init_stream_header(&header, key_material, key_mode, aad, aad_len, chunk_size,
+                                        tlv_buffer, sizeof(tlv_buffer),
+                                        stream_patchable(out, &header_position) ? &root_offset : NULL);
+    lrs_merkle_t tree;
+    lrs_merkle_init(&tree);
+    
+    lrs_pool_t *pool = threads == 1 ? NULL : lrs_pool_create(threads);
+    size_t batch_chunks = batch_chunk_count(pool);
+    size_t sealed_size = (size_t)chunk_size + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    
+    // Only one batch of plaintext and ciphertext is ever held in memory
+    size_t buffers_size = batch_chunks * (chunk_size + sealed_size);
+    
+    // Derive key based on mode, reading input meanwhile
+    io_helper_t helper;
+    readahead_t ahead;
+    readahead_begin(&ahead, &helper, in, chunk_size, buffers_size,
+                    kdf_is_slow(key_mode, tlv_buffer, tlv_len));
+    uint8_t key[32];
+    int kdf_result = seal_container_key(key_material, key_mode, &header, tlv_buffer, &tlv_len,
+                                        sizeof(tlv_buffer), 1, key);
+    readahead_wait(&ahead);
+    if (kdf_result != 0) {
+        readahead_end(&ahead);
+        lrs_pool_destroy(pool);
+        return kdf_result == -11 ? -11 : -1;
+    }
+    
+    if (readahead_reserve_batch(&ahead) != 0) {
+        sodium_memzero(key, sizeof key);
+        readahead_end(&ahead);
+        lrs_pool_destroy(pool);
+        return -11; // Memory budget exhausted
+    }
+    uint8_t *plaintext = (uint8_t*)lrs_alloc(batch_chunks * chunk_size);
+    uint8_t *ciphertext = (uint8_t*)lrs_alloc(batch_chunks * sealed_size);
+    if (!plaintext || !ciphertext) {
+        sodium_memzero(key, sizeof key);
+        lrs_free(plaintext);
+        lrs_free(ciphertext);
+        lrs_memory_release(buffers_size);
+        readahead_end(&ahead);
+        lrs_pool_destroy(pool);
+        return -1;
+    }
+    
+    chunk_batch_t batch = {
+        .key = key, .base_nonce = header.nonce, .aad = aad, .aad_len = aad_len,
+        .plaintext = plaintext, .ciphertext = ciphertext, .chunk_size = chunk_size,
+    };
+    int result = 0;
+    
+    // Write header and TLV data
+    if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+        fwrite(tlv_buffer, 1, tlv_len, out) != tlv_len) {
+        result = -1;
+    }
+    
+    // Seal one batch at a time; the last chunk may be short or empty
+    while (result == 0) {
+        size_t wanted = batch_chunks * chunk_size;
+        size_t bytes_read = readahead_read(&ahead, plaintext, wanted);
+        if (ferror(in)) {
+            result = -1;
+            break;
+        }
+        
+        batch.final = bytes_read < wanted || readahead_at_eof(&ahead);
+        batch.chunk_count = (bytes_read + chunk_size - 1) / chunk_size;
+        if (batch.chunk_count == 0) batch.chunk_count = 1; // Empty final chunk
+        batch.last_len = bytes_read - (batch.chunk_count - 1) * chunk_size;
+        
+        lrs_pool_run(pool, batch.chunk_count, seal_chunk, &batch);
+        if (batch.failed) {
+            result = -2; // Encryption failed
+            break;
+        }
+        
+        // All chunks but the last are full, so the sealed batch is contiguous
+        size_t batch_len = (batch.chunk_count - 1) * sealed_size + batch.last_len +
+                           crypto_aead_xchacha20poly1305_ietf_ABYTES;
+        if (fwrite(ciphertext, 1, batch_len, out) != batch_len) {
+            result = -1;
+            break;
+        }
+        if (root_offset) {
+            merkle_add_chunks(&tree, ciphertext, sealed_size, batch.first_index, batch.chunk_count,
+                              batch.last_len + crypto_aead_xchacha20poly1305_ietf_ABYTES);
+        }
+        
+        if (batch.final) break;
+        batch.first_index += batch.chunk_count;
+    }
+    
+    // Fill in the chunk root and its MAC
+    if (result == 0 && root_offset) {
+        uint8_t root[LRS_MERKLE_HASH_BYTES];
+        uint8_t field[ROOT_FIELD_BYTES];
+        lrs_merkle_final(&tree, root);
+        seal_chunk_root(key, &header, root, field);
+        if (fseeko(out, header_position + (off_t)(sizeof(header) + root_offset), SEEK_SET) != 0 ||
+            fwrite(field, 1, sizeof(field), out) != sizeof(field) ||
+            fseeko(out, 0, SEEK_END) != 0) {
+            result = -1;
+        }
+    }
+    
+    // Always zero out the key and plaintext after use
+    sodium_memzero(key, sizeof key);
+    sodium_memzero(plaintext, batch_chunks * chunk_size);
+    lrs_free(plaintext);
+    lrs_free(ciphertext);
+    lrs_memory_release(buffers_size);
+    readahead_end(&ahead);
+    lrs_pool_destroy(pool);
+    
+    return result;
+}
+
+// Decrypt the chunk sequence of a v3 container whose header and TLV were already read
+static int decrypt_chunks(FILE *in, FILE *out, const header_t *hdr,
+                          const uint8_t *tlv_data, size_t tlv_len,
+                          const void *key_material, int key_mode,
+                          const uint8_t *aad, size_t aad_len, unsigned threads) {
+    int header_result = check_header(hdr);
+    if (header_result != 0) {
+        return header_result;
+    }
+    
+    uint32_t chunk_size = tlv_chunk_size(tlv_data, tlv_len);
+    if (chunk_size == 0) {
+        return -9; // Missing or invalid chunk layout
+    }
+    
+    lrs_pool_t *pool = threads == 1 ? NULL : lrs_pool_create(threads);
+    size_t batch_chunks = batch_chunk_count(pool);
+    size_t sealed_size = (size_t)chunk_size + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    size_t buffers_size = batch_chunks * (chunk_size + sealed_size);
+    
+    // Derive key based on detected mode, reading ciphertext meanwhile
+    io_helper_t helper;
+    readahead_t ahead;
+    readahead_begin(&ahead, &helper, in, sealed_size, buffers_size,
+                    kdf_is_slow(key_mode, tlv_data, tlv_len));
+    uint8_t key[32];
+    int kdf_result = derive_checked_key(key_material, key_mode, hdr, tlv_data, tlv_len, key);
+    readahead_wait(&ahead);
+    if (kdf_result != 0) {
+        readahead_end(&ahead);
+        lrs_pool_destroy(pool);
+        return kdf_error(kdf_result);
+    }
+    
+    if (readahead_reserve_batch(&ahead) != 0) {
+        sodium_memzero(key, sizeof key);
+        readahead_end(&ahead);
+        lrs_pool_destroy(pool);
+        return -11; // Memory budget exhausted
+    }
+    uint8_t *ciphertext = (uint8_t*)lrs_alloc(batch_chunks * sealed_size);
+    uint8_t *plaintext = (uint8_t*)lrs_alloc(batch_chunks * chunk_size);
+    if (!ciphertext || !plaintext) {
+        sodium_memzero(key, sizeof key);
+        lrs_free(ciphertext);
+        lrs_free(plaintext);
+        lrs_memory_release(buffers_size);
+        readahead_end(&ahead);
+        lrs_pool_destroy(pool);
+        return -1;
+    }
+    
+    chunk_batch_t batch = {
+        .key = key, .base_nonce = hdr->nonce, .aad = aad, .aad_len = aad_len,
+        .plaintext = plaintext, .ciphertext = ciphertext, .chunk_size = chunk_size,
+    };
+    int result = 0;
+    
+    // Only fully authenticated batches are ever written out
+    for (;;) {
+        size_t wanted = batch_chunks * sealed_size;
+        size_t bytes_read = readahead_read(&ahead, ciphertext, wanted);
+        if (ferror(in)) {
+            result = -1;
+            break;
+        }
+        
+        batch.final = bytes_read < wanted || readahead_at_eof(&ahead);
+        batch.chunk_count = (bytes_read + sealed_size - 1) / sealed_size;
+        batch.last_len = bytes_read - (batch.chunk_count ? batch.chunk_count - 1 : 0) * sealed_size;
+        if (batch.chunk_count == 0 || batch.last_len < crypto_aead_xchacha20poly1305_ietf_ABYTES) {
+            result = -8; // Truncated before the final chunk
+            break;
+        }
+        
+        lrs_pool_run(pool, batch.chunk_count, open_chunk, &batch);
+        if (batch.failed) {
+            result = -8; // auth fail => no output
+            break;
+        }
+        
+        size_t batch_len = bytes_read - batch.chunk_count * crypto_aead_xchacha20poly1305_ietf_ABYTES;
+        if (fwrite(plaintext, 1, batch_len, out) != batch_len) {
+            result = -1;
+            break;
+        }
+        
+        if (batch.final) break;
+        batch.first_index += batch.chunk_count;
+    }
+    
+    // Always zero out the key and plaintext after use
+    sodium_memzero(key, sizeof key);
+    sodium_memzero(plaintext, batch_chunks * chunk_size);
+    lrs_free(ciphertext);
+    lrs_free(plaintext);
+    lrs_memory_release(buffers_size);
+    readahead_end(&ahead);
+    lrs_pool_destroy(pool);
+    
+    return result;
+}
+
+// Decrypt a chunked (v3) container from `in` to `out`
+// On failure, `out` may hold the plaintext of chunks that did authenticate;
+// callers writing to a file should discard it
+int decrypt_stream(FILE *in, FILE *out, const void *key_material, int key_mode,
+                 const uint8_t *aad, size_t aad_len, unsigned threads) {
+    if (!in || !out || !key_material) return -1;
+    
+    // Read header; decrypt_chunks validates the rest
+    header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1) {
+        return -1;
+    }
+    
+    if (header_layout(&header) != VERSION_STREAM) {
+        return -2; // Unsupported version
+    }
+    
+    // Read TLV data
+    size_t tlv_len = ntohs(header.tlv_len);
+    uint8_t *tlv_data = (uint8_t*)lrs_alloc(tlv_len ? tlv_len : 1);
+    if (!tlv_data) return -1;
+    
+    if (fread(tlv_data, 1, tlv_len, in) != tlv_len) {
+        lrs_free(tlv_data);
+        return -1;
+    }
+    
+    int result = decrypt_chunks(in, out, &header, tlv_data, tlv_len,
+                                key_material, key_mode, aad, aad_len, threads);
+    lrs_free(tlv_data);
+    
+    return result;
+}
+
+// Batch API
+// Many small blobs under one session: the batch draws a single subkey, so no
+// item runs a KDF or touches the heap. Item i is sealed with the batch nonce
+// folded with i (as for stream chunks), which keeps nonces unique under the
+// subkey without drawing randomness per item. Every item is written as a
+// standalone v2 blob (header, TLV, ciphertext) that decrypt_blob_ex can open.
+
+// Upper bound on the arena needed by encrypt_blob_batch
+size_t lrs_batch_encrypted_size(const lrs_batch_item_t *items, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += sizeof(header_t) + LRS_TLV_MAX + items[i].len + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    }
+    return total;
+}
+
+// Upper bound on the arena needed by decrypt_blob_batch
+size_t lrs_batch_decrypted_size(const lrs_batch_item_t *items, size_t count) {
+    size_t overhead = sizeof(header_t) + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += items[i].len > overhead ? items[i].len - overhead : 0;
+    }
+    return total;
+}
+
+// Work shared by the tasks of one batch call
+typedef struct {
+    const lrs_session_t *session;
+    const lrs_batch_item_t *items;
+    size_t count;
+    uint8_t *arena;
+    lrs_batch_result_t *results;
+    const header_t *header;   // encrypt: header template
+    const uint8_t *tlv;       // encrypt: TLV section shared by every item
+    size_t tlv_len;
+    const uint8_t *key;       // encrypt: batch subkey
+    size_t failed;
+} blob_batch_t;
+
+static void seal_items(void *arg, size_t task) {
+    blob_batch_t *batch = (blob_batch_t*)arg;
+    size_t end = (task + 1) * LRS_BATCH_ITEMS_PER_TASK;
+    if (end > batch->count) end = batch->count;
+    
+    for (size_t i = task * LRS_BATCH_ITEMS_PER_TASK; i < end; i++) {
+        const lrs_batch_item_t *item = &batch->items[i];
+        lrs_batch_result_t *result = &batch->results[i];
+        uint8_t *out = batch->arena + result->offset;
+        
+        header_t hdr = *batch->header;
+        chunk_nonce(batch->header->nonce, i, 0, hdr.nonce);
+        set_aad_hash(&hdr, item->aad, item->aad_len);
+        
+        memcpy(out, &hdr, sizeof(hdr));
+        memcpy(out + sizeof(hdr), batch->tlv, batch->tlv_len);
+        
+        unsigned long long clen = 0;
+        if (crypto_aead_xchacha20poly1305_ietf_encrypt(
+                out + sizeof(hdr) + batch->tlv_len, &clen, item->data, item->len,
+                item->aad, item->aad_len, NULL, hdr.nonce, batch->key) != 0) {
+            result->len = 0;
+            result->status = -2; // Encryption failed
+            __atomic_fetch_add(&batch->failed, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        
+        result->len = sizeof(hdr) + batch->tlv_len + (size_t)clen;
+        result->status = 0;
+    }
+}
+
+// Open one serialized session blob into `pt`
+// The subkey of the previous item is kept in `key`/`key_id` and only re-derived
+// when the item names another one
+static int open_item(const lrs_session_t *session, const lrs_batch_item_t *item, uint8_t *pt,
+                     size_t *pt_len, uint8_t key[32], uint64_t *key_id, int *have_key) {
+    if (!item->data || item->len < sizeof(header_t)) {
+        return -5; // Invalid lengths
+    }
+    
+    header_t hdr;
+    memcpy(&hdr, item->data, sizeof(hdr));
+    
+    int header_result = check_header(&hdr);
+    if (header_result != 0) {
+        return header_result;
+    }
+    if (header_layout(&hdr) == VERSION_STREAM) {
+        return -2; // Unsupported version
+    }
+    
+    size_t tlv_len = ntohs(hdr.tlv_len);
+    if (item->len - sizeof(hdr) < tlv_len + crypto_aead_xchacha20poly1305_ietf_ABYTES) {
+        return -5;
+    }
+    const uint8_t *tlv = item->data + sizeof(hdr);
+    
+    uint64_t subkey_id = 0;
+    if (session_object_subkey_id(session, &hdr, tlv, tlv_len, &subkey_id) != 0) {
+        return -10; // Object not from this session
+    }
+    if (!*have_key || *key_id != subkey_id) {
+        if (crypto_kdf_derive_from_key(key, 32, subkey_id, LRS_SUBKEY_CONTEXT, session->master_key) != 0) {
+            *have_key = 0;
+            return -7;
+        }
+        *key_id = subkey_id;
+        *have_key = 1;
+    }
+    
+    // Objects sealed outside a batch carry their own wrapped data key
+    uint8_t data_key[32];
+    const uint8_t *open_key = key;
+    uint8_t slot_len = 0;
+    const uint8_t *slot = find_tlv(tlv, tlv_len, TLV_KEY_SLOT, &slot_len);
+    if (slot && slot_len == LRS_KEY_SLOT_BYTES) {
+        if (unwrap_data_key(key, &hdr, slot, data_key) != 0) {
+            return -8;
+        }
+        open_key = data_key;
+    }
+    
+    unsigned long long plen = 0;
+    int open_result = crypto_aead_xchacha20poly1305_ietf_decrypt(
+            pt, &plen, NULL, tlv + tlv_len, item->len - sizeof(hdr) - tlv_len,
+            item->aad, item->aad_len, hdr.nonce, open_key);
+    sodium_memzero(data_key, sizeof data_key);
+    if (open_result != 0) {
+        return -8; // auth fail => no output
+    }
+    
+    *pt_len = (size_t)plen;
+    return 0;
+}
+
+static void open_items(void *arg, size_t task) {
+    blob_batch_t *batch = (blob_batch_t*)arg;
+    size_t end = (task + 1) * LRS_BATCH_ITEMS_PER_TASK;
+    if (end > batch->count) end = batch->count;
+    
+    uint8_t key[32];
+    uint64_t key_id = 0;
+    int have_key = 0;
+    
+    for (size_t i = task * LRS_BATCH_ITEMS_PER_TASK; i < end; i++) {
+        lrs_batch_result_t *result = &batch->results[i];
+        size_t pt_len = 0;
+        
+        result->status = open_item(batch->session, &batch->items[i], batch->arena + result->offset,
+                                   &pt_len, key, &key_id, &have_key);
+        result->len = result->status == 0 ? pt_len : 0;
+        if (result->status != 0) {
+            __atomic_fetch_add(&batch->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    
+    sodium_memzero(key, sizeof key);
+}
+
+static size_t batch_task_count(size_t count) {
+    return (count + LRS_BATCH_ITEMS_PER_TASK - 1) / LRS_BATCH_ITEMS_PER_TASK;
+}
+
+// Encrypt `count` items under one session subkey into `arena`
+// results[i] gives the offset, length and status of item i's blob.
+// Returns the number of failed items, or -1 for invalid arguments and -5 if
+// the arena is smaller than lrs_batch_encrypted_size()
+int encrypt_blob_batch(lrs_session_t *session, const lrs_batch_item_t *items, size_t count,
+                     uint8_t *arena, size_t arena_size, lrs_batch_result_t *results, unsigned threads) {
+    if (!session || !session->master_key || (count > 0 && (!items || !arena || !results))) {
+        return -1;
+    }
+    if (count == 0) return 0;
+    
+    // One header, TLV section and subkey for the whole batch
+    header_t header;
+    uint8_t tlv_buffer[LRS_TLV_MAX] = {0};
+    size_t tlv_len = init_header(&header, VERSION, session, KEY_MODE_SESSION, NULL, 0,
+                                 tlv_buffer, sizeof(tlv_buffer));
+    
+    // Lay the items out back to back
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t size = sizeof(header_t) + tlv_len + items[i].len + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+        if (!items[i].data && items[i].len > 0) {
+            return -1;
+        }
+        if (size > arena_size - offset) {
+            return -5;
+        }
+        results[i].offset = offset;
+        offset += size;
+    }
+    
+    uint8_t key[32];
+    if (derive_container_key(session, KEY_MODE_SESSION, &header, tlv_buffer, tlv_len, 0, key) != 0) {
+        return -1;
+    }
+    
+    blob_batch_t batch = {
+        .session = session, .items = items, .count = count, .arena = arena, .results = results,
+        .header = &header, .tlv = tlv_buffer, .tlv_len = tlv_len, .key = key,
+    };
+    lrs_parallel_for(threads, batch_task_count(count), seal_items, &batch);
+    
+    sodium_memzero(key, sizeof key);
+    return (int)batch.failed;
+}
+
+// Decrypt `count` serialized session blobs into `arena`
+// Items may come from different batches of the same session; the subkey is only
+// re-derived where consecutive items differ. Returns the number of failed items,
+// or -1 for invalid arguments and -5 if the arena is smaller than
+// lrs_batch_decrypted_size()
+int decrypt_blob_batch(lrs_session_t *session, const lrs_batch_item_t *items, size_t count,
+                     uint8_t *arena, size_t arena_size, lrs_batch_result_t *results, unsigned threads) {
+    if (!session || !session->master_key || (count > 0 && (!items || !arena || !results))) {
+        return -1;
+    }
+    if (count == 0) return 0;
+    
+    size_t overhead = sizeof(header_t) + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t size = items[i].len > overhead ? items[i].len - overhead : 0;
+        if (size > arena_size - offset) {
+            return -5;
+        }
+        results[i].offset = offset;
+        offset += size;
+    }
+    
+    blob_batch_t batch = {
+        .session = session, .items = items, .count = count, .arena = arena, .results = results,
+    };
+    lrs_parallel_for(threads, batch_task_count(count), open_items, &batch);
+    
+    return (int)batch.failed;
+}
+
+// Outputs go to a temporary file next to the destination, renamed over it only
+// once complete: a wrong key, tampered input or full disk leaves an existing
+// file as it was. The temporary file takes the mode of the file it replaces.
+// Returns a descriptor and the temporary path (free with finish_output), or -1
+static int open_temp_output(const char *path, char **temp_path) {
+    size_t length = strlen(path) + sizeof(".12345678.tmp");
+    char *temp = (char*)lrs_alloc(length);
+    if (!temp) return -1;
+    
+    struct stat st;
+    int existing = stat(path, &st) == 0 && S_ISREG(st.st_mode);
+    int fd = -1;
+    for (int attempt = 0; attempt < 16 && fd < 0; attempt++) {
+        uint32_t suffix;
+        randombytes_buf(&suffix, sizeof suffix);
+        snprintf(temp, length, "%s.%08x.tmp", path, suffix);
+        fd = open(temp, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (fd < 0 && errno != EEXIST) break;
+    }
+    if (fd < 0) {
+        lrs_free(temp);
+        return -1;
+    }
+    if (existing) {
+        fchmod(fd, st.st_mode & 07777);
+    }
+    
+    *temp_path = temp;
+    return fd;
+}
+
+// Move a finished temporary output into place, or discard it on failure
+// Returns result, or -1 if the rename fails
+static int finish_output(const char *path, char *temp_path, int result) {
+    if (!temp_path) return result;
+    
+    if (result == 0 && rename(temp_path, path) != 0) {
+        result = -1;
+    }
+    if (result != 0) {
+        unlink(temp_path);
+    }
+    lrs_free(temp_path);
+    
+    return result;
+}
+
+// Open an output stream through a temporary file; outputs that exist but are
+// not regular files (pipes, devices) are written directly, with *temp_path NULL
+static FILE *open_output(const char *path, char **temp_path) {
+    struct stat st;
+    *temp_path = NULL;
+    if (stat(path, &st) == 0 && !S_ISREG(st.st_mode)) {
+        return fopen(path, "wb");
+    }
+    
+    int fd = open_temp_output(path, temp_path);
+    if (fd < 0) return NULL;
+    FILE *out = fdopen(fd, "wb");
+    if (!out) {
+        close(fd);
+        finish_output(path, *temp_path, -1);
+        *temp_path = NULL;
+    }
+    return out;
+}
+
+// Whether two paths name the same existing file
+static int same_file(const char *a, const char *b) {
+    struct stat st_a, st_b;
+    return stat(a, &st_a) == 0 && stat(b, &st_b) == 0 &&
+           st_a.st_dev == st_b.st_dev && st_a.st_ino == st_b.st_ino;
+}
+
+// Create a temporary output for `path` with `size` bytes reserved on disk and
+// map it for writing; *temp_path is set as by open_temp_output
+static uint8_t *map_output(const char *path, size_t size, char **temp_path) {
+    *temp_path = NULL;
+    int fd = open_temp_output(path, temp_path);
+    if (fd < 0) return NULL;
+    
+    // Reserve the blocks up front; fall back to a sparse file where unsupported
+    int alloc_result = posix_fallocate(fd, 0, (off_t)size);
+    if (alloc_result == EINVAL || alloc_result == EOPNOTSUPP) {
+        alloc_result = ftruncate(fd, (off_t)size) == 0 ? 0 : errno;
+    }
+    if (alloc_result != 0) {
+        close(fd);
+        return NULL;
+    }
+    
+    uint8_t *map = (uint8_t*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file referenced
+    
+    return map == MAP_FAILED ? NULL : map;
+}
+
+// Map a non-empty regular file read-only; NULL means use the stdio path instead
+static uint8_t *map_input(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+    
+    uint8_t *map = (uint8_t*)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+    
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    *size = (size_t)st.st_size;
+    
+    return map;
+}
+
+// Output paths that exist but are not regular files (pipes, devices) can't be mapped
+static int output_mappable(const char *path) {
+    struct stat st;
+    return stat(path, &st) != 0 || S_ISREG(st.st_mode);
+}
+
+// Encrypt between two mappings with no intermediate buffers
+// Returns LRS_MMAP_FALLBACK when the files can't be mapped
+static int encrypt_file_mmap(const char *input_file, const char *output_file,
+                             const void *key_material, int key_mode,
+                             const uint8_t *aad, size_t aad_len, unsigned threads) {
+    if (!output_mappable(output_file)) return LRS_MMAP_FALLBACK;
+    
+    size_t pt_len = 0;
+    uint8_t *in_map = map_input(input_file, &pt_len);
+    if (!in_map) return LRS_MMAP_FALLBACK;
+    
+    // Build header and TLV section
+    header_t header;
+    uint8_t tlv_buffer[LRS_TLV_MAX] = {0};
+    uint32_t chunk_size = LRS_CHUNK_SIZE_DEFAULT;
+    size_t root_offset = 0;
+    size_t tlv_len = init_stream_header(&header, key_material, key_mode, aad, aad_len, chunk_size,
+                                        tlv_buffer, sizeof(tlv_buffer), &root_offset);
+    
+    // Derive key based on mode, faulting in the input meanwhile
+    io_helper_t helper;
+    map_range_t input = { in_map, pt_len };
+    prefetch_mapping_begin(&helper, &input, kdf_is_slow(key_mode, tlv_buffer, tlv_len));
+    uint8_t key[32];
+    int kdf_result = seal_container_key(key_material, key_mode, &header, tlv_buffer, &tlv_len,
+                                        sizeof(tlv_buffer), 1, key);
+    io_helper_finish(&helper);
+    if (kdf_result != 0) {
+        munmap(in_map, pt_len);
+        return kdf_result == -11 ? -11 : -1;
+    }
+    
+    // The container size is known up front, so the output is preallocated
+    size_t chunk_count = (pt_len + chunk_size - 1) / chunk_size;
+    size_t data_offset = sizeof(header) + tlv_len;
+    size_t out_len = data_offset + pt_len + chunk_count * crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    
+    char *temp_path;
+    uint8_t *out_map = map_output(output_file, out_len, &temp_path);
+    if (!out_map) {
+        sodium_memzero(key, sizeof key);
+        munmap(in_map, pt_len);
+        return finish_output(output_file, temp_path, -1);
+    }
+    
+    memcpy(out_map, &header, sizeof(header));
+    memcpy(out_map + sizeof(header), tlv_buffer, tlv_len);
+    
+    // Seal every chunk straight from the input mapping into the output mapping
+    chunk_batch_t batch = {
+        .key = key, .base_nonce = header.nonce, .aad = aad, .aad_len = aad_len,
+        .plaintext = in_map, .ciphertext = out_map + data_offset, .chunk_size = chunk_size,
+        .chunk_count = chunk_count, .last_len = pt_len - (chunk_count - 1) * chunk_size,
+        .final = 1,
+    };
+    lrs_parallel_for(threads, chunk_count, seal_chunk, &batch);
+    
+    int result = batch.failed ? -2 : 0;
+    if (result == 0 && root_offset) {
+        lrs_merkle_t tree;
+        uint8_t root[LRS_MERKLE_HASH_BYTES];
+        lrs_merkle_init(&tree);
+        size_t sealed_size = (size_t)chunk_size + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+        merkle_add_chunks(&tree, out_map + data_offset, sealed_size, 0, chunk_count,
+                          batch.last_len + crypto_aead_xchacha20poly1305_ietf_ABYTES);
+        lrs_merkle_final(&tree, root);
+        seal_chunk_root(key, &header, root, out_map + sizeof(header) + root_offset);
+    }
+    
+    // Always zero out the key immediately after use
+    sodium_memzero(key, sizeof key);
+    if (munmap(out_map, out_len) != 0 && result == 0) {
+        result = -1;
+    }
+    munmap(in_map, pt_len);
+    
+    return finish_output(output_file, temp_path, result);
+}
+
+// Encrypt a file with any key mode into the chunked (v3) format
+// Regular files are processed through memory mappings; anything else is streamed
+int encrypt_file_ex(const char *input_file, const char *output_file,
+                    const void *key_material, int key_mode,
+                    const uint8_t *aad, size_t aad_len, unsigned threads) {
+    if (!input_file || !output_file || !key_material) return -1;
+    if (same_file(input_file, output_file)) return -1; // Would read what it is overwriting
+    
+    int result = encrypt_file_mmap(input_file, output_file, key_material, key_mode,
+                                   aad, aad_len, threads);
+    if (result != LRS_MMAP_FALLBACK) {
+        return result;
+    }
     
     // Open input file
     FILE *in = fopen(input_file, "rb");
     if (!in) return -1;
     
-    // Get file size
-    fseek(in, 0, SEEK_END);
-    long file_size = ftell(in);
-    fseek(in, 0, SEEK_SET);
-    
-    if (file_size < (long)sizeof(header_t)) {
+    // Open output file
+    char *temp_path;
+    FILE *out = open_output(output_file, &temp_path);
+    if (!out) {
         fclose(in);
+        return -1;
+    }
+    
+    result = encrypt_stream(in, out, key_material, key_mode,
+                            aad, aad_len, LRS_CHUNK_SIZE_DEFAULT, threads);
+    
+    fclose(in);
+    if (fclose(out) != 0 && result == 0) {
+        result = -1;
+    }
+    
+    // Don't leave a truncated container behind
+    return finish_output(output_file, temp_path, result);
+}
+
+// Encrypt a file into the chunked (v3) format
+int encrypt_file(const char *input_file, const char *output_file, const char *password, const char *paths) {
+    if (!input_file || !output_file || !password) return -1;
+    
+    // Handle paths/AAD consistently - NULL and empty string are treated the same
+    const uint8_t *aad = NULL;
+    size_t aad_len = 0;
+    if (paths != NULL && paths[0] != '\0') {
+        aad = (const uint8_t*)paths;
+        aad_len = strlen(paths);
+    }
+    
+    return encrypt_file_ex(input_file, output_file, password, KEY_MODE_PASSWORD,
+                           aad, aad_len, 0) == 0 ? 0 : -1;
+}
+
+// Decrypt between two mappings with no intermediate buffers
+// Returns LRS_MMAP_FALLBACK when the files can't be mapped
+static int decrypt_file_mmap(const char *input_file, const char *output_file,
+                             const void *key_material, int key_mode,
+                             const uint8_t *aad, size_t aad_len, unsigned threads) {
+    if (!output_mappable(output_file)) return LRS_MMAP_FALLBACK;
+    
+    size_t file_size = 0;
+    uint8_t *in_map = map_input(input_file, &file_size);
+    if (!in_map) return LRS_MMAP_FALLBACK;
+    
+    // Extract and validate the header
+    header_t header;
+    if (file_size < sizeof(header)) {
+        munmap(in_map, file_size);
         return -1; // File too small to contain header
     }
+    memcpy(&header, in_map, sizeof(header));
+    
+    int result = check_header(&header);
+    if (result != 0) {
+        munmap(in_map, file_size);
+        return result;
+    }
+    
+    // Locate TLV data and payload
+    size_t tlv_len = header_layout(&header) >= 2 ? ntohs(header.tlv_len) : 0;
+    size_t data_offset = sizeof(header) + tlv_len;
+    if (data_offset > file_size) {
+        munmap(in_map, file_size);
+        return -1;
+    }
+    const uint8_t *tlv_data = tlv_len ? in_map + sizeof(header) : NULL;
+    size_t data_len = file_size - data_offset;
+    
+    // Work out the plaintext size from the container layout
+    uint32_t chunk_size = 0;
+    size_t chunk_count = 1;
+    size_t pt_len = 0;
+    if (header_layout(&header) == VERSION_STREAM) {
+        chunk_size = tlv_chunk_size(tlv_data, tlv_len);
+        if (chunk_size == 0) {
+            munmap(in_map, file_size);
+            return -9; // Missing or invalid chunk layout
+        }
+        size_t sealed_size = (size_t)chunk_size + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+        chunk_count = (data_len + sealed_size - 1) / sealed_size;
+    }
+    if (data_len < chunk_count * crypto_aead_xchacha20poly1305_ietf_ABYTES ||
+        (chunk_count > 0 && data_len - (chunk_count - 1) *
+            ((size_t)chunk_size + crypto_aead_xchacha20poly1305_ietf_ABYTES) <
+            crypto_aead_xchacha20poly1305_ietf_ABYTES)) {
+        munmap(in_map, file_size);
+        return -8; // Truncated
+    }
+    pt_len = data_len - chunk_count * crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    
+    // Empty payloads have nothing to map
+    if (chunk_count == 0 || pt_len == 0) {
+        munmap(in_map, file_size);
+        return LRS_MMAP_FALLBACK;
+    }
+    
+    // Derive the key before touching the output, so a wrong key leaves it alone;
+    // the payload is faulted in meanwhile
+    io_helper_t helper;
+    map_range_t payload = { in_map + data_offset, data_len };
+    prefetch_mapping_begin(&helper, &payload, kdf_is_slow(key_mode, tlv_data, tlv_len));
+    uint8_t key[32];
+    int kdf_result = derive_checked_key(key_material, key_mode, &header, tlv_data, tlv_len, key);
+    io_helper_finish(&helper);
+    if (kdf_result != 0) {
+        munmap(in_map, file_size);
+        return kdf_error(kdf_result);
+    }
+    
+    char *temp_path;
+    uint8_t *out_map = map_output(output_file, pt_len, &temp_path);
+    if (!out_map) {
+        sodium_memzero(key, sizeof key);
+        munmap(in_map, file_size);
+        return finish_output(output_file, temp_path, -1);
+    }
+    
+    if (header_layout(&header) == VERSION_STREAM) {
+        // Open every chunk straight from the input mapping into the output mapping
+        chunk_batch_t batch = {
+            .key = key, .base_nonce = header.nonce, .aad = aad, .aad_len = aad_len,
+            .plaintext = out_map, .ciphertext = in_map + data_offset, .chunk_size = chunk_size,
+            .chunk_count = chunk_count,
+            .last_len = data_len - (chunk_count - 1) *
+                        ((size_t)chunk_size + crypto_aead_xchacha20poly1305_ietf_ABYTES),
+            .final = 1,
+        };
+        lrs_parallel_for(threads, chunk_count, open_chunk, &batch);
+        result = batch.failed ? -8 : 0;
+    } else {
+        size_t out_pt_len = 0;
+        result = open_blob(in_map + data_offset, data_len, key, aad, aad_len, header.nonce,
+                           out_map, &out_pt_len);
+    }
+    
+    // Always zero out the key immediately after use
+    sodium_memzero(key, sizeof key);
+    
+    if (munmap(out_map, pt_len) != 0 && result == 0) {
+        result = -1;
+    }
+    munmap(in_map, file_size);
+    
+    // No partial plaintext is left behind on failure
+    return finish_output(output_file, temp_path, result);
+}
+
+// Decrypt a file with any key mode (chunked v3 or single-blob v1/v2)
+// Regular files are processed through memory mappings; anything else is streamed
+int decrypt_file_ex(const char *input_file, const char *output_file,
+                    const void *key_material, int key_mode,
+                    const uint8_t *aad, size_t aad_len, unsigned threads) {
+    if (!input_file || !output_file || !key_material) return -1;
+    if (same_file(input_file, output_file)) return -1; // Would read what it is overwriting
+    
+    int mmap_result = decrypt_file_mmap(input_file, output_file, key_material, key_mode,
+                                        aad, aad_len, threads);
+    if (mmap_result != LRS_MMAP_FALLBACK) {
+        return mmap_result;
+    }
+    
+    // Open input file
+    FILE *in = fopen(input_file, "rb");
+    if (!in) return -1;
     
     // Read header
     header_t header;
     if (fread(&header, sizeof(header), 1, in) != 1) {
         fclose(in);
-        return -1;
+        return -1; // File too small to contain header
     }
     
     // Verify header magic and version
     if (memcmp(header.magic, MAGIC, 3) != 0 || 
-        (header.version != VERSION && header.version != 1)) {
+        (header_layout(&header) != VERSION && header.version != 1 && header_layout(&header) != VERSION_STREAM)) {
         fclose(in);
         return -1; // Invalid header
     }
@@ -671,93 +2634,815 @@ int decrypt_file(const char *input_file, const char *output_file, const char *pa
     // Get TLV length from header if version 2+
     size_t tlv_len = 0;
     uint8_t *tlv_data = NULL;
-    if (header.version >= 2) {
+    if (header_layout(&header) >= 2) {
         tlv_len = ntohs(header.tlv_len);
         
         // Read TLV data if present
         if (tlv_len > 0) {
-            tlv_data = (uint8_t*)malloc(tlv_len);
+            tlv_data = (uint8_t*)lrs_alloc(tlv_len);
             if (!tlv_data) {
                 fclose(in);
                 return -1;
             }
             
             if (fread(tlv_data, 1, tlv_len, in) != tlv_len) {
-                free(tlv_data);
+                lrs_free(tlv_data);
                 fclose(in);
                 return -1;
             }
         }
     }
     
-    // Calculate ciphertext size
-    size_t ct_len = file_size - sizeof(header) - tlv_len;
-    uint8_t *ciphertext = (uint8_t*)malloc(ct_len);
-    if (!ciphertext) {
-        if (tlv_data) free(tlv_data);
+    // Chunked (v3) payloads are streamed through a bounded buffer
+    if (header_layout(&header) == VERSION_STREAM) {
+        char *temp_path;
+        FILE *out = open_output(output_file, &temp_path);
+        if (!out) {
+            lrs_free(tlv_data);
+            fclose(in);
+            return -1;
+        }
+        
+        int result = decrypt_chunks(in, out, &header, tlv_data, tlv_len,
+                                    key_material, key_mode, aad, aad_len, threads);
+        
         fclose(in);
-        return -1;
+        lrs_free(tlv_data);
+        if (fclose(out) != 0 && result == 0) {
+            result = -1;
+        }
+        
+        // No partial plaintext is left behind on failure
+        return finish_output(output_file, temp_path, result);
     }
     
-    // Read ciphertext
-    if (fread(ciphertext, 1, ct_len, in) != ct_len) {
+    // Single-blob payloads are read whole; get the ciphertext size
+    long data_start = ftell(in);
+    fseek(in, 0, SEEK_END);
+    long file_size = ftell(in);
+    if (data_start < 0 || file_size < data_start || fseek(in, data_start, SEEK_SET) != 0) {
+        lrs_free(tlv_data);
         fclose(in);
-        free(ciphertext);
-        if (tlv_data) free(tlv_data);
         return -1;
     }
     
-    fclose(in);
+    // Calculate ciphertext size
+    size_t ct_len = (size_t)(file_size - data_start);
     
+    // With a key slot or check value a wrong key is caught before anything is
+    // reserved, allocated or read; without one the read overlaps the key derivation
+    uint8_t key[32];
+    uint8_t check_len = 0;
+    int key_ready = tlv_data && (find_tlv(tlv_data, tlv_len, TLV_KEY_CHECK, &check_len) != NULL ||
+                                 find_tlv(tlv_data, tlv_len, TLV_KEY_SLOT, &check_len) != NULL);
+    if (key_ready) {
+        int result = check_header(&header);
+        int kdf_result = result == 0 ?
+            derive_checked_key(key_material, key_mode, &header, tlv_data, tlv_len, key) : 0;
+        if (result != 0 || kdf_result != 0) {
+            lrs_free(tlv_data);
+            fclose(in);
+            return result != 0 ? result : kdf_error(kdf_result);
+        }
+    }
+    
+    // Both whole-file buffers count against the memory budget
+    if (lrs_memory_reserve(2 * ct_len) != 0) {
+        if (key_ready) sodium_memzero(key, sizeof key);
+        lrs_free(tlv_data);
+        fclose(in);
+        return -11; // Memory budget exhausted
+    }
+    
+    uint8_t *ciphertext = (uint8_t*)lrs_alloc(ct_len);
     // Allocate memory for plaintext (will be smaller than ciphertext)
-    uint8_t *plaintext = (uint8_t*)malloc(ct_len);
-    if (!plaintext) {
-        free(ciphertext);
-        if (tlv_data) free(tlv_data);
+    uint8_t *plaintext = (uint8_t*)lrs_alloc(ct_len);
+    if (!ciphertext || !plaintext) {
+        if (key_ready) sodium_memzero(key, sizeof key);
+        lrs_free(ciphertext);
+        lrs_free(plaintext);
+        lrs_memory_release(2 * ct_len);
+        lrs_free(tlv_data);
+        fclose(in);
         return -1;
     }
     
-    // Decrypt the ciphertext
-    // Handle paths/AAD consistently - NULL and empty string are treated the same
-    const uint8_t *aad = NULL;
-    size_t aad_len = 0;
-    if (paths != NULL && paths[0] != '\0') {
-        aad = (const uint8_t*)paths;
-        aad_len = strlen(paths);
+    int result = 0;
+    if (key_ready) {
+        if (fread(ciphertext, 1, ct_len, in) != ct_len) {
+            result = -1;
+        }
+    } else if ((result = check_header(&header)) == 0) {
+        // Read ciphertext, on a helper thread while a password key is derived
+        whole_read_t reader = { in, ciphertext, ct_len, 0 };
+        io_helper_t helper = {0};
+        if (!kdf_is_slow(key_mode, tlv_data, tlv_len) ||
+            !io_helper_start(&helper, read_whole, &reader)) {
+            reader.bytes_read = fread(ciphertext, 1, ct_len, in);
+        }
+        int kdf_result = derive_checked_key(key_material, key_mode, &header, tlv_data, tlv_len, key);
+        io_helper_finish(&helper);
+        
+        if (kdf_result != 0) {
+            result = kdf_error(kdf_result);
+        } else if (reader.bytes_read != ct_len) {
+            result = -1;
+        }
     }
     
+    fclose(in);
+    
+    // Decrypt the ciphertext
     size_t pt_len;
-    int result = decrypt_blob_ex(ciphertext, ct_len,
-                             password, KEY_MODE_PASSWORD,
-                             aad, aad_len,
-                             &header, tlv_data, tlv_len, plaintext, &pt_len);
+    if (result == 0) {
+        result = open_blob(ciphertext, ct_len, key, aad, aad_len, header.nonce, plaintext, &pt_len);
+    }
+    sodium_memzero(key, sizeof key);
     
-    free(ciphertext);
-    if (tlv_data) free(tlv_data);
+    lrs_free(ciphertext);
+    lrs_free(tlv_data);
     
     if (result != 0) {
         // On decryption failure, zero out the plaintext buffer
         sodium_memzero(plaintext, ct_len);
-        free(plaintext);
+        lrs_free(plaintext);
+        lrs_memory_release(2 * ct_len);
         return result; // Decryption failed
     }
     
     // Open output file
-    FILE *out = fopen(output_file, "wb");
+    char *temp_path;
+    FILE *out = open_output(output_file, &temp_path);
     if (!out) {
-        free(plaintext);
+        lrs_free(plaintext);
+        lrs_memory_release(2 * ct_len);
         return -1;
     }
     
     // Write plaintext
-    if (fwrite(plaintext, 1, pt_len, out) != pt_len) {
-        fclose(out);
-        free(plaintext);
+    result = fwrite(plaintext, 1, pt_len, out) == pt_len ? 0 : -1;
+    if (fclose(out) != 0) {
+        result = -1;
+    }
+    lrs_free(plaintext);
+    lrs_memory_release(2 * ct_len);
+    
+    return finish_output(output_file, temp_path, result);
+}
+
+// Decrypt a file (chunked v3 or single-blob v1/v2)
+int decrypt_file(const char *input_file, const char *output_file, const char *password, const char *paths) {
+    if (!input_file || !output_file || !password) return -1;
+    
+    // Handle paths/AAD consistently - NULL and empty string are treated the same
+    const uint8_t *aad = NULL;
+    size_t aad_len = 0;
+    if (paths != NULL && paths[0] != '\0') {
+        aad = (const uint8_t*)paths;
+        aad_len = strlen(paths);
+    }
+    
+    return decrypt_file_ex(input_file, output_file, password, KEY_MODE_PASSWORD,
+                           aad, aad_len, 0);
+}
+
+// Random access
+// A v3 container needs no stored index: chunk i starts at a fixed offset, its
+// nonce binds i, and only the last chunk opens with the final flag. Opening a
+// handle authenticates that last chunk, which pins the plaintext length, and a
+// read then opens just the chunks covering its range (one chunk is cached, so
+// small sequential reads open each chunk once).
+struct lrs_file {
+    int fd;
+    uint8_t *key;                 // Secure allocation, wiped on close
+    uint8_t nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
+    uint8_t *aad;
+    size_t aad_len;
+    uint32_t chunk_size;
+    uint64_t chunk_count;
+    uint64_t data_offset;
+    uint64_t size;                // Plaintext bytes
+    uint8_t *sealed;              // One sealed chunk
+    uint8_t *chunk;               // Plaintext of chunk cached_index
+    uint64_t cached_index;        // UINT64_MAX when nothing is cached
+    size_t buffers_size;          // Reserved against the memory governor
+    const lrs_allocator_t *allocator; // The opener's: closing may happen on another thread
+    pthread_mutex_t lock;
+};
+
+// Read exactly len bytes at offset
+static int pread_full(int fd, uint8_t *buf, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t got = pread(fd, buf, len, (off_t)offset);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return -1;
+        buf += got;
+        len -= (size_t)got;
+        offset += (uint64_t)got;
+    }
+    return 0;
+}
+
+// Open chunk `index` into `out` (chunk_size bytes, or less for the last chunk)
+static int open_file_chunk(lrs_file_t *file, uint64_t index, uint8_t *out) {
+    size_t sealed_size = (size_t)file->chunk_size + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    int final = index == file->chunk_count - 1;
+    size_t len = final ? (size_t)(file->size - index * file->chunk_size) +
+                         crypto_aead_xchacha20poly1305_ietf_ABYTES : sealed_size;
+    
+    if (pread_full(file->fd, file->sealed, len, file->data_offset + index * sealed_size) != 0) {
         return -1;
     }
     
-    fclose(out);
-    free(plaintext);
+    uint8_t nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
+    chunk_nonce(file->nonce, index, final, nonce);
+    if (crypto_aead_xchacha20poly1305_ietf_decrypt(out, NULL, NULL, file->sealed, len,
+                                                   file->aad, file->aad_len, nonce, file->key) != 0) {
+        return -8;
+    }
+    return 0;
+}
+
+static void file_release(lrs_file_t *file) {
+    const lrs_allocator_t *allocator = file->allocator;
+    
+    if (file->key) {
+        sodium_memzero(file->key, 32);
+        allocator->secure_free(allocator->ctx, file->key);
+    }
+    if (file->chunk) {
+        sodium_memzero(file->chunk, file->chunk_size);
+        allocator->free(allocator->ctx, file->chunk);
+    }
+    if (file->sealed) {
+        allocator->free(allocator->ctx, file->sealed);
+    }
+    if (file->buffers_size) {
+        lrs_memory_release(file->buffers_size);
+    }
+    if (file->aad) {
+        sodium_memzero(file->aad, file->aad_len);
+        allocator->free(allocator->ctx, file->aad);
+    }
+    if (file->fd >= 0) {
+        close(file->fd);
+    }
+    pthread_mutex_destroy(&file->lock);
+    allocator->free(allocator->ctx, file);
+}
+
+// Open a chunked (v3) container for random-access reads
+// Returns 0 and sets *out, or a decrypt_file_ex error code (-2 for other versions)
+int lrs_open(lrs_file_t **out, const char *path, const void *key_material, int key_mode,
+             const uint8_t *aad, size_t aad_len) {
+    if (!out || !path || !key_material || (aad_len && !aad)) return -1;
+    *out = NULL;
+    
+    const lrs_allocator_t *allocator = lrs_current_allocator();
+    lrs_file_t *file = (lrs_file_t*)allocator->alloc(allocator->ctx, sizeof(lrs_file_t));
+    if (!file) return -1;
+    memset(file, 0, sizeof(*file));
+    file->allocator = allocator;
+    file->cached_index = UINT64_MAX;
+    pthread_mutex_init(&file->lock, NULL);
+    file->fd = open(path, O_RDONLY | O_CLOEXEC);
+    
+    // Header and TLV section
+    header_t header;
+    uint8_t *tlv_data = NULL;
+    size_t tlv_len = 0;
+    struct stat st;
+    int result = file->fd >= 0 && fstat(file->fd, &st) == 0 &&
+                 pread_full(file->fd, (uint8_t*)&header, sizeof(header), 0) == 0 ? 0 : -1;
+    if (result == 0) result = check_header(&header);
+    if (result == 0 && header_layout(&header) != VERSION_STREAM) result = -2; // Only chunked containers seek
+    if (result == 0) {
+        tlv_len = ntohs(header.tlv_len);
+        tlv_data = (uint8_t*)lrs_alloc(tlv_len ? tlv_len : 1);
+        result = tlv_data ? pread_full(file->fd, tlv_data, tlv_len, sizeof(header)) : -1;
+    }
+    if (result == 0) {
+        file->chunk_size = tlv_chunk_size(tlv_data, tlv_len);
+        if (file->chunk_size == 0) result = -9; // Missing or invalid chunk layout
+    }
+    
+    // Layout: every chunk but the last is full, the last holds at least its tag
+    size_t sealed_size = (size_t)file->chunk_size + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    if (result == 0) {
+        file->data_offset = sizeof(header) + tlv_len;
+        uint64_t data_len = (uint64_t)st.st_size > file->data_offset ? (uint64_t)st.st_size - file->data_offset : 0;
+        file->chunk_count = (data_len + sealed_size - 1) / sealed_size;
+        if (file->chunk_count == 0 ||
+            data_len - (file->chunk_count - 1) * sealed_size < crypto_aead_xchacha20poly1305_ietf_ABYTES) {
+            result = -8; // Truncated
+        } else {
+            file->size = data_len - file->chunk_count * crypto_aead_xchacha20poly1305_ietf_ABYTES;
+        }
+    }
+    
+    // Key first: the chunk buffers are not held while the KDF waits for its memory
+    if (result == 0) {
+        file->key = (uint8_t*)allocator->secure_alloc(allocator->ctx, 32);
+        int kdf_result = file->key ?
+            derive_checked_key(key_material, key_mode, &header, tlv_data, tlv_len, file->key) : -1;
+        if (kdf_result != 0) result = file->key ? kdf_error(kdf_result) : -1;
+    }
+    
+    // A recorded chunk root must carry a valid MAC
+    if (result == 0) {
+        uint8_t root[LRS_MERKLE_HASH_BYTES];
+        if (read_chunk_root(file->key, &header, tlv_data, tlv_len, root) < 0) result = -8;
+    }
+    
+    // Buffers for one chunk
+    if (result == 0) {
+        if (lrs_memory_reserve(file->chunk_size + sealed_size) != 0) {
+            result = -11; // Memory budget exhausted
+        } else {
+            file->buffers_size = file->chunk_size + sealed_size;
+            file->sealed = (uint8_t*)allocator->alloc(allocator->ctx, sealed_size);
+            file->chunk = (uint8_t*)allocator->alloc(allocator->ctx, file->chunk_size);
+            file->aad = (uint8_t*)allocator->alloc(allocator->ctx, aad_len ? aad_len : 1);
+            if (!file->sealed || !file->chunk || !file->aad) result = -1;
+        }
+    }
+    
+    // The final chunk authenticates the length; keep it cached
+    if (result == 0) {
+        memcpy(file->nonce, header.nonce, sizeof(file->nonce));
+        memcpy(file->aad, aad, aad_len);
+        file->aad_len = aad_len;
+        result = open_file_chunk(file, file->chunk_count - 1, file->chunk);
+        if (result == 0) file->cached_index = file->chunk_count - 1;
+    }
+    lrs_free(tlv_data);
+    
+    if (result != 0) {
+        file_release(file);
+        return result;
+    }
+    *out = file;
+    return 0;
+}
+
+// Plaintext size of an open container
+uint64_t lrs_file_size(const lrs_file_t *file) {
+    return file ? file->size : 0;
+}
+
+// Read up to len plaintext bytes at offset, opening only the chunks that cover them
+// Returns the number of bytes read (0 at or past the end), -1 on I/O errors or
+// -8 if a chunk fails authentication (buf is then wiped)
+ssize_t lrs_pread(lrs_file_t *file, void *buf, size_t len, uint64_t offset) {
+    if (!file || (len && !buf)) return -1;
+    if (offset >= file->size || len == 0) return 0;
+    if (len > file->size - offset) len = (size_t)(file->size - offset);
+    if (len > SSIZE_MAX) len = SSIZE_MAX;
+    
+    uint8_t *dst = (uint8_t*)buf;
+    size_t done = 0;
+    int result = 0;
+    
+    pthread_mutex_lock(&file->lock);
+    while (done < len) {
+        uint64_t position = offset + done;
+        uint64_t index = position / file->chunk_size;
+        size_t within = (size_t)(position % file->chunk_size);
+        size_t chunk_len = index == file->chunk_count - 1 ?
+                           (size_t)(file->size - index * file->chunk_size) : file->chunk_size;
+        size_t take = chunk_len - within < len - done ? chunk_len - within : len - done;
+        
+        if (index == file->cached_index) {
+            memcpy(dst + done, file->chunk + within, take);
+        } else if (within == 0 && take == chunk_len) {
+            // Whole chunk wanted: open it straight into the caller's buffer
+            result = open_file_chunk(file, index, dst + done);
+        } else {
+            file->cached_index = UINT64_MAX;
+            result = open_file_chunk(file, index, file->chunk);
+            if (result == 0) {
+                file->cached_index = index;
+                memcpy(dst + done, file->chunk + within, take);
+            }
+        }
+        if (result != 0) break;
+        done += take;
+    }
+    pthread_mutex_unlock(&file->lock);
+    
+    if (result != 0) {
+        // No unauthenticated plaintext is handed out
+        sodium_memzero(buf, len);
+        return result;
+    }
+    return (ssize_t)done;
+}
+
+// Wipe the key and cached plaintext and close the file
+void lrs_close(lrs_file_t *file) {
+    if (!file) return;
+    
+    file_release(file);
+}
+
+// Verify-only
+// Scrubbing needs the tags, not the plaintext. The XChaCha20-Poly1305 tag is a
+// Poly1305 MAC over the ciphertext under a one-time key, so it can be computed
+// from the ciphertext as it streams past: nothing is decrypted or written, the
+// buffer is independent of file and chunk size, and the cost is the read plus
+// one Poly1305 pass. Files are read once, sequentially, and dropped from the
+// page cache afterwards so a scrub does not evict the working set.
+
+// Streamed check of one XChaCha20-Poly1305 (IETF) ciphertext, as
+// crypto_aead_xchacha20poly1305_ietf_decrypt computes it
+typedef struct {
+    crypto_onetimeauth_poly1305_state state;
+    uint64_t aad_len;
+    uint64_t ct_len;              // Ciphertext bytes expected (without the tag)
+    uint64_t absorbed;
+} aead_check_t;
+
+static void aead_check_init(aead_check_t *check, const uint8_t key[32],
+                            const uint8_t nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES],
+                            const uint8_t *aad, size_t aad_len, uint64_t ct_len) {
+    static const uint8_t pad[16] = {0};
+    uint8_t subkey[crypto_core_hchacha20_OUTPUTBYTES];
+    uint8_t inner_nonce[crypto_stream_chacha20_ietf_NONCEBYTES] = {0};
+    uint8_t block0[64];
+    
+    crypto_core_hchacha20(subkey, nonce, key, NULL);
+    memcpy(inner_nonce + 4, nonce + crypto_core_hchacha20_INPUTBYTES, 8);
+    crypto_stream_chacha20_ietf(block0, sizeof(block0), inner_nonce, subkey);
+    crypto_onetimeauth_poly1305_init(&check->state, block0);
+    sodium_memzero(block0, sizeof block0);
+    sodium_memzero(subkey, sizeof subkey);
+    
+    crypto_onetimeauth_poly1305_update(&check->state, aad, aad_len);
+    crypto_onetimeauth_poly1305_update(&check->state, pad, (0x10 - aad_len) & 0xf);
+    check->aad_len = aad_len;
+    check->ct_len = ct_len;
+    check->absorbed = 0;
+}
+
+static void aead_check_update(aead_check_t *check, const uint8_t *ct, size_t len) {
+    crypto_onetimeauth_poly1305_update(&check->state, ct, len);
+    check->absorbed += len;
+}
+
+// Returns 0 if the ciphertext matches the tag
+static int aead_check_final(aead_check_t *check, const uint8_t tag[crypto_aead_xchacha20poly1305_ietf_ABYTES]) {
+    static const uint8_t pad[16] = {0};
+    uint8_t lengths[16];
+    uint8_t mac[crypto_onetimeauth_poly1305_BYTES];
+    
+    crypto_onetimeauth_poly1305_update(&check->state, pad, (0x10 - check->ct_len) & 0xf);
+    uint64_t aad_len_le = htole64(check->aad_len);
+    uint64_t ct_len_le = htole64(check->ct_len);
+    memcpy(lengths, &aad_len_le, 8);
+    memcpy(lengths + 8, &ct_len_le, 8);
+    crypto_onetimeauth_poly1305_update(&check->state, lengths, sizeof(lengths));
+    crypto_onetimeauth_poly1305_final(&check->state, mac);
+    
+    int result = check->absorbed == check->ct_len && crypto_verify_16(mac, tag) == 0 ? 0 : -8;
+    sodium_memzero(&check->state, sizeof(check->state));
+    sodium_memzero(mac, sizeof mac);
+    return result;
+}
+
+// One pass over the payload of an open container; `buffer` is any size
+static int verify_payload(int fd, const header_t *hdr, const uint8_t key[32], uint32_t chunk_size,
+                          int has_root, const uint8_t *root, uint64_t data_offset, uint64_t data_len,
+                          const uint8_t *aad, size_t aad_len, uint8_t *buffer, size_t buffer_size) {
+    // Single blobs are one "chunk" covering the whole payload
+    uint64_t sealed_size = chunk_size ? (uint64_t)chunk_size + crypto_aead_xchacha20poly1305_ietf_ABYTES : data_len;
+    uint64_t chunk_count = chunk_size ? (data_len + sealed_size - 1) / sealed_size : 1;
+    if (chunk_count == 0 || data_len - (chunk_count - 1) * sealed_size < crypto_aead_xchacha20poly1305_ietf_ABYTES) {
+        return -8; // Truncated
+    }
+    
+    lrs_merkle_t tree;
+    lrs_merkle_init(&tree);
+    aead_check_t check;
+    uint8_t tag[crypto_aead_xchacha20poly1305_ietf_ABYTES];
+    uint64_t index = 0;
+    uint64_t chunk_pos = 0;       // Bytes of the current chunk consumed
+    uint64_t chunk_len = 0;       // Sealed length of the current chunk
+    uint64_t offset = 0;
+    int result = 0;
+    
+    while (offset < data_len && result == 0) {
+        size_t wanted = data_len - offset < buffer_size ? (size_t)(data_len - offset) : buffer_size;
+        ssize_t got = pread(fd, buffer, wanted, (off_t)(data_offset + offset));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            result = -1;
+            break;
+        }
+        
+        for (size_t pos = 0; pos < (size_t)got && result == 0;) {
+            if (chunk_pos == 0) {
+                int final = index == chunk_count - 1;
+                chunk_len = final ? data_len - index * sealed_size : sealed_size;
+                uint8_t nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
+                if (chunk_size) {
+                    chunk_nonce(hdr->nonce, index, final, nonce);
+                } else {
+                    memcpy(nonce, hdr->nonce, sizeof(nonce));
+                }
+                aead_check_init(&check, key, nonce, aad, aad_len,
+                                chunk_len - crypto_aead_xchacha20poly1305_ietf_ABYTES);
+            }
+            
+            // Ciphertext goes into the MAC, the trailing 16 bytes are the tag
+            uint64_t ct_len = chunk_len - crypto_aead_xchacha20poly1305_ietf_ABYTES;
+            size_t take = (size_t)got - pos < chunk_len - chunk_pos ? (size_t)got - pos : (size_t)(chunk_len - chunk_pos);
+            size_t ct_take = chunk_pos < ct_len ? (size_t)(ct_len - chunk_pos < take ? ct_len - chunk_pos : take) : 0;
+            aead_check_update(&check, buffer + pos, ct_take);
+            if (take > ct_take) {
+                memcpy(tag + (chunk_pos + ct_take - ct_len), buffer + pos + ct_take, take - ct_take);
+            }
+            pos += take;
+            chunk_pos += take;
+            
+            if (chunk_pos == chunk_len) {
+                result = aead_check_final(&check, tag);
+                if (has_root) {
+                    uint8_t leaf[LRS_MERKLE_HASH_BYTES];
+                    lrs_merkle_leaf(index, tag, leaf);
+                    lrs_merkle_add(&tree, leaf);
+                }
+                chunk_pos = 0;
+                index++;
+            }
+        }
+        offset += (uint64_t)got;
+    }
+    
+    if (result == 0 && has_root) {
+        uint8_t computed[LRS_MERKLE_HASH_BYTES];
+        lrs_merkle_final(&tree, computed);
+        if (sodium_memcmp(computed, root, sizeof(computed)) != 0) result = -8;
+    }
+    return result;
+}
+
+// Verify one container; the read buffer is reserved only once the key is
+// derived, so it is never held while the KDF waits for its memory
+static int verify_container(const char *path, const void *key_material, int key_mode,
+                            const uint8_t *aad, size_t aad_len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    
+    struct stat st;
+    header_t header;
+    int result = fstat(fd, &st) == 0 && pread_full(fd, (uint8_t*)&header, sizeof(header), 0) == 0 ? 0 : -1;
+    if (result == 0) result = check_header(&header);
+    
+    size_t tlv_len = result == 0 && header_layout(&header) >= 2 ? ntohs(header.tlv_len) : 0;
+    uint8_t *tlv_data = result == 0 ? (uint8_t*)lrs_alloc(tlv_len ? tlv_len : 1) : NULL;
+    if (result == 0 && (!tlv_data || pread_full(fd, tlv_data, tlv_len, sizeof(header)) != 0)) result = -1;
+    
+    uint64_t data_offset = sizeof(header) + tlv_len;
+    if (result == 0 && (uint64_t)st.st_size < data_offset + crypto_aead_xchacha20poly1305_ietf_ABYTES) {
+        result = -8; // Truncated
+    }
+    
+    uint32_t chunk_size = 0;
+    if (result == 0 && header_layout(&header) == VERSION_STREAM) {
+        chunk_size = tlv_chunk_size(tlv_data, tlv_len);
+        if (chunk_size == 0) result = -9; // Missing or invalid chunk layout
+    }
+    
+    if (result == 0) {
+        // The kernel reads ahead while a password is stretched
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        if (kdf_is_slow(key_mode, tlv_data, tlv_len)) {
+            posix_fadvise(fd, (off_t)data_offset, LRS_READAHEAD_MAX, POSIX_FADV_WILLNEED);
+        }
+        
+        uint8_t key[32];
+        uint8_t root[LRS_MERKLE_HASH_BYTES];
+        int has_root = 0;
+        int kdf_result = derive_checked_key(key_material, key_mode, &header, tlv_data, tlv_len, key);
+        if (kdf_result != 0) {
+            result = kdf_error(kdf_result);
+        } else if (header_layout(&header) == VERSION_STREAM &&
+                   (has_root = read_chunk_root(key, &header, tlv_data, tlv_len, root)) < 0) {
+            result = has_root;
+        } else if (lrs_memory_reserve(LRS_VERIFY_BUFFER) != 0) {
+            result = -11; // Memory budget exhausted
+        } else {
+            uint8_t *buffer = (uint8_t*)lrs_alloc(LRS_VERIFY_BUFFER);
+            result = buffer ? verify_payload(fd, &header, key, chunk_size, has_root, root, data_offset,
+                                             (uint64_t)st.st_size - data_offset, aad, aad_len,
+                                             buffer, LRS_VERIFY_BUFFER) : -1;
+            lrs_free(buffer);
+            lrs_memory_release(LRS_VERIFY_BUFFER);
+        }
+        sodium_memzero(key, sizeof key);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    
+    lrs_free(tlv_data);
+    close(fd);
+    return result;
+}
+
+// Authenticate a container (any version) without producing plaintext
+// Returns 0 or a decrypt_file_ex error code
+int lrs_verify_file(const char *path, const void *key_material, int key_mode,
+                    const uint8_t *aad, size_t aad_len) {
+    if (!path || !key_material || (aad_len && !aad)) return -1;
+    
+    return verify_container(path, key_material, key_mode, aad, aad_len);
+}
+
+// Files of one lrs_verify_files call
+typedef struct {
+    const char *const *paths;
+    const void *key_material;
+    int key_mode;
+    const uint8_t *aad;
+    size_t aad_len;
+    int *results;
+    size_t failed;
+} verify_job_t;
+
+static void verify_one(void *arg, size_t index) {
+    verify_job_t *job = (verify_job_t*)arg;
+    int result = verify_container(job->paths[index], job->key_material, job->key_mode,
+                                  job->aad, job->aad_len);
+    
+    if (job->results) job->results[index] = result;
+    if (result != 0) __atomic_fetch_add(&job->failed, 1, __ATOMIC_RELAXED);
+}
+
+// Verify many containers on `threads` threads (0 = one per CPU), one file per
+// thread at a time, each through its own LRS_VERIFY_BUFFER
+// Returns the number of files that failed (results[i] holds each code, -11 for
+// a buffer that did not fit the memory budget) or -1 for invalid arguments
+int lrs_verify_files(const char *const *paths, size_t count, const void *key_material, int key_mode,
+                     const uint8_t *aad, size_t aad_len, unsigned threads, int *results) {
+    if ((count && !paths) || !key_material || (aad_len && !aad)) return -1;
+    if (count == 0) return 0;
+    if (threads == 0) threads = lrs_cpu_count();
+    if (threads > count) threads = (unsigned)count;
+    
+    lrs_pool_t *pool = lrs_pool_create(threads);
+    verify_job_t job = {
+        .paths = paths, .key_material = key_material, .key_mode = key_mode, .aad = aad,
+        .aad_len = aad_len, .results = results,
+    };
+    lrs_pool_run(pool, count, verify_one, &job);
+    lrs_pool_destroy(pool);
+    
+    return (int)job.failed;
+}
+
+// Rekey
+// A container's password or key only wraps its data key (TLV_KEY_SLOT), so
+// changing it reads the header and TLV section, unwraps the data key with the
+// old key, wraps it with the new one and writes the same number of bytes back
+// with one pwrite, then syncs: the cost is two key derivations and one small
+// write, whatever the size of the file. The salt is renewed (or set to the new
+// session's), so neither the old key nor its derived key opens the file again.
+
+static int pwrite_full(int fd, const uint8_t *buf, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t written = pwrite(fd, buf, len, (off_t)offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return -1;
+        buf += written;
+        len -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+    return 0;
+}
+
+// Point a header at new key material: a fresh salt and the current KDF
+// parameters, or those of the session, and the key mode in TLV_KEY_MODE
+static int set_header_key(header_t *hdr, uint8_t *tlv, size_t tlv_len, const void *key_material, int key_mode) {
+    const lrs_session_t *session = key_mode == KEY_MODE_SESSION ? (const lrs_session_t*)key_material : NULL;
+    uint8_t length = 0;
+    uint8_t *recorded_mode = (uint8_t*)find_tlv(tlv, tlv_len, TLV_KEY_MODE, &length);
+    if (!recorded_mode || length != 1) return -1;
+    
+    lrs_kdf_params_t params;
+    lrs_get_kdf_params(&params);
+    hdr->kdf_ops = htonl(session ? session->kdf_ops : params.ops);
+    hdr->kdf_mem_limit_kib = htonl(session ? session->kdf_mem_limit_kib : params.mem_limit_kib);
+    hdr->kdf_parallelism = htonl(session ? session->kdf_parallelism : params.parallelism);
+    if (session) {
+        memcpy(hdr->salt, session->salt, sizeof(hdr->salt));
+    } else {
+        randombytes_buf(hdr->salt, sizeof(hdr->salt));
+    }
+    *recorded_mode = (uint8_t)(session ? session->key_mode : key_mode);
+    hdr->version |= VERSION_KEY_SLOT;
+    
+    return 0;
+}
+
+// Rewrap the data key of one container under new key material
+// Returns 0, -1 (I/O, not a container), -2 (unsupported version), -6 (invalid
+// key mode), -7 (KDF failure), -8 (wrong old key), -10 (not an object of the
+// old session), -11 (memory budget) or -12 (no key slot: re-encrypt instead)
+int lrs_rekey(const char *path, const void *old_key_material, int old_key_mode,
+              const void *new_key_material, int new_key_mode) {
+    if (!path || !old_key_material || !new_key_material) return -1;
+    const lrs_session_t *session = new_key_mode == KEY_MODE_SESSION ? (const lrs_session_t*)new_key_material : NULL;
+    if (new_key_mode != KEY_MODE_PASSWORD && new_key_mode != KEY_MODE_RAW_KEY && !(session && session->master_key)) {
+        return -6; // Invalid key mode
+    }
+    
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return -1;
+    
+    // Header and TLV section, as one region to write back
+    header_t header;
+    uint8_t *region = NULL;
+    size_t tlv_len = 0;
+    int result = pread_full(fd, (uint8_t*)&header, sizeof(header), 0) == 0 ? check_header(&header) : -1;
+    if (result == 0 && header_layout(&header) < 2) {
+        result = -12; // No TLV section, so no key slot
+    }
+    if (result == 0) {
+        tlv_len = ntohs(header.tlv_len);
+        region = (uint8_t*)lrs_alloc(sizeof(header) + tlv_len);
+        result = region && pread_full(fd, region + sizeof(header), tlv_len, sizeof(header)) == 0 ? 0 : -1;
+    }
+    uint8_t *tlv = region ? region + sizeof(header) : NULL;
+    uint8_t length = 0;
+    uint8_t *slot = result == 0 ? (uint8_t*)find_tlv(tlv, tlv_len, TLV_KEY_SLOT, &length) : NULL;
+    if (result == 0 && (!slot || length != LRS_KEY_SLOT_BYTES)) {
+        result = -12;
+    }
+    
+    // Unwrap with the old key, rewrap with the new one
+    uint8_t key[32];
+    uint8_t data_key[32];
+    if (result == 0) {
+        int kdf_result = derive_container_key(old_key_material, old_key_mode, &header, tlv, tlv_len, 1, key);
+        if (kdf_result == 0 && unwrap_data_key(key, &header, slot, data_key) != 0) {
+            kdf_result = -4; // Wrong key
+        }
+        result = kdf_result == 0 ? 0 : kdf_error(kdf_result);
+    }
+    if (result == 0 && set_header_key(&header, tlv, tlv_len, new_key_material, new_key_mode) != 0) {
+        result = -1;
+    }
+    if (result == 0) {
+        int kdf_result = derive_container_key(new_key_material, new_key_mode, &header, tlv, tlv_len, 0, key);
+        result = kdf_result == 0 ? 0 : kdf_error(kdf_result);
+    }
+    if (result == 0) {
+        wrap_data_key(key, &header, data_key, slot);
+        memcpy(region, &header, sizeof(header));
+        if (pwrite_full(fd, region, sizeof(header) + tlv_len, 0) != 0 || fdatasync(fd) != 0) {
+            result = -1;
+        }
+    }
+    sodium_memzero(key, sizeof key);
+    sodium_memzero(data_key, sizeof data_key);
+    
+    lrs_free(region);
+    if (close(fd) != 0 && result == 0) {
+        result = -1;
+    }
+    return result;
+}
+
+typedef struct {
+    const char *const *paths;
+    const void *old_key_material;
+    int old_key_mode;
+    const void *new_key_material;
+    int new_key_mode;
+    int *results;
+    size_t failed;
+} rekey_job_t;
+
+static void rekey_one(void *arg, size_t index) {
+    rekey_job_t *job = (rekey_job_t*)arg;
+    int result = lrs_rekey(job->paths[index], job->old_key_material, job->old_key_mode,
+                           job->new_key_material, job->new_key_mode);
     
-    return 0; // Success
-}
\ No newline at end of file
+    if (job->results) job->results[index] = result;
+    if (result != 0) __atomic_fetch_add(&job->failed, 1, __ATOMIC_RELAXED);
+}
+
+// Rekey many containers on `threads` threads (0 = one per CPU)
+// Returns the number of files that failed (results[i] holds each code) or -1
+// for invalid arguments
+int lrs_rekey_files(const char *const *paths, size_t count, const void *old_key_material, int old_key_mode,
+                    const void *new_key_material, int new_key_mode, unsigned threads, int *results) {
+    if ((count && !paths) || !old_key_material || !new_key_material) return -1;
+    
+    rekey_job_t job = {
+        .paths = paths, .old_key_material = old_key_material, .old_key_mode = old_key_mode,
+        .new_key_material = new_key_material, .new_key_mode = new_key_mode, .results = results,
+    };
+    lrs_parallel_for(threads, count, rekey_one, &job);
+    
+    return (int)job.failed;
+}
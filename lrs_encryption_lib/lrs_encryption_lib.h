@@ -1,12 +1,19 @@
 #ifndef LRS_ENCRYPTION_LIB_H
 #define LRS_ENCRYPTION_LIB_H
 
+#include <stdio.h>
 #include <stdint.h>
+#include <sys/types.h>
 #include <sodium.h>
 
 // Magic and version constants
 #define MAGIC "LRS"
 #define VERSION 2
+#define VERSION_STREAM 3
+// Version flag: the payload key is wrapped in TLV_KEY_SLOT. Readers from before
+// key slots see an unknown version and refuse the file (-2) instead of failing
+// authentication; header_layout() gives the version with the flag cleared
+#define VERSION_KEY_SLOT 0x80
 
 // Algorithm and KDF identifiers
 #define CIPHER_XCHACHA20POLY1305 1
@@ -18,10 +25,57 @@
 #define TLV_TIMESTAMP 2
 #define TLV_FILE_ID 3
 #define TLV_COMMENT 4
+#define TLV_CHUNK_SIZE 5
+#define TLV_SUBKEY_ID 6
+#define TLV_CHUNK_ROOT 7
+#define TLV_KEY_CHECK 8
+#define TLV_KEY_SLOT 9
+#define TLV_ROOT_MAC 10
+
+// Key check value: BLAKE2b of the nonce keyed with the container key
+#define LRS_KEY_CHECK_BYTES 16
+// Key slot: wrap nonce (24) + wrapped data key (32) + tag (16)
+#define LRS_KEY_SLOT_BYTES 72
+// Chunk root MAC: BLAKE2b of the nonce and TLV_CHUNK_ROOT keyed with the payload key
+#define LRS_ROOT_MAC_BYTES 16
+
+// Chunked (v3) container parameters
+#define LRS_CHUNK_SIZE_DEFAULT (64 * 1024)
+#define LRS_CHUNK_SIZE_MAX (16 * 1024 * 1024)
+#define LRS_TLV_MAX 192
+#define LRS_CHUNKS_PER_THREAD 4
+// Stream input read ahead while a password KDF runs (a pipe's buffer starts at
+// the minimum and doubles as input arrives)
+#define LRS_READAHEAD_MAX (64 * 1024 * 1024)
+#define LRS_READAHEAD_MIN (1024 * 1024)
+// Read buffer of the verify-only path (any chunk size streams through it)
+#define LRS_VERIFY_BUFFER (1024 * 1024)
+
+// Batch API: items handed to a worker at a time
+#define LRS_BATCH_ITEMS_PER_TASK 256
+
+// Output encodings for the string API
+#define LRS_ENCODING_HEX 0          // Lowercase hex (encrypt_string)
+#define LRS_ENCODING_BASE64URL 1    // URL-safe Base64 without padding
+#define LRS_ENCODING_BINARY 2       // Raw serialized blob, explicit length
+
+// Internal status: memory mapping unavailable, use the stdio path
+#define LRS_MMAP_FALLBACK 1
 
 // Key modes
 #define KEY_MODE_PASSWORD 0
 #define KEY_MODE_RAW_KEY 1
+#define KEY_MODE_SESSION 2   // key_material is an lrs_session_t*
+
+// Default Argon2id parameters
+#define LRS_KDF_OPS_DEFAULT 3
+#define LRS_KDF_MEM_LIMIT_KIB_DEFAULT (512 * 1024) // 512MB in KiB
+#define LRS_KDF_PARALLELISM_DEFAULT 1
+#define LRS_KDF_MEM_LIMIT_KIB_MIN (8 * 1024)        // Calibration floor: 8 MiB
+#define LRS_KDF_PARALLELISM_MAX 64                   // Lanes; p > 1 uses lrs_argon2id
+
+// crypto_kdf context for per-object session subkeys (8 bytes)
+#define LRS_SUBKEY_CONTEXT "LRSSUBKY"
 
 // TLV structure for extensible header
 typedef struct {
@@ -33,7 +87,7 @@ typedef struct {
 // Header structure for encrypted data with self-describing fields
 typedef struct {
     char magic[3];                // "LRS"
-    uint8_t version;              // 2
+    uint8_t version;              // 2 = single blob, 3 = chunked stream, | VERSION_KEY_SLOT
     uint8_t cipher_suite_id;      // 1 = xchacha20poly1305
     uint8_t kdf_id;               // 1 = argon2id
     uint32_t kdf_ops;             // Time cost parameter (network byte order)
@@ -50,14 +104,92 @@ typedef struct {
     // TLV data would follow here in the actual encrypted data
 } header_t;
 
+// Allocator vtable (lrs_alloc.c). Every heap allocation in the library goes
+// through the calling thread's allocator; secure_alloc holds key material.
+typedef struct {
+    void* (*alloc)(void* ctx, size_t size);
+    void (*free)(void* ctx, void* ptr);
+    void* (*secure_alloc)(void* ctx, size_t size);
+    void (*secure_free)(void* ctx, void* ptr);
+    void* ctx;
+} lrs_allocator_t;
+
+// Argon2id parameters (host byte order), as recorded in the header kdf_* fields
+typedef struct {
+    uint32_t ops;
+    uint32_t mem_limit_kib;
+    uint32_t parallelism;
+} lrs_kdf_params_t;
+
+// Session: a master key derived once (Argon2id or raw key), from which every
+// object encrypted under KEY_MODE_SESSION gets its own subkey via
+// crypto_kdf_derive_from_key. Objects record the session salt and KDF parameters
+// in the header and the subkey id in TLV_SUBKEY_ID, so they also decrypt with
+// the password or raw key alone.
+typedef struct {
+    uint8_t *master_key;          // sodium_malloc'd; NULL once closed
+    int key_mode;                 // KEY_MODE_PASSWORD or KEY_MODE_RAW_KEY
+    uint8_t salt[16];
+    uint32_t kdf_ops;             // Host byte order
+    uint32_t kdf_mem_limit_kib;
+    uint32_t kdf_parallelism;
+    uint64_t next_subkey_id;
+    const lrs_allocator_t *allocator; // Allocator the master key came from
+} lrs_session_t;
+
 // Function declarations
+size_t add_tlv(uint8_t* buffer, size_t max_size, uint8_t type, const uint8_t* value, uint8_t length);
+const uint8_t* find_tlv(const uint8_t* buffer, size_t size, uint8_t type, uint8_t* length);
+uint8_t header_layout(const header_t* hdr);
+
+int derive_key_argon2id(const char* pwd, const uint8_t salt[16],
+                       uint32_t mem_limit_kib, uint32_t ops, uint32_t parallel,
+                       uint8_t out_key[32]);
+int derive_key_from_raw(const uint32_t* raw_key, size_t raw_key_len, uint8_t out_key[32]);
+
+int lrs_session_open(lrs_session_t* session, const void* key_material, int key_mode);
+int lrs_session_open_header(lrs_session_t* session, const void* key_material, int key_mode,
+                         const header_t* header);
+uint64_t lrs_session_next_subkey_id(lrs_session_t* session);
+int lrs_session_open_params(lrs_session_t* session, const void* key_material, int key_mode,
+                         const lrs_kdf_params_t* params);
+void lrs_session_close(lrs_session_t* session);
+
+// KDF parameters for new objects: the process-wide setting (NULL restores the
+// LRS_KDF_*_DEFAULT values) applies to every encrypt entry point and new session.
+// lrs_kdf_calibrate finds the strongest parameters whose derivation takes at most
+// target_ms on this host within max_mem_kib (0 = LRS_KDF_MEM_LIMIT_KIB_DEFAULT);
+// it returns -2 if even the smallest setting is too slow (params are then the
+// fastest tried), and optionally reports the measured latency.
+void lrs_kdf_params_default(lrs_kdf_params_t* params);
+int lrs_set_kdf_params(const lrs_kdf_params_t* params);
+void lrs_get_kdf_params(lrs_kdf_params_t* params);
+int lrs_kdf_calibrate(uint32_t target_ms, uint32_t max_mem_kib, lrs_kdf_params_t* params,
+                   uint32_t* measured_ms);
+
+// Derived-key cache (opt-in): bounded LRU of Argon2id outputs keyed by a keyed
+// hash of (password, salt, kdf_ops, kdf_mem_limit_kib, kdf_parallelism, key_mode),
+// filled by decryption and session opens only
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t expirations;
+    uint64_t entries;
+} lrs_key_cache_stats_t;
+
+int lrs_key_cache_enable(size_t capacity, unsigned ttl_seconds);
+void lrs_key_cache_purge(void);
+void lrs_key_cache_disable(void);
+void lrs_key_cache_get_stats(lrs_key_cache_stats_t* stats);
+
 int encrypt_blob(const uint8_t* plaintext, size_t pt_len,
-                const char* password, const char* aad,
+                const char* password, const uint8_t* aad, size_t aad_len,
                 header_t* header, uint8_t* ciphertext, size_t* ct_len);
 
 int decrypt_blob(const uint8_t* ciphertext, size_t ct_len,
-                const char* password, const char* aad,
-                header_t* header, uint8_t* plaintext, size_t* pt_len);
+                const char* password, const uint8_t* aad, size_t aad_len,
+                const header_t* header, uint8_t* plaintext, size_t* pt_len);
 
 int encrypt_blob_ex(const uint8_t* plaintext, size_t pt_len,
                  const void* key_material, int key_mode,
@@ -71,10 +203,316 @@ int decrypt_blob_ex(const uint8_t* ciphertext, size_t ct_len,
                  const header_t* header, const uint8_t* tlv_data, size_t tlv_len,
                  uint8_t* plaintext, size_t* pt_len);
 
+// In-place AEAD with a detached tag: the ciphertext overwrites the plaintext in
+// `buf` (same length) and back, and the 16-byte tag is kept wherever the caller
+// likes. buf followed by tag is the encrypt_blob_ex ciphertext. On failure,
+// decrypt_blob_inplace wipes `buf`.
+int encrypt_blob_inplace(uint8_t* buf, size_t len,
+                      const void* key_material, int key_mode,
+                      const uint8_t* aad, size_t aad_len,
+                      header_t* header, uint8_t* tlv_buffer, size_t tlv_buffer_size,
+                      uint8_t tag[crypto_aead_xchacha20poly1305_ietf_ABYTES]);
+int decrypt_blob_inplace(uint8_t* buf, size_t len,
+                      const void* key_material, int key_mode,
+                      const uint8_t* aad, size_t aad_len,
+                      const header_t* header, const uint8_t* tlv_data, size_t tlv_len,
+                      const uint8_t tag[crypto_aead_xchacha20poly1305_ietf_ABYTES]);
+
 char* encrypt_string(const char* plaintext, const char* password, const char* aad);
 char* decrypt_string(const char* ciphertext_hex, const char* password, const char* aad);
 
+// String API with any key mode and a selectable encoding (LRS_ENCODING_*)
+// All encodings carry the same serialized blob (header, TLV section, ciphertext);
+// hex output is what encrypt_string produces. *out_len receives the output length
+// without the terminating NUL of the text encodings; it is required for binary.
+char* encrypt_string_ex(const char* plaintext, const void* key_material, int key_mode,
+                      const char* aad, int encoding, size_t* out_len);
+char* decrypt_string_ex(const char* input, size_t input_len, const void* key_material, int key_mode,
+                      const char* aad, int encoding);
+
 int encrypt_file(const char* input_file, const char* output_file, const char* password, const char* aad);
 int decrypt_file(const char* input_file, const char* output_file, const char* password, const char* aad);
 
+// File encryption with any key mode. Regular files are encrypted/decrypted directly
+// between memory mappings (output preallocated); pipes and other special files fall
+// back to the chunked stdio stream. `threads` as for encrypt_stream.
+int encrypt_file_ex(const char* input_file, const char* output_file,
+                 const void* key_material, int key_mode,
+                 const uint8_t* aad, size_t aad_len, unsigned threads);
+int decrypt_file_ex(const char* input_file, const char* output_file,
+                 const void* key_material, int key_mode,
+                 const uint8_t* aad, size_t aad_len, unsigned threads);
+
+// Chunked (v3) streaming: the payload is split into chunk_size pieces, each sealed
+// separately, so memory use is bounded by the chunk size rather than the input size.
+// A chunk_size of 0 selects LRS_CHUNK_SIZE_DEFAULT.
+// Chunks are sealed on `threads` threads (0 = one per CPU); every chunk has its own
+// nonce, so the output does not depend on the thread count.
+int encrypt_stream(FILE* in, FILE* out,
+                 const void* key_material, int key_mode,
+                 const uint8_t* aad, size_t aad_len, uint32_t chunk_size, unsigned threads);
+int decrypt_stream(FILE* in, FILE* out,
+                 const void* key_material, int key_mode,
+                 const uint8_t* aad, size_t aad_len, unsigned threads);
+
+// Random access to chunked (v3) files: lrs_open derives the key and authenticates
+// the last chunk (and with it the plaintext length); lrs_pread then opens only
+// the chunks covering the requested range, so a read costs O(chunk size) whatever
+// the file size. lrs_open returns 0 or a decrypt_file_ex error code (-2 for v1/v2
+// files); lrs_pread returns the bytes read (short only at the end of the file),
+// -1 on I/O errors or -8 if a chunk fails authentication. A handle may be shared
+// between threads; its reads are serialized.
+typedef struct lrs_file lrs_file_t;
+
+int lrs_open(lrs_file_t** file, const char* path, const void* key_material, int key_mode,
+             const uint8_t* aad, size_t aad_len);
+uint64_t lrs_file_size(const lrs_file_t* file);
+ssize_t lrs_pread(lrs_file_t* file, void* buf, size_t len, uint64_t offset);
+void lrs_close(lrs_file_t* file);
+
+// Verify-only: authenticate a container of any version by recomputing each
+// Poly1305 tag from the ciphertext as it is read (and the chunk root and its
+// MAC, if any), without decrypting or writing anything; memory use is
+// LRS_VERIFY_BUFFER per file being read. Returns 0 or a decrypt_file_ex error code (-8: tampered or
+// wrong key). lrs_verify_files checks many files on `threads` threads (0 = one
+// per CPU) and returns how many failed, with each code in results[i] (optional).
+int lrs_verify_file(const char* path, const void* key_material, int key_mode,
+                    const uint8_t* aad, size_t aad_len);
+int lrs_verify_files(const char* const* paths, size_t count, const void* key_material, int key_mode,
+                     const uint8_t* aad, size_t aad_len, unsigned threads, int* results);
+
+// Rekey (envelope encryption): file and stream payloads are sealed under a
+// random data key that TLV_KEY_SLOT holds wrapped by the key derived from the
+// password, raw key or session. lrs_rekey unwraps it with the old key material
+// and rewraps it with the new (password, raw key or session) in place - header
+// and TLV section only, whatever the file size. Returns 0 or a decrypt_file_ex
+// error code (-8: wrong old key), or -12 for containers without a key slot,
+// which have to be re-encrypted (only the file and stream functions write one;
+// blobs never have it). lrs_rekey_files rekeys many files on `threads` threads
+// (0 = one per CPU) and returns how many failed, with each code in results[i]
+// (optional).
+int lrs_rekey(const char* path, const void* old_key_material, int old_key_mode,
+              const void* new_key_material, int new_key_mode);
+int lrs_rekey_files(const char* const* paths, size_t count, const void* old_key_material, int old_key_mode,
+                    const void* new_key_material, int new_key_mode, unsigned threads, int* results);
+
+// Batch API: many small messages under one session (one subkey per batch, no
+// per-item KDF or heap allocation). Each item is written to the caller's arena
+// as a standalone v2 blob - header, TLV section, ciphertext - that
+// decrypt_blob_ex also accepts. Work is spread over `threads` threads (0 = one
+// per CPU). Both calls return the number of failed items (see results[i].status),
+// -1 for invalid arguments or -5 if the arena is too small.
+typedef struct {
+    const uint8_t* data;
+    size_t len;
+    const uint8_t* aad;
+    size_t aad_len;
+} lrs_batch_item_t;
+
+typedef struct {
+    size_t offset;                // Start of the item's output in the arena
+    size_t len;                   // Bytes written
+    int status;                   // 0 or an encrypt_blob_ex/decrypt_blob_ex error code
+} lrs_batch_result_t;
+
+size_t lrs_batch_encrypted_size(const lrs_batch_item_t* items, size_t count);
+size_t lrs_batch_decrypted_size(const lrs_batch_item_t* items, size_t count);
+int encrypt_blob_batch(lrs_session_t* session, const lrs_batch_item_t* items, size_t count,
+                     uint8_t* arena, size_t arena_size, lrs_batch_result_t* results, unsigned threads);
+int decrypt_blob_batch(lrs_session_t* session, const lrs_batch_item_t* items, size_t count,
+                     uint8_t* arena, size_t arena_size, lrs_batch_result_t* results, unsigned threads);
+
+// Hex codec (lrs_hex.c): SSE2/AVX2 kernels chosen at runtime with a scalar
+// fallback; constant time in the data. Encoding writes 2 * len digits and a NUL;
+// decoding accepts either case and returns 0 or -1 for odd lengths/non-hex input.
+void lrs_hex_encode(char* hex, const uint8_t* bin, size_t len);
+int lrs_hex_decode(uint8_t* bin, const char* hex, size_t hex_len);
+
+// Directory trees (lrs_dir.c): every regular file under src_dir is encrypted to
+// the same relative path under dst_dir plus ".lrs"; decryption takes the ".lrs"
+// files and strips the suffix. Directories are created as needed and permission
+// bits are copied; symlinks, special files and (decrypting) other files are skipped.
+// A password or raw key is turned into one session for the tree, so there is a
+// single KDF and every file gets its own subkey id; decryption opens that session
+// from the first container and derives per file only for files from elsewhere.
+// Files run on `threads` threads (0 = one per CPU), largest first.
+// Returns 0, the number of files that failed, or -1 if the tree could not be
+// walked or a directory created.
+typedef struct {
+    uint64_t files;               // Processed
+    uint64_t failed;
+    uint64_t skipped;
+    uint64_t bytes;               // Input bytes of the processed files
+    double seconds;
+} lrs_dir_stats_t;
+
+int lrs_encrypt_dir(const char* src_dir, const char* dst_dir, const void* key_material, int key_mode,
+                    const uint8_t* aad, size_t aad_len, unsigned threads, lrs_dir_stats_t* stats);
+int lrs_decrypt_dir(const char* src_dir, const char* dst_dir, const void* key_material, int key_mode,
+                    const uint8_t* aad, size_t aad_len, unsigned threads, lrs_dir_stats_t* stats);
+
+// Chunk Merkle tree (lrs_merkle.c): v3 files record in TLV_CHUNK_ROOT a BLAKE2b
+// Merkle root (RFC 6962 shape) over leaves lrs_merkle_leaf(i, tag of chunk i), when
+// the writer could seek back to fill it in (files always; encrypt_stream only on
+// seekable, non-append outputs). The tree is unkeyed; TLV_ROOT_MAC binds the root
+// to the payload key, and lrs_verify_file and lrs_open reject a root whose MAC
+// does not match. lrs_merkle_check_file recomputes the root from the chunk tags
+// on `threads` threads (0 = one per CPU) and compares it with the recorded one,
+// which anyone can rewrite along with the tags: without the key it detects
+// accidental corruption only, so check against a root taken from a file a key
+// holder has verified. lrs_merkle_proof_file returns the tag and audit path of
+// one chunk, which lrs_merkle_verify checks against a root in O(log n) hashes.
+// The file functions return 0, -8 if the root does not match, -9 if the file has
+// no root, -2 for v1/v2 files or -1 on I/O errors; lrs_merkle_verify returns 0 or -1.
+#define LRS_MERKLE_HASH_BYTES 32
+#define LRS_MERKLE_PROOF_MAX 64
+
+typedef struct {
+    uint8_t stack[64][LRS_MERKLE_HASH_BYTES]; // Roots of complete subtrees, largest first
+    uint64_t count;               // Leaves added
+} lrs_merkle_t;
+
+void lrs_merkle_leaf(uint64_t index, const uint8_t tag[crypto_aead_xchacha20poly1305_ietf_ABYTES],
+                     uint8_t leaf[LRS_MERKLE_HASH_BYTES]);
+void lrs_merkle_init(lrs_merkle_t* tree);
+void lrs_merkle_add(lrs_merkle_t* tree, const uint8_t leaf[LRS_MERKLE_HASH_BYTES]);
+int lrs_merkle_final(const lrs_merkle_t* tree, uint8_t root[LRS_MERKLE_HASH_BYTES]);
+int lrs_merkle_verify(const uint8_t root[LRS_MERKLE_HASH_BYTES], uint64_t count, uint64_t index,
+                      const uint8_t leaf[LRS_MERKLE_HASH_BYTES],
+                      const uint8_t proof[][LRS_MERKLE_HASH_BYTES], size_t proof_len);
+int lrs_merkle_check_file(const char* path, uint8_t root[LRS_MERKLE_HASH_BYTES], unsigned threads);
+int lrs_merkle_proof_file(const char* path, uint64_t index,
+                          uint8_t tag[crypto_aead_xchacha20poly1305_ietf_ABYTES],
+                          uint8_t proof[LRS_MERKLE_PROOF_MAX][LRS_MERKLE_HASH_BYTES], size_t* proof_len,
+                          uint64_t* chunk_count);
+
+// Header inspection (lrs_inspect.c): read a container's header and TLV section
+// (one pread for the usual TLV sizes) without the key or the payload.
+// lrs_inspect returns 0, or -1 if the file cannot be read or is not an LRS
+// container (info->status says the same). lrs_inspect_files fans a list out over
+// `threads` threads (0 = one per CPU), each with at most one file open, and
+// returns how many failed. Records are written as JSON Lines or CSV rows.
+#define LRS_INSPECT_JSON 0
+#define LRS_INSPECT_CSV 1
+
+typedef struct {
+    int status;                   // 0 or -1
+    uint8_t version;
+    uint8_t cipher_suite_id;
+    uint8_t kdf_id;
+    uint32_t kdf_ops;             // Host byte order
+    uint32_t kdf_mem_limit_kib;
+    uint32_t kdf_parallelism;
+    int key_mode;                 // TLV_KEY_MODE, -1 if absent
+    int64_t timestamp;            // TLV_TIMESTAMP (Unix seconds), -1 if absent
+    uint32_t chunk_size;          // TLV_CHUNK_SIZE, 0 if absent
+    uint64_t subkey_id;           // TLV_SUBKEY_ID, if has_subkey_id
+    int has_subkey_id;
+    int has_chunk_root;
+    int has_key_check;
+    int has_key_slot;             // Rekeyable in place (lrs_rekey)
+    int has_aad;                  // Encrypted with paths/doubts
+    uint16_t tlv_len;
+    uint64_t file_size;
+} lrs_inspect_t;
+
+int lrs_inspect(const char* path, lrs_inspect_t* info);
+size_t lrs_inspect_files(const char* const* paths, size_t count, lrs_inspect_t* infos, unsigned threads);
+void lrs_inspect_write_header(FILE* out, int format);
+void lrs_inspect_write(FILE* out, const char* path, const lrs_inspect_t* info, int format);
+
+// Multi-lane Argon2id (lrs_argon2.c): RFC 9106 Argon2id v1.3 with `lanes` lanes
+// (1..LRS_KDF_PARALLELISM_MAX) filled on up to one thread per lane. secret and
+// ad are optional. Returns 0, -1 on invalid parameters or allocation failure, or
+// -11 if the memory governor's budget could not be reserved.
+// Single-lane output is identical to crypto_pwhash; the library uses this
+// backend for headers with kdf_parallelism > 1.
+int lrs_argon2id(uint8_t* out, size_t out_len, const uint8_t* pwd, size_t pwd_len,
+                 const uint8_t* salt, size_t salt_len, const uint8_t* secret, size_t secret_len,
+                 const uint8_t* ad, size_t ad_len, uint32_t ops, uint32_t mem_limit_kib, uint32_t lanes);
+// Called by both KDF backends once the derivation's memory is reserved, to start
+// the calling thread's I/O overlapped with it (internal)
+void lrs_kdf_memory_held(void);
+
+// Persistent KDF memory (opt-in): each thread that derives keys keeps its Argon2
+// memory mapped and pre-faulted between calls, on MAP_HUGETLB pages when the
+// system has them reserved, else on transparent huge pages, and wiped after every
+// use; a mapped arena holds its memory governor reservation until it is unmapped.
+// While enabled all password derivations go through lrs_argon2id. Disabling
+// unmaps every idle arena at once and those in use when their derivation ends.
+// lrs_kdf_arena_trim unmaps the idle arenas of all threads and returns the bytes
+// freed; a memory reservation that would wait calls it first, and an arena is
+// dropped after use while reservations are queued, so arenas never hold budget
+// others are waiting for.
+typedef struct {
+    uint64_t acquires;            // Derivations served from an arena
+    uint64_t reuses;              // ... without mapping new memory
+    uint64_t maps;                // Arenas mapped (first use or growth)
+    uint64_t hugetlb_maps;        // ... of which on MAP_HUGETLB pages
+    uint64_t mapped_bytes;        // Currently mapped across all threads
+} lrs_kdf_arena_stats_t;
+
+void lrs_kdf_arena_enable(void);
+void lrs_kdf_arena_disable(void);
+size_t lrs_kdf_arena_trim(void);
+int lrs_kdf_arena_enabled(void);
+void lrs_kdf_arena_get_stats(lrs_kdf_arena_stats_t* stats);
+
+// Allocators (lrs_alloc.c)
+// The thread allocator overrides the process default, which overrides
+// malloc/sodium_malloc. Buffers returned by the library (encrypt_string etc.)
+// come from the current allocator; release them with lrs_free.
+void lrs_set_allocator(const lrs_allocator_t* allocator);
+const lrs_allocator_t* lrs_set_thread_allocator(const lrs_allocator_t* allocator);
+const lrs_allocator_t* lrs_current_allocator(void);
+void* lrs_alloc(size_t size);
+void lrs_free(void* ptr);
+void* lrs_secure_alloc(size_t size);
+void lrs_secure_free(void* ptr);
+
+// Memory governor (lrs_alloc.c): Argon2 memory, stream batch buffers and
+// whole-file buffers reserve their size against a process-wide budget before
+// allocating, in arrival order. With the budget exhausted a reservation queues
+// for up to timeout_ms (< 0 = indefinitely) or, with 0, fails at once; the
+// operation then returns -11. A budget of 0 (the default) only counts.
+typedef struct {
+    uint64_t budget_bytes;
+    uint64_t reserved_bytes;      // Currently reserved
+    uint64_t peak_reserved_bytes;
+    uint64_t reservations;        // Granted
+    uint64_t waits;               // ... of which after queueing
+    uint64_t rejections;          // Timed out, failed fast or larger than the budget
+    uint64_t queue_depth;         // Queued now
+    uint64_t max_queue_depth;
+    uint64_t total_wait_ns;       // Time spent queued, granted or not
+    uint64_t max_wait_ns;
+} lrs_memory_stats_t;
+
+void lrs_memory_set_budget(size_t budget_bytes, int timeout_ms);
+int lrs_memory_reserve(size_t bytes);
+int lrs_memory_try_reserve(size_t bytes);
+void lrs_memory_release(size_t bytes);
+void lrs_memory_get_stats(lrs_memory_stats_t* stats);
+
+// Bump arena: O(1) reset of every allocation since the last reset; secure
+// allocations still go to sodium_malloc. lrs_thread_arena gives each thread its own.
+typedef struct lrs_arena lrs_arena_t;
+
+lrs_arena_t* lrs_arena_create(size_t block_size);
+const lrs_allocator_t* lrs_arena_allocator(lrs_arena_t* arena);
+void lrs_arena_reset(lrs_arena_t* arena);
+size_t lrs_arena_used(const lrs_arena_t* arena);
+void lrs_arena_destroy(lrs_arena_t* arena);
+lrs_arena_t* lrs_thread_arena(void);
+
+// Worker pool (lrs_parallel.c)
+typedef struct lrs_pool lrs_pool_t;
+
+unsigned lrs_cpu_count(void);
+lrs_pool_t* lrs_pool_create(unsigned threads);
+void lrs_pool_run(lrs_pool_t* pool, size_t count, void (*fn)(void* arg, size_t index), void* arg);
+unsigned lrs_pool_size(const lrs_pool_t* pool);
+void lrs_pool_destroy(lrs_pool_t* pool);
+void lrs_parallel_for(unsigned threads, size_t count, void (*fn)(void* arg, size_t index), void* arg);
+
 #endif // LRS_ENCRYPTION_LIB_H
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "lrs_encryption_lib.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LRS_HEX_X86 1
+#endif
+
+// Hex codec
+// Lowercase output; input may use either case. Neither direction branches or
+// indexes tables on the data, and decoding checks every character and reports
+// invalid input only once the whole string was processed, so timing depends on
+// the length alone. Runs of 32 (AVX2) or 16 (SSE2) bytes go through vector
+// kernels, the tail through the scalar code.
+
+// One nibble to its lowercase hex digit
+static inline char hex_digit(unsigned n) {
+    // 'a' - '0' - 10 = 39, added only when n > 9
+    return (char)(n + '0' + (((9 - n) >> 8) & 39));
+}
+
+// One hex digit to its value; sets the high bits of *err for anything else
+static inline unsigned hex_value(unsigned char c, unsigned *err) {
+    unsigned digit = ((unsigned)c - '0') & 0xff;
+    unsigned alpha = (((unsigned)c | 0x20) - 'a') & 0xff;
+    unsigned digit_mask = ((digit - 10) >> 8) & 0xff;   // 0xff if c is 0-9
+    unsigned alpha_mask = ((alpha - 6) >> 8) & 0xff;    // 0xff if c is a-f/A-F
+
+    *err |= ~(digit_mask | alpha_mask) & 0xff;
+    return (digit & digit_mask) | ((alpha + 10) & alpha_mask);
+}
+
+static void encode_scalar(char *hex, const uint8_t *bin, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hex[2 * i] = hex_digit(bin[i] >> 4);
+        hex[2 * i + 1] = hex_digit(bin[i] & 0x0f);
+    }
+}
+
+static unsigned decode_scalar(uint8_t *bin, const char *hex, size_t len) {
+    unsigned err = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned hi = hex_value((unsigned char)hex[2 * i], &err);
+        unsigned lo = hex_value((unsigned char)hex[2 * i + 1], &err);
+        bin[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return err;
+}
+
+#ifdef LRS_HEX_X86
+
+// Nibbles (0-15 per byte) to hex digits
+__attribute__((target("sse2")))
+static inline __m128i digits_sse2(__m128i nibbles) {
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8(39));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+// Hex digits to nibbles; invalid characters set bytes of *err
+__attribute__((target("sse2")))
+static inline __m128i nibbles_sse2(__m128i chars, __m128i *err) {
+    __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    __m128i alpha = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    // Unsigned x <= limit as min(x, limit) == x
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    __m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+
+    *err = _mm_or_si128(*err, _mm_andnot_si128(_mm_or_si128(is_digit, is_alpha), _mm_set1_epi8(-1)));
+    return _mm_or_si128(_mm_and_si128(digit, is_digit),
+                        _mm_and_si128(_mm_add_epi8(alpha, _mm_set1_epi8(10)), is_alpha));
+}
+
+// Pairs of nibbles (high first) in each 16-bit lane to one byte in its low half
+__attribute__((target("sse2")))
+static inline __m128i join_sse2(__m128i nibbles) {
+    __m128i hi = _mm_and_si128(_mm_slli_epi16(nibbles, 4), _mm_set1_epi16(0x00f0));
+    __m128i lo = _mm_srli_epi16(nibbles, 8);
+    return _mm_or_si128(hi, lo);
+}
+
+__attribute__((target("sse2")))
+static void encode_sse2(char *hex, const uint8_t *bin, size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(bin + i));
+        __m128i hi = digits_sse2(_mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0f)));
+        __m128i lo = digits_sse2(_mm_and_si128(bytes, _mm_set1_epi8(0x0f)));
+        _mm_storeu_si128((__m128i*)(hex + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*)(hex + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    encode_scalar(hex + 2 * i, bin + i, len - i);
+}
+
+__attribute__((target("sse2")))
+static unsigned decode_sse2(uint8_t *bin, const char *hex, size_t len) {
+    __m128i err = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i first = nibbles_sse2(_mm_loadu_si128((const __m128i*)(hex + 2 * i)), &err);
+        __m128i second = nibbles_sse2(_mm_loadu_si128((const __m128i*)(hex + 2 * i + 16)), &err);
+        _mm_storeu_si128((__m128i*)(bin + i), _mm_packus_epi16(join_sse2(first), join_sse2(second)));
+    }
+    return (unsigned)_mm_movemask_epi8(err) | decode_scalar(bin + i, hex + 2 * i, len - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i digits_avx2(__m256i nibbles) {
+    __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9)),
+                                       _mm256_set1_epi8(39));
+    return _mm256_add_epi8(_mm256_add_epi8(nibbles, _mm256_set1_epi8('0')), letters);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i nibbles_avx2(__m256i chars, __m256i *err) {
+    __m256i digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+    __m256i alpha = _mm256_sub_epi8(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+    __m256i is_alpha = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(5)), alpha);
+
+    *err = _mm256_or_si256(*err, _mm256_andnot_si256(_mm256_or_si256(is_digit, is_alpha),
+                                                     _mm256_set1_epi8(-1)));
+    return _mm256_or_si256(_mm256_and_si256(digit, is_digit),
+                           _mm256_and_si256(_mm256_add_epi8(alpha, _mm256_set1_epi8(10)), is_alpha));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i join_avx2(__m256i nibbles) {
+    __m256i hi = _mm256_and_si256(_mm256_slli_epi16(nibbles, 4), _mm256_set1_epi16(0x00f0));
+    __m256i lo = _mm256_srli_epi16(nibbles, 8);
+    return _mm256_or_si256(hi, lo);
+}
+
+__attribute__((target("avx2")))
+static void encode_avx2(char *hex, const uint8_t *bin, size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)(bin + i));
+        __m256i hi = digits_avx2(_mm256_and_si256(_mm256_srli_epi16(bytes, 4), _mm256_set1_epi8(0x0f)));
+        __m256i lo = digits_avx2(_mm256_and_si256(bytes, _mm256_set1_epi8(0x0f)));
+        // Unpacking works within 128-bit lanes; put the halves back in order
+        __m256i low = _mm256_unpacklo_epi8(hi, lo);
+        __m256i high = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i*)(hex + 2 * i), _mm256_permute2x128_si256(low, high, 0x20));
+        _mm256_storeu_si256((__m256i*)(hex + 2 * i + 32), _mm256_permute2x128_si256(low, high, 0x31));
+    }
+    encode_sse2(hex + 2 * i, bin + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static unsigned decode_avx2(uint8_t *bin, const char *hex, size_t len) {
+    __m256i err = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i first = nibbles_avx2(_mm256_loadu_si256((const __m256i*)(hex + 2 * i)), &err);
+        __m256i second = nibbles_avx2(_mm256_loadu_si256((const __m256i*)(hex + 2 * i + 32)), &err);
+        // Packing also works within lanes: 64-bit blocks come out as 0, 2, 1, 3
+        __m256i packed = _mm256_packus_epi16(join_avx2(first), join_avx2(second));
+        _mm256_storeu_si256((__m256i*)(bin + i), _mm256_permute4x64_epi64(packed, 0xd8));
+    }
+    return (unsigned)_mm256_movemask_epi8(err) | decode_sse2(bin + i, hex + 2 * i, len - i);
+}
+
+#endif // LRS_HEX_X86
+
+typedef struct {
+    void (*encode)(char *hex, const uint8_t *bin, size_t len);
+    unsigned (*decode)(uint8_t *bin, const char *hex, size_t len);
+} hex_kernels_t;
+
+// Pick the widest kernels the CPU supports (once; later calls reuse the choice)
+static const hex_kernels_t *hex_kernels(void) {
+    static const hex_kernels_t scalar = { encode_scalar, decode_scalar };
+#ifdef LRS_HEX_X86
+    static const hex_kernels_t sse2 = { encode_sse2, decode_sse2 };
+    static const hex_kernels_t avx2 = { encode_avx2, decode_avx2 };
+#endif
+    static const hex_kernels_t *selected = NULL;
+
+    const hex_kernels_t *kernels = __atomic_load_n(&selected, __ATOMIC_ACQUIRE);
+    if (kernels) return kernels;
+
+    kernels = &scalar;
+#ifdef LRS_HEX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels = &avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernels = &sse2;
+    }
+#endif
+    __atomic_store_n(&selected, kernels, __ATOMIC_RELEASE);
+
+    return kernels;
+}
+
+// Encode `len` bytes as 2 * len lowercase hex digits plus a terminating NUL
+void lrs_hex_encode(char *hex, const uint8_t *bin, size_t len) {
+    hex_kernels()->encode(hex, bin, len);
+    hex[2 * len] = '\0';
+}
+
+// Decode `hex_len` hex digits (even) into hex_len / 2 bytes
+// Returns 0, or -1 if the length is odd or any character is not a hex digit;
+// the output is wiped in that case
+int lrs_hex_decode(uint8_t *bin, const char *hex, size_t hex_len) {
+    if (hex_len % 2 != 0) return -1;
+
+    if (hex_kernels()->decode(bin, hex, hex_len / 2) != 0) {
+        sodium_memzero(bin, hex_len / 2);
+        return -1;
+    }
+
+    return 0;
+}
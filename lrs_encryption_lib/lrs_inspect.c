@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "lrs_encryption_lib.h"
+
+// Header inspection
+// Everything an inventory needs sits in the first few hundred bytes: one pread
+// of the header plus LRS_INSPECT_READ bytes of TLV covers every container the
+// library writes (a longer TLV section costs a second read). Files are opened
+// with O_NOATIME where permitted, so listing an archive does not dirty every
+// inode, and each pool thread holds at most one descriptor at a time.
+
+#define LRS_INSPECT_READ 512
+
+// Open read-only without updating the access time; O_NOATIME needs ownership
+static int open_noatime(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if (fd < 0 && errno == EPERM) {
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    return fd;
+}
+
+static int pread_all(int fd, uint8_t *buf, size_t len, off_t offset, size_t *got) {
+    *got = 0;
+    while (*got < len) {
+        ssize_t n = pread(fd, buf + *got, len - *got, offset + (off_t)*got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        *got += (size_t)n;
+    }
+    return 0;
+}
+
+// Decode the header fields and known TLV entries of one container
+static void parse_header(const header_t *hdr, const uint8_t *tlv_data, size_t tlv_len, lrs_inspect_t *info) {
+    info->version = header_layout(hdr);
+    info->cipher_suite_id = hdr->cipher_suite_id;
+    info->kdf_id = hdr->kdf_id;
+    info->kdf_ops = ntohl(hdr->kdf_ops);
+    info->kdf_mem_limit_kib = ntohl(hdr->kdf_mem_limit_kib);
+    info->kdf_parallelism = ntohl(hdr->kdf_parallelism);
+    info->has_aad = hdr->aad_hash_id != 0;
+    info->tlv_len = (uint16_t)tlv_len;
+
+    uint8_t length = 0;
+    const uint8_t *value = find_tlv(tlv_data, tlv_len, TLV_KEY_MODE, &length);
+    if (value && length == 1) info->key_mode = *value;
+
+    value = find_tlv(tlv_data, tlv_len, TLV_TIMESTAMP, &length);
+    if (value && length == 8) {
+        uint64_t timestamp_be;
+        memcpy(&timestamp_be, value, 8);
+        info->timestamp = (int64_t)be64toh(timestamp_be);
+    }
+
+    value = find_tlv(tlv_data, tlv_len, TLV_CHUNK_SIZE, &length);
+    if (value && length == 4) {
+        uint32_t chunk_size_be;
+        memcpy(&chunk_size_be, value, 4);
+        info->chunk_size = ntohl(chunk_size_be);
+    }
+
+    value = find_tlv(tlv_data, tlv_len, TLV_SUBKEY_ID, &length);
+    if (value && length == 8) {
+        uint64_t subkey_id_be;
+        memcpy(&subkey_id_be, value, 8);
+        info->subkey_id = be64toh(subkey_id_be);
+        info->has_subkey_id = 1;
+    }
+
+    value = find_tlv(tlv_data, tlv_len, TLV_CHUNK_ROOT, &length);
+    info->has_chunk_root = value && length == LRS_MERKLE_HASH_BYTES;
+
+    value = find_tlv(tlv_data, tlv_len, TLV_KEY_CHECK, &length);
+    info->has_key_check = value && length == LRS_KEY_CHECK_BYTES;
+
+    value = find_tlv(tlv_data, tlv_len, TLV_KEY_SLOT, &length);
+    info->has_key_slot = value && length == LRS_KEY_SLOT_BYTES;
+}
+
+// Read the header and TLV section of a container
+// Returns 0, or -1 if the file cannot be read or is not an LRS container
+int lrs_inspect(const char *path, lrs_inspect_t *info) {
+    if (!path || !info) return -1;
+    memset(info, 0, sizeof(*info));
+    info->key_mode = -1;
+    info->timestamp = -1;
+    info->status = -1;
+
+    int fd = open_noatime(path);
+    if (fd < 0) return -1;
+
+    uint8_t buffer[sizeof(header_t) + LRS_INSPECT_READ];
+    uint8_t *tlv_data = buffer + sizeof(header_t);
+    uint8_t *long_tlv = NULL;
+    struct stat st;
+    size_t got = 0;
+    header_t hdr;
+    int result = fstat(fd, &st) == 0 && pread_all(fd, buffer, sizeof(buffer), 0, &got) == 0 &&
+                 got >= sizeof(header_t) ? 0 : -1;
+    if (result == 0) {
+        memcpy(&hdr, buffer, sizeof(hdr));
+        if (memcmp(hdr.magic, MAGIC, 3) != 0) result = -1;
+    }
+
+    size_t tlv_len = 0;
+    if (result == 0 && header_layout(&hdr) >= 2) {
+        tlv_len = ntohs(hdr.tlv_len);
+        if (tlv_len > got - sizeof(header_t)) {
+            // Longer than the first read, or cut short by the end of the file
+            size_t more = 0;
+            long_tlv = (uint8_t*)lrs_alloc(tlv_len);
+            result = long_tlv && pread_all(fd, long_tlv, tlv_len, sizeof(header_t), &more) == 0 &&
+                     more == tlv_len ? 0 : -1;
+            tlv_data = long_tlv;
+        }
+    }
+
+    if (result == 0) {
+        info->file_size = (uint64_t)st.st_size;
+        parse_header(&hdr, tlv_data, tlv_len, info);
+        info->status = 0;
+    }
+
+    lrs_free(long_tlv);
+    close(fd);
+    return result;
+}
+
+typedef struct {
+    const char *const *paths;
+    lrs_inspect_t *infos;
+} inspect_job_t;
+
+static void inspect_one(void *arg, size_t index) {
+    inspect_job_t *job = (inspect_job_t*)arg;
+    lrs_inspect(job->paths[index], &job->infos[index]);
+}
+
+// Inspect many files on `threads` threads (0 = one per CPU); each thread has at
+// most one file open. Returns the number of files that could not be inspected.
+size_t lrs_inspect_files(const char *const *paths, size_t count, lrs_inspect_t *infos, unsigned threads) {
+    if (!paths || !infos) return count;
+
+    inspect_job_t job = { paths, infos };
+    lrs_parallel_for(threads, count, inspect_one, &job);
+
+    size_t failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (infos[i].status != 0) failed++;
+    }
+    return failed;
+}
+
+static const char *key_mode_name(int key_mode) {
+    if (key_mode == KEY_MODE_PASSWORD) return "password";
+    if (key_mode == KEY_MODE_RAW_KEY) return "raw_key";
+    return key_mode < 0 ? "" : "unknown";
+}
+
+// Quote a path for JSON (RFC 8259) or CSV (RFC 4180)
+static void write_quoted(FILE *out, const char *text, int format) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char*)text; *c; c++) {
+        if (format == LRS_INSPECT_CSV) {
+            if (*c == '"') fputc('"', out);
+            fputc(*c, out);
+        } else if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// Column names for LRS_INSPECT_CSV
+void lrs_inspect_write_header(FILE *out, int format) {
+    if (format == LRS_INSPECT_CSV) {
+        fputs("path,status,version,cipher_suite,kdf,kdf_ops,kdf_mem_kib,kdf_parallelism,key_mode,"
+              "timestamp,chunk_size,subkey_id,chunk_root,key_check,key_slot,aad,tlv_len,file_size\n", out);
+    }
+}
+
+// One record: a JSON object per line (LRS_INSPECT_JSON) or a CSV row
+void lrs_inspect_write(FILE *out, const char *path, const lrs_inspect_t *info, int format) {
+    if (format == LRS_INSPECT_CSV) {
+        write_quoted(out, path, format);
+        if (info->status != 0) {
+            fputs(",error,,,,,,,,,,,,,,,,\n", out);
+            return;
+        }
+        fprintf(out, ",ok,%u,%u,%u,%u,%u,%u,%s,", info->version, info->cipher_suite_id, info->kdf_id,
+                info->kdf_ops, info->kdf_mem_limit_kib, info->kdf_parallelism, key_mode_name(info->key_mode));
+        if (info->timestamp >= 0) fprintf(out, "%lld", (long long)info->timestamp);
+        fputc(',', out);
+        if (info->chunk_size) fprintf(out, "%u", info->chunk_size);
+        fputc(',', out);
+        if (info->has_subkey_id) fprintf(out, "%llu", (unsigned long long)info->subkey_id);
+        fprintf(out, ",%d,%d,%d,%d,%u,%llu\n", info->has_chunk_root, info->has_key_check, info->has_key_slot,
+                info->has_aad, info->tlv_len, (unsigned long long)info->file_size);
+        return;
+    }
+
+    fputs("{\"path\":", out);
+    write_quoted(out, path, format);
+    if (info->status != 0) {
+        fputs(",\"status\":\"error\"}\n", out);
+        return;
+    }
+    fprintf(out, ",\"status\":\"ok\",\"version\":%u,\"cipher_suite\":%u,\"kdf\":%u,\"kdf_ops\":%u,"
+            "\"kdf_mem_kib\":%u,\"kdf_parallelism\":%u", info->version, info->cipher_suite_id, info->kdf_id,
+            info->kdf_ops, info->kdf_mem_limit_kib, info->kdf_parallelism);
+    if (info->key_mode >= 0) fprintf(out, ",\"key_mode\":\"%s\"", key_mode_name(info->key_mode));
+    if (info->timestamp >= 0) fprintf(out, ",\"timestamp\":%lld", (long long)info->timestamp);
+    if (info->chunk_size) fprintf(out, ",\"chunk_size\":%u", info->chunk_size);
+    if (info->has_subkey_id) fprintf(out, ",\"subkey_id\":%llu", (unsigned long long)info->subkey_id);
+    fprintf(out, ",\"chunk_root\":%s,\"key_check\":%s,\"key_slot\":%s,\"aad\":%s,\"tlv_len\":%u,"
+            "\"file_size\":%llu}\n", info->has_chunk_root ? "true" : "false", info->has_key_check ? "true" : "false",
+            info->has_key_slot ? "true" : "false", info->has_aad ? "true" : "false", info->tlv_len,
+            (unsigned long long)info->file_size);
+}
@@ -0,0 +1,274 @@
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "lrs_encryption_lib.h"
+
+// Chunk Merkle tree
+// Leaves are BLAKE2b-256(0x00 || index || tag) over the 16-byte Poly1305 tags of a
+// v3 container's chunks, inner nodes BLAKE2b-256(0x01 || left || right), and the
+// tree over n leaves splits at the largest power of two below n (RFC 6962), so a
+// writer can fold leaves in as chunks are sealed and a proof has at most one
+// hash per level. The root needs no key: anyone holding a trusted root can check
+// the tags of a file, and whoever holds the key checks each chunk against its tag.
+// The root a file records is trusted only once its TLV_ROOT_MAC has been checked
+// with the key; compared without it, a match rules out accidental corruption only.
+
+#define LEAF_PREFIX 0x00
+#define NODE_PREFIX 0x01
+
+// Leaves hashed per pool item when checking a file
+#define LEAVES_PER_TASK 4096
+
+void lrs_merkle_leaf(uint64_t index, const uint8_t tag[crypto_aead_xchacha20poly1305_ietf_ABYTES],
+                     uint8_t leaf[LRS_MERKLE_HASH_BYTES]) {
+    uint8_t input[1 + 8 + crypto_aead_xchacha20poly1305_ietf_ABYTES];
+    uint64_t index_be = htobe64(index);
+    input[0] = LEAF_PREFIX;
+    memcpy(input + 1, &index_be, 8);
+    memcpy(input + 9, tag, crypto_aead_xchacha20poly1305_ietf_ABYTES);
+    crypto_generichash(leaf, LRS_MERKLE_HASH_BYTES, input, sizeof(input), NULL, 0);
+}
+
+static void merkle_node(const uint8_t left[LRS_MERKLE_HASH_BYTES], const uint8_t right[LRS_MERKLE_HASH_BYTES],
+                        uint8_t out[LRS_MERKLE_HASH_BYTES]) {
+    uint8_t input[1 + 2 * LRS_MERKLE_HASH_BYTES];
+    input[0] = NODE_PREFIX;
+    memcpy(input + 1, left, LRS_MERKLE_HASH_BYTES);
+    memcpy(input + 1 + LRS_MERKLE_HASH_BYTES, right, LRS_MERKLE_HASH_BYTES);
+    crypto_generichash(out, LRS_MERKLE_HASH_BYTES, input, sizeof(input), NULL, 0);
+}
+
+// Incremental builder: the stack holds the roots of the complete subtrees, one
+// per set bit of the leaf count, largest first
+void lrs_merkle_init(lrs_merkle_t *tree) {
+    memset(tree, 0, sizeof(*tree));
+}
+
+void lrs_merkle_add(lrs_merkle_t *tree, const uint8_t leaf[LRS_MERKLE_HASH_BYTES]) {
+    uint8_t hash[LRS_MERKLE_HASH_BYTES];
+    memcpy(hash, leaf, sizeof(hash));
+
+    // Like a binary increment: every trailing 1 bit merges two equal subtrees
+    size_t depth = (size_t)__builtin_popcountll(tree->count);
+    for (uint64_t bits = tree->count; bits & 1; bits >>= 1) {
+        merkle_node(tree->stack[--depth], hash, hash);
+    }
+    memcpy(tree->stack[depth], hash, sizeof(hash));
+    tree->count++;
+}
+
+// Root of the leaves added so far; -1 if there are none
+int lrs_merkle_final(const lrs_merkle_t *tree, uint8_t root[LRS_MERKLE_HASH_BYTES]) {
+    size_t depth = (size_t)__builtin_popcountll(tree->count);
+    if (depth == 0) return -1;
+
+    // Fold the subtrees right to left
+    memcpy(root, tree->stack[depth - 1], LRS_MERKLE_HASH_BYTES);
+    while (--depth > 0) {
+        merkle_node(tree->stack[depth - 1], root, root);
+    }
+    return 0;
+}
+
+// Check a proof that `leaf` is leaf `index` of the tree of `count` leaves with this root
+// (RFC 9162, 2.1.3.2)
+int lrs_merkle_verify(const uint8_t root[LRS_MERKLE_HASH_BYTES], uint64_t count, uint64_t index,
+                      const uint8_t leaf[LRS_MERKLE_HASH_BYTES],
+                      const uint8_t proof[][LRS_MERKLE_HASH_BYTES], size_t proof_len) {
+    if (index >= count) return -1;
+
+    uint64_t fn = index, sn = count - 1;
+    uint8_t hash[LRS_MERKLE_HASH_BYTES];
+    memcpy(hash, leaf, sizeof(hash));
+    for (size_t i = 0; i < proof_len; i++) {
+        if (sn == 0) return -1;
+        if ((fn & 1) || fn == sn) {
+            merkle_node(proof[i], hash, hash);
+            while (!(fn & 1) && fn != 0) {
+                fn >>= 1;
+                sn >>= 1;
+            }
+        } else {
+            merkle_node(hash, proof[i], hash);
+        }
+        fn >>= 1;
+        sn >>= 1;
+    }
+
+    return sn == 0 && sodium_memcmp(hash, root, LRS_MERKLE_HASH_BYTES) == 0 ? 0 : -1;
+}
+
+// Root of leaves[0..count)
+static void subtree_root(const uint8_t (*leaves)[LRS_MERKLE_HASH_BYTES], uint64_t count,
+                         uint8_t out[LRS_MERKLE_HASH_BYTES]) {
+    lrs_merkle_t tree;
+    lrs_merkle_init(&tree);
+    for (uint64_t i = 0; i < count; i++) {
+        lrs_merkle_add(&tree, leaves[i]);
+    }
+    lrs_merkle_final(&tree, out);
+}
+
+// Audit path of leaf `index`, leaf level first
+static size_t audit_path(const uint8_t (*leaves)[LRS_MERKLE_HASH_BYTES], uint64_t count, uint64_t index,
+                         uint8_t proof[][LRS_MERKLE_HASH_BYTES]) {
+    if (count <= 1) return 0;
+
+    uint64_t split = 1;
+    while (split * 2 < count) split *= 2;
+
+    size_t length;
+    if (index < split) {
+        length = audit_path(leaves, split, index, proof);
+        subtree_root(leaves + split, count - split, proof[length]);
+    } else {
+        length = audit_path(leaves + split, count - split, index - split, proof);
+        subtree_root(leaves, split, proof[length]);
+    }
+    return length + 1;
+}
+
+// A v3 container mapped for reading its chunk tags
+typedef struct {
+    uint8_t *map;
+    size_t map_len;
+    const uint8_t *chunks;        // First sealed chunk
+    size_t sealed_size;
+    uint64_t chunk_count;
+    size_t last_sealed;           // Sealed length of the last chunk
+    uint8_t root[LRS_MERKLE_HASH_BYTES];
+    int has_root;
+    uint8_t (*leaves)[LRS_MERKLE_HASH_BYTES];
+} chunk_file_t;
+
+static const uint8_t *chunk_tag(const chunk_file_t *file, uint64_t index) {
+    size_t sealed = index == file->chunk_count - 1 ? file->last_sealed : file->sealed_size;
+    return file->chunks + index * file->sealed_size + sealed - crypto_aead_xchacha20poly1305_ietf_ABYTES;
+}
+
+static void hash_leaves(void *arg, size_t task) {
+    chunk_file_t *file = (chunk_file_t*)arg;
+    uint64_t end = (uint64_t)(task + 1) * LEAVES_PER_TASK;
+    if (end > file->chunk_count) end = file->chunk_count;
+
+    for (uint64_t i = (uint64_t)task * LEAVES_PER_TASK; i < end; i++) {
+        lrs_merkle_leaf(i, chunk_tag(file, i), file->leaves[i]);
+    }
+}
+
+static void chunk_file_close(chunk_file_t *file) {
+    lrs_free(file->leaves);
+    if (file->map) munmap(file->map, file->map_len);
+}
+
+// Map a v3 container and hash the leaves of its chunks on `threads` threads
+// Returns 0, -1 on I/O errors, the check_header codes, or -9 for a bad chunk layout
+static int chunk_file_open(chunk_file_t *file, const char *path, unsigned threads) {
+    memset(file, 0, sizeof(*file));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(header_t)) {
+        close(fd);
+        return -1;
+    }
+    file->map_len = (size_t)st.st_size;
+    file->map = (uint8_t*)mmap(NULL, file->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file->map == MAP_FAILED) {
+        file->map = NULL;
+        return -1;
+    }
+
+    header_t header;
+    memcpy(&header, file->map, sizeof(header));
+    if (memcmp(header.magic, MAGIC, 3) != 0) return -1;
+    if (header_layout(&header) != VERSION_STREAM) return -2;
+
+    size_t tlv_len = ntohs(header.tlv_len);
+    if (sizeof(header) + tlv_len > file->map_len) return -1;
+    const uint8_t *tlv_data = file->map + sizeof(header);
+
+    uint8_t length = 0;
+    const uint8_t *value = find_tlv(tlv_data, tlv_len, TLV_CHUNK_SIZE, &length);
+    uint32_t chunk_size_be = 0;
+    if (value && length == 4) memcpy(&chunk_size_be, value, 4);
+    uint32_t chunk_size = ntohl(chunk_size_be);
+    if (chunk_size == 0 || chunk_size > LRS_CHUNK_SIZE_MAX) return -9;
+
+    value = find_tlv(tlv_data, tlv_len, TLV_CHUNK_ROOT, &length);
+    if (value && length == LRS_MERKLE_HASH_BYTES) {
+        memcpy(file->root, value, LRS_MERKLE_HASH_BYTES);
+        file->has_root = 1;
+    }
+
+    // Every chunk but the last is full, the last holds at least its tag
+    file->chunks = tlv_data + tlv_len;
+    file->sealed_size = (size_t)chunk_size + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    size_t data_len = file->map_len - sizeof(header) - tlv_len;
+    file->chunk_count = (data_len + file->sealed_size - 1) / file->sealed_size;
+    if (file->chunk_count == 0) return -9;
+    file->last_sealed = data_len - (file->chunk_count - 1) * file->sealed_size;
+    if (file->last_sealed < crypto_aead_xchacha20poly1305_ietf_ABYTES) return -9;
+
+    file->leaves = (uint8_t(*)[LRS_MERKLE_HASH_BYTES])lrs_alloc(file->chunk_count * LRS_MERKLE_HASH_BYTES);
+    if (!file->leaves) return -1;
+    madvise(file->map, file->map_len, MADV_SEQUENTIAL);
+    lrs_parallel_for(threads, (file->chunk_count + LEAVES_PER_TASK - 1) / LEAVES_PER_TASK, hash_leaves, file);
+    return 0;
+}
+
+// Recompute a v3 container's chunk root and compare it with the one it records
+// (unauthenticated here: a match rules out corruption, not tampering)
+// Returns 0 if they match, -8 if they differ, -9 if the file records no root or
+// has a bad chunk layout, -2 for other versions or -1 on I/O errors
+int lrs_merkle_check_file(const char *path, uint8_t root[LRS_MERKLE_HASH_BYTES], unsigned threads) {
+    if (!path) return -1;
+
+    chunk_file_t file;
+    int result = chunk_file_open(&file, path, threads);
+    if (result == 0 && !file.has_root) result = -9;
+
+    uint8_t computed[LRS_MERKLE_HASH_BYTES];
+    if (result == 0) {
+        subtree_root((const uint8_t(*)[LRS_MERKLE_HASH_BYTES])file.leaves, file.chunk_count, computed);
+        result = sodium_memcmp(computed, file.root, sizeof(computed)) == 0 ? 0 : -8;
+    }
+    if (result == 0 && root) {
+        memcpy(root, file.root, sizeof(file.root));
+    }
+
+    chunk_file_close(&file);
+    return result;
+}
+
+// Proof that chunk `index` belongs to a v3 container: its tag, the audit path
+// (at most LRS_MERKLE_PROOF_MAX hashes) and the chunk count, for lrs_merkle_verify
+// with lrs_merkle_leaf(index, tag). Error codes as for lrs_merkle_check_file.
+int lrs_merkle_proof_file(const char *path, uint64_t index,
+                          uint8_t tag[crypto_aead_xchacha20poly1305_ietf_ABYTES],
+                          uint8_t proof[LRS_MERKLE_PROOF_MAX][LRS_MERKLE_HASH_BYTES], size_t *proof_len,
+                          uint64_t *chunk_count) {
+    if (!path || !tag || !proof || !proof_len) return -1;
+
+    chunk_file_t file;
+    int result = chunk_file_open(&file, path, 0);
+    if (result == 0 && index >= file.chunk_count) result = -1;
+
+    if (result == 0) {
+        memcpy(tag, chunk_tag(&file, index), crypto_aead_xchacha20poly1305_ietf_ABYTES);
+        *proof_len = audit_path((const uint8_t(*)[LRS_MERKLE_HASH_BYTES])file.leaves, file.chunk_count,
+                                index, proof);
+        if (chunk_count) *chunk_count = file.chunk_count;
+    }
+
+    chunk_file_close(&file);
+    return result;
+}
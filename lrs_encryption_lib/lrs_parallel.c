@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "lrs_encryption_lib.h"
+
+// Fork-join worker pool
+// The calling thread takes part in every job, so a pool of N threads runs
+// N-1 workers; items are handed out one at a time from a shared counter so
+// uneven items balance themselves across threads
+struct lrs_pool {
+    const lrs_allocator_t *allocator;
+    pthread_t *workers;
+    unsigned worker_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+
+    // Current job (guarded by lock, except next which is claimed atomically)
+    void (*fn)(void *arg, size_t index);
+    void *arg;
+    size_t count;
+    size_t next;
+    size_t finished;
+    unsigned generation;
+    unsigned active;
+    int shutdown;
+};
+
+// Number of CPUs available to the process
+unsigned lrs_cpu_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (unsigned)cpus : 1;
+}
+
+// Claim and run items until the job is exhausted; returns the number run
+// The job can't be replaced while a thread runs it (the caller waits for
+// active == 0), so count is read from the pool itself
+static size_t run_items(lrs_pool_t *pool, void (*fn)(void *, size_t), void *arg) {
+    size_t done = 0;
+
+    for (;;) {
+        size_t index = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if (index >= pool->count) break;
+
+        fn(arg, index);
+        done++;
+    }
+
+    return done;
+}
+
+static void *pool_worker(void *ptr) {
+    lrs_pool_t *pool = (lrs_pool_t*)ptr;
+    unsigned seen_generation = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen_generation) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->shutdown) break;
+
+        // A worker that wakes after the caller has finished the job alone must
+        // not join it: the caller may already be publishing the next one
+        seen_generation = pool->generation;
+        if (__atomic_load_n(&pool->next, __ATOMIC_RELAXED) >= pool->count) continue;
+
+        // Snapshot the job while holding the lock
+        void (*fn)(void *, size_t) = pool->fn;
+        void *arg = pool->arg;
+        pool->active++;
+        pthread_mutex_unlock(&pool->lock);
+
+        size_t done = run_items(pool, fn, arg);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active--;
+        pool->finished += done;
+        if (pool->active == 0 && pool->finished >= pool->count) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+// Create a pool of `threads` threads (including the caller); 0 means one per CPU
+lrs_pool_t *lrs_pool_create(unsigned threads) {
+    if (threads == 0) threads = lrs_cpu_count();
+
+    const lrs_allocator_t *allocator = lrs_current_allocator();
+    lrs_pool_t *pool = (lrs_pool_t*)allocator->alloc(allocator->ctx, sizeof(lrs_pool_t));
+    if (!pool) return NULL;
+    memset(pool, 0, sizeof(lrs_pool_t));
+    pool->allocator = allocator;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    if (threads > 1) {
+        pool->workers = (pthread_t*)allocator->alloc(allocator->ctx, (threads - 1) * sizeof(pthread_t));
+        if (!pool->workers) {
+            lrs_pool_destroy(pool);
+            return NULL;
+        }
+
+        for (unsigned i = 0; i < threads - 1; i++) {
+            if (pthread_create(&pool->workers[i], NULL, pool_worker, pool) != 0) {
+                break; // Run with the workers we did get
+            }
+            pool->worker_count++;
+        }
+    }
+
+    return pool;
+}
+
+// Run fn(arg, i) for every i in [0, count) and wait for all of them
+// A NULL pool runs the items inline on the calling thread
+void lrs_pool_run(lrs_pool_t *pool, size_t count, void (*fn)(void *arg, size_t index), void *arg) {
+    if (count == 0) return;
+
+    if (!pool || pool->worker_count == 0) {
+        for (size_t i = 0; i < count; i++) {
+            fn(arg, i);
+        }
+        return;
+    }
+
+    // Publish the job and wake the workers
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->count = count;
+    pool->next = 0;
+    pool->finished = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    // Work alongside them
+    size_t done = run_items(pool, fn, arg);
+
+    // Wait until every item ran and no worker still references the job
+    pthread_mutex_lock(&pool->lock);
+    pool->finished += done;
+    while (pool->finished < pool->count || pool->active > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Number of threads (including the caller) that run a job
+unsigned lrs_pool_size(const lrs_pool_t *pool) {
+    return pool ? pool->worker_count + 1 : 1;
+}
+
+// Stop the workers and free the pool
+void lrs_pool_destroy(lrs_pool_t *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned i = 0; i < pool->worker_count; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    if (pool->workers) {
+        pool->allocator->free(pool->allocator->ctx, pool->workers);
+    }
+    pool->allocator->free(pool->allocator->ctx, pool);
+}
+
+// Convenience wrapper: run a single job on a temporary pool
+void lrs_parallel_for(unsigned threads, size_t count, void (*fn)(void *arg, size_t index), void *arg) {
+    if (threads == 0) threads = lrs_cpu_count();
+    if (threads > count) threads = (unsigned)count;
+
+    if (threads <= 1) {
+        lrs_pool_run(NULL, count, fn, arg);
+        return;
+    }
+
+    lrs_pool_t *pool = lrs_pool_create(threads);
+    lrs_pool_run(pool, count, fn, arg);
+    lrs_pool_destroy(pool);
+}
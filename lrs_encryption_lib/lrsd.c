@@ -0,0 +1,766 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <sodium.h>
+#include "lrs_encryption_lib.h"
+#include "lrs_client.h"
+
+// lrsd: encrypt/decrypt service on a Unix domain socket (protocol in lrs_client.h)
+//
+// One epoll thread watches the listening socket and every connection. A readable
+// connection is queued for a fixed set of workers; EPOLLONESHOT keeps it with one
+// worker until re-armed, so its responses stay in request order. The worker reads
+// what has arrived, answers every complete request and writes the responses back.
+// What the client is not ready to take stays on the connection, which is re-armed
+// for EPOLLOUT and not read from until it is sent, so a client that stops reading
+// holds neither a worker nor more of the daemon's memory.
+// Consecutive requests with the same operation and key are handled as one
+// encrypt_blob_batch/decrypt_blob_batch call.
+//
+// Keys are held as sessions: the first request for a password runs Argon2id once,
+// later ones derive a subkey with crypto_kdf. Workers live as long as the daemon,
+// so their KDF arenas stay mapped between derivations.
+
+#define LRSD_SESSIONS_MAX 64
+#define LRSD_SESSION_IDLE_S 600
+#define LRSD_BATCH_MAX 256
+#define LRSD_READ_SIZE (64 * 1024)
+#define LRSD_TURN_BYTES (1024 * 1024)  // Read at most this much per turn, for fairness
+
+// A cached session, found by a keyed hash of the key mode and key material
+typedef struct session_slot {
+    uint8_t id[crypto_generichash_BYTES];
+    lrs_session_t session;
+    unsigned refs;
+    time_t last_used;
+    int used;
+    int cached;                   // 0: temporary, closed on release
+} session_slot_t;
+
+typedef struct conn {
+    int fd;
+    uint8_t *in;
+    size_t in_len;
+    size_t in_cap;
+    uint8_t *out;
+    size_t out_len;
+    size_t out_sent;              // Written so far; the rest waits for EPOLLOUT
+    size_t out_cap;
+    int eof;                      // Nothing more to read: answer, flush and close
+    struct conn *next;            // Ready queue
+} conn_t;
+
+// One parsed request, pointing into the connection's input buffer
+typedef struct {
+    uint8_t op;
+    uint8_t key_mode;
+    uint32_t id;
+    const uint8_t *key;
+    size_t key_len;
+    const uint8_t *aad;
+    size_t aad_len;
+    const uint8_t *data;
+    size_t data_len;
+} request_t;
+
+// Key material of a request in the form the library takes
+typedef struct {
+    int mode;
+    char password[LRSD_KEY_MAX + 1];
+    uint32_t raw[8];
+} request_key_t;
+
+typedef struct {
+    uint8_t *scratch;             // Batch output arena
+    size_t scratch_cap;
+    lrs_batch_item_t items[LRSD_BATCH_MAX];
+    lrs_batch_result_t results[LRSD_BATCH_MAX];
+    request_t requests[LRSD_BATCH_MAX];
+} worker_t;
+
+static struct {
+    int epoll_fd;
+    int listen_fd;
+    int stop_pipe[2];
+
+    pthread_mutex_t lock;         // Ready queue
+    pthread_cond_t ready;
+    conn_t *head;
+    conn_t *tail;
+    int shutdown;
+
+    pthread_mutex_t sessions_lock;
+    session_slot_t sessions[LRSD_SESSIONS_MAX];
+    uint8_t session_hash_key[crypto_generichash_KEYBYTES];
+
+    lrsd_stats_t stats;           // Updated atomically
+    struct timespec started;
+} server = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .ready = PTHREAD_COND_INITIALIZER,
+    .sessions_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+#define STAT_ADD(field, n) __atomic_fetch_add(&server.stats.field, (uint64_t)(n), __ATOMIC_RELAXED)
+
+// Map a session open failure onto the decrypt_blob_ex error codes
+static int session_error(int result) {
+    if (result == -11) return -11; // Memory budget exhausted
+    if (result == -1) return -6;   // Invalid key mode
+    return -7;                     // Key derivation failed
+}
+
+// Turn a request's key bytes into library key material; 0 or -6
+static int load_key(const request_t *request, request_key_t *key) {
+    key->mode = request->key_mode;
+    if (request->key_mode == KEY_MODE_PASSWORD) {
+        if (request->key_len == 0 || memchr(request->key, '\0', request->key_len)) return -6;
+        memcpy(key->password, request->key, request->key_len);
+        key->password[request->key_len] = '\0';
+        return 0;
+    }
+    if (request->key_mode == KEY_MODE_RAW_KEY && request->key_len == sizeof(key->raw)) {
+        memcpy(key->raw, request->key, sizeof(key->raw));
+        return 0;
+    }
+    return -6; // Invalid key mode
+}
+
+static const void *key_material(const request_key_t *key) {
+    return key->mode == KEY_MODE_PASSWORD ? (const void*)key->password : (const void*)key->raw;
+}
+
+// Find the cached session for a key or, with `create`, open one
+// Returns a referenced slot, or NULL with *status set (0 if merely not cached)
+static session_slot_t *session_acquire(const request_t *request, const request_key_t *key, int create, int *status) {
+    uint8_t id[crypto_generichash_BYTES];
+    uint8_t mode = request->key_mode;
+    crypto_generichash_state state;
+    crypto_generichash_init(&state, server.session_hash_key, sizeof(server.session_hash_key), sizeof(id));
+    crypto_generichash_update(&state, &mode, 1);
+    crypto_generichash_update(&state, request->key, request->key_len);
+    crypto_generichash_final(&state, id, sizeof(id));
+    *status = 0;
+
+    time_t now = time(NULL);
+    session_slot_t *found = NULL;
+    pthread_mutex_lock(&server.sessions_lock);
+    for (size_t i = 0; i < LRSD_SESSIONS_MAX; i++) {
+        session_slot_t *slot = &server.sessions[i];
+        if (!slot->used) continue;
+        if (sodium_memcmp(slot->id, id, sizeof(id)) == 0) {
+            found = slot;
+        } else if (slot->refs == 0 && now - slot->last_used > LRSD_SESSION_IDLE_S) {
+            lrs_session_close(&slot->session);
+            slot->used = 0;
+            STAT_ADD(sessions, -1);
+        }
+    }
+    if (found) {
+        found->refs++;
+        found->last_used = now;
+        STAT_ADD(session_hits, 1);
+    }
+    pthread_mutex_unlock(&server.sessions_lock);
+    if (found || !create) return found;
+
+    // Derive outside the lock; another worker may be doing the same
+    lrs_session_t session;
+    int result = lrs_session_open(&session, key_material(key), key->mode);
+    if (result != 0) {
+        *status = session_error(result);
+        return NULL;
+    }
+    STAT_ADD(session_opens, 1);
+
+    pthread_mutex_lock(&server.sessions_lock);
+    session_slot_t *free_slot = NULL;
+    session_slot_t *oldest = NULL;
+    for (size_t i = 0; i < LRSD_SESSIONS_MAX && !found; i++) {
+        session_slot_t *slot = &server.sessions[i];
+        if (!slot->used) {
+            if (!free_slot) free_slot = slot;
+        } else if (sodium_memcmp(slot->id, id, sizeof(id)) == 0) {
+            found = slot;
+        } else if (slot->refs == 0 && (!oldest || slot->last_used < oldest->last_used)) {
+            oldest = slot;
+        }
+    }
+    if (found) {
+        lrs_session_close(&session);
+    } else {
+        found = free_slot ? free_slot : oldest;
+        if (found) {
+            if (found->used) {
+                lrs_session_close(&found->session);
+            } else {
+                STAT_ADD(sessions, 1);
+            }
+            found->cached = 1;
+        } else {
+            // Every slot is in use: serve this request from a temporary session
+            found = (session_slot_t*)calloc(1, sizeof(session_slot_t));
+            if (!found) {
+                pthread_mutex_unlock(&server.sessions_lock);
+                lrs_session_close(&session);
+                *status = -1;
+                return NULL;
+            }
+        }
+        memcpy(found->id, id, sizeof(id));
+        found->session = session;
+        found->used = 1;
+        found->refs = 0;
+    }
+    found->refs++;
+    found->last_used = now;
+    pthread_mutex_unlock(&server.sessions_lock);
+
+    return found;
+}
+
+static void session_release(session_slot_t *slot) {
+    if (!slot) return;
+
+    pthread_mutex_lock(&server.sessions_lock);
+    slot->refs--;
+    int temporary = !slot->cached;
+    pthread_mutex_unlock(&server.sessions_lock);
+
+    if (temporary) {
+        lrs_session_close(&slot->session);
+        free(slot);
+    }
+}
+
+// Grow a buffer to hold at least `needed` bytes
+static int reserve_buffer(uint8_t **buf, size_t *cap, size_t needed) {
+    if (needed <= *cap) return 0;
+
+    size_t new_cap = *cap ? *cap : LRSD_READ_SIZE;
+    while (new_cap < needed) new_cap *= 2;
+    uint8_t *grown = (uint8_t*)realloc(*buf, new_cap);
+    if (!grown) return -1;
+
+    *buf = grown;
+    *cap = new_cap;
+    return 0;
+}
+
+// Append a response to the connection's output buffer
+static int append_response(conn_t *conn, const request_t *request, int status,
+                           const uint8_t *data, size_t len) {
+    if (reserve_buffer(&conn->out, &conn->out_cap, conn->out_len + LRSD_RESPONSE_HEADER_SIZE + len) != 0) {
+        return -1;
+    }
+    if (status != 0) len = 0;
+
+    uint8_t *p = conn->out + conn->out_len;
+    uint16_t status_n = htons((uint16_t)(int16_t)status);
+    uint32_t id_n = htonl(request->id);
+    uint32_t len_n = htonl((uint32_t)len);
+    p[0] = request->op;
+    p[1] = 0;
+    memcpy(p + 2, &status_n, 2);
+    memcpy(p + 4, &id_n, 4);
+    memcpy(p + 8, &len_n, 4);
+    if (len) memcpy(p + LRSD_RESPONSE_HEADER_SIZE, data, len);
+    conn->out_len += LRSD_RESPONSE_HEADER_SIZE + len;
+
+    STAT_ADD(requests, 1);
+    STAT_ADD(bytes_in, request->aad_len + request->data_len);
+    STAT_ADD(bytes_out, len);
+    if (status != 0) STAT_ADD(errors, 1);
+    return 0;
+}
+
+static uint64_t uptime_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - server.started.tv_sec) * 1000 +
+           (uint64_t)((now.tv_nsec - server.started.tv_nsec) / 1000000);
+}
+
+static int answer_stats(conn_t *conn, const request_t *request) {
+    lrsd_stats_t stats;
+    uint64_t *fields = (uint64_t*)&stats;
+    const uint64_t *counters = (const uint64_t*)&server.stats;
+    for (size_t i = 0; i < sizeof(stats) / sizeof(uint64_t); i++) {
+        fields[i] = __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+    }
+    stats.uptime_ms = uptime_ms();
+
+    uint8_t data[sizeof(stats)];
+    for (size_t i = 0; i < sizeof(stats) / sizeof(uint64_t); i++) {
+        for (int b = 0; b < 8; b++) data[i * 8 + b] = (uint8_t)(fields[i] >> (56 - 8 * b));
+    }
+    return append_response(conn, request, 0, data, sizeof(data));
+}
+
+// Decrypt a blob that is not from the cached session with the key itself
+static int open_foreign_blob(const request_t *request, const request_key_t *key, uint8_t *pt, size_t *pt_len) {
+    header_t hdr;
+    if (request->data_len < sizeof(hdr)) return -5;
+    memcpy(&hdr, request->data, sizeof(hdr));
+
+    size_t tlv_len = header_layout(&hdr) >= 2 ? ntohs(hdr.tlv_len) : 0;
+    if (request->data_len - sizeof(hdr) < tlv_len) return -5;
+    const uint8_t *tlv = request->data + sizeof(hdr);
+
+    return decrypt_blob_ex(tlv + tlv_len, request->data_len - sizeof(hdr) - tlv_len, key_material(key),
+                           key->mode, request->aad, request->aad_len, &hdr, tlv_len ? tlv : NULL,
+                           tlv_len, pt, pt_len);
+}
+
+// Answer requests[0..count), which share their operation and key
+static int answer_run(worker_t *worker, conn_t *conn, const request_t *requests, size_t count) {
+    const request_t *first = &requests[0];
+    int encrypting = first->op == LRSD_OP_ENCRYPT;
+    for (size_t i = 0; i < count; i++) {
+        worker->items[i] = (lrs_batch_item_t){
+            requests[i].data, requests[i].data_len, requests[i].aad, requests[i].aad_len
+        };
+    }
+
+    request_key_t key;
+    int status = load_key(first, &key);
+    session_slot_t *slot = NULL;
+    if (status == 0) {
+        // Decryption never opens a session: foreign blobs go through the key cache
+        slot = session_acquire(first, &key, encrypting, &status);
+    }
+
+    size_t arena_size = encrypting ? lrs_batch_encrypted_size(worker->items, count)
+                                   : lrs_batch_decrypted_size(worker->items, count);
+    if (status == 0 && reserve_buffer(&worker->scratch, &worker->scratch_cap, arena_size ? arena_size : 1) != 0) {
+        status = -1;
+    }
+
+    if (status == 0) {
+        if (encrypting) {
+            int failed = encrypt_blob_batch(&slot->session, worker->items, count, worker->scratch,
+                                            worker->scratch_cap, worker->results, 1);
+            if (failed < 0) status = failed;
+        } else {
+            int failed = slot ? decrypt_blob_batch(&slot->session, worker->items, count, worker->scratch,
+                                                   worker->scratch_cap, worker->results, 1) : 0;
+            if (failed < 0) status = failed;
+
+            // Place and open whatever the session could not
+            size_t offset = 0;
+            for (size_t i = 0; i < count && status == 0; i++) {
+                lrs_batch_result_t *result = &worker->results[i];
+                if (!slot) {
+                    result->offset = offset;
+                    result->status = -10;
+                }
+                offset += lrs_batch_decrypted_size(&worker->items[i], 1);
+                if (result->status == -10) {
+                    result->status = open_foreign_blob(&requests[i], &key, worker->scratch + result->offset,
+                                                       &result->len);
+                }
+            }
+        }
+    }
+    session_release(slot);
+    sodium_memzero(&key, sizeof(key));
+
+    for (size_t i = 0; i < count; i++) {
+        const lrs_batch_result_t *result = &worker->results[i];
+        int item_status = status != 0 ? status : result->status;
+        if (append_response(conn, &requests[i], item_status,
+                            item_status == 0 ? worker->scratch + result->offset : NULL,
+                            item_status == 0 ? result->len : 0) != 0) {
+            return -1;
+        }
+    }
+
+    // Plaintext passed through the scratch arena
+    if (!encrypting && arena_size) sodium_memzero(worker->scratch, arena_size);
+    return 0;
+}
+
+// Parse one request at the start of buf; returns its size, 0 if incomplete or -1 if malformed
+static long parse_request(const uint8_t *buf, size_t len, request_t *request) {
+    if (len < LRSD_REQUEST_HEADER_SIZE) return 0;
+
+    uint16_t key_len_n;
+    uint32_t id_n, aad_len_n, data_len_n;
+    memcpy(&key_len_n, buf + 2, 2);
+    memcpy(&id_n, buf + 4, 4);
+    memcpy(&aad_len_n, buf + 8, 4);
+    memcpy(&data_len_n, buf + 12, 4);
+    request->op = buf[0];
+    request->key_mode = buf[1];
+    request->id = ntohl(id_n);
+    request->key_len = ntohs(key_len_n);
+    request->aad_len = ntohl(aad_len_n);
+    request->data_len = ntohl(data_len_n);
+    if (request->key_len > LRSD_KEY_MAX || request->aad_len > LRSD_PAYLOAD_MAX ||
+        request->data_len > LRSD_PAYLOAD_MAX - request->aad_len) {
+        return -1;
+    }
+
+    size_t size = LRSD_REQUEST_HEADER_SIZE + request->key_len + request->aad_len + request->data_len;
+    if (len < size) return 0;
+
+    request->key = buf + LRSD_REQUEST_HEADER_SIZE;
+    request->aad = request->key + request->key_len;
+    request->data = request->aad + request->aad_len;
+    return (long)size;
+}
+
+static int same_key(const request_t *a, const request_t *b) {
+    return a->op == b->op && a->key_mode == b->key_mode && a->key_len == b->key_len &&
+           sodium_memcmp(a->key, b->key, a->key_len) == 0;
+}
+
+// Answer every complete request in the input buffer; -1 on a protocol error
+static int answer_requests(worker_t *worker, conn_t *conn) {
+    size_t consumed = 0;
+
+    for (;;) {
+        size_t count = 0;
+        while (count < LRSD_BATCH_MAX) {
+            long size = parse_request(conn->in + consumed, conn->in_len - consumed, &worker->requests[count]);
+            if (size < 0) return -1;
+            if (size == 0) break;
+            consumed += (size_t)size;
+            count++;
+        }
+        if (count == 0) break;
+
+        for (size_t start = 0; start < count;) {
+            const request_t *request = &worker->requests[start];
+            size_t end = start + 1;
+            int result;
+
+            if (request->op == LRSD_OP_STATS) {
+                result = answer_stats(conn, request);
+            } else if (request->op == LRSD_OP_ENCRYPT || request->op == LRSD_OP_DECRYPT) {
+                while (end < count && same_key(request, &worker->requests[end])) end++;
+                result = answer_run(worker, conn, request, end - start);
+            } else {
+                result = append_response(conn, request, -1, NULL, 0); // Unknown operation
+            }
+            if (result != 0) return -1;
+            start = end;
+        }
+    }
+
+    // Keep the start of an incomplete request
+    memmove(conn->in, conn->in + consumed, conn->in_len - consumed);
+    conn->in_len -= consumed;
+    return 0;
+}
+
+// Write as much of the output buffer as the socket takes
+// Returns 0 once it is all sent, 1 if the rest has to wait for the client, -1 on errors
+static int flush_output(conn_t *conn) {
+    while (conn->out_sent < conn->out_len) {
+        ssize_t written = send(conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent,
+                               MSG_NOSIGNAL);
+        if (written > 0) {
+            conn->out_sent += (size_t)written;
+        } else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 1;
+        } else if (written < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return -1;
+        }
+    }
+
+    conn->out_len = 0;
+    conn->out_sent = 0;
+    return 0;
+}
+
+static void close_connection(conn_t *conn) {
+    close(conn->fd);
+    free(conn->in);
+    free(conn->out);
+    free(conn);
+    STAT_ADD(active_connections, -1);
+}
+
+// Serve one readiness event: send what is pending, then read, answer, write,
+// re-arm (for EPOLLOUT while output is left over)
+static void serve_connection(worker_t *worker, conn_t *conn) {
+    int pending = flush_output(conn);
+    size_t turn = 0;
+
+    while (pending == 0 && !conn->eof && turn < LRSD_TURN_BYTES) {
+        if (reserve_buffer(&conn->in, &conn->in_cap, conn->in_len + LRSD_READ_SIZE) != 0) {
+            conn->eof = 1;
+            break;
+        }
+        ssize_t got = read(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len);
+        if (got > 0) {
+            conn->in_len += (size_t)got;
+            turn += (size_t)got;
+        } else if (got < 0 && errno == EINTR) {
+            continue;
+        } else {
+            conn->eof = got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+            break;
+        }
+    }
+
+    if (pending == 0) {
+        pending = answer_requests(worker, conn) != 0 ? -1 : flush_output(conn);
+    }
+    if (pending < 0 || (pending == 0 && conn->eof)) {
+        close_connection(conn);
+        return;
+    }
+
+    struct epoll_event event = { .events = (pending ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT, .data.ptr = conn };
+    if (epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) != 0) {
+        close_connection(conn);
+    }
+}
+
+static void *worker_main(void *arg) {
+    (void)arg;
+    worker_t *worker = (worker_t*)calloc(1, sizeof(worker_t));
+    if (!worker) return NULL;
+    lrs_kdf_arena_enable();
+
+    pthread_mutex_lock(&server.lock);
+    for (;;) {
+        while (!server.shutdown && !server.head) {
+            pthread_cond_wait(&server.ready, &server.lock);
+        }
+        if (server.shutdown) break;
+
+        conn_t *conn = server.head;
+        server.head = conn->next;
+        if (!server.head) server.tail = NULL;
+        pthread_mutex_unlock(&server.lock);
+
+        serve_connection(worker, conn);
+
+        pthread_mutex_lock(&server.lock);
+    }
+    pthread_mutex_unlock(&server.lock);
+
+    lrs_kdf_arena_disable();
+    free(worker->scratch);
+    free(worker);
+    return NULL;
+}
+
+static void queue_connection(conn_t *conn) {
+    pthread_mutex_lock(&server.lock);
+    conn->next = NULL;
+    if (server.tail) {
+        server.tail->next = conn;
+    } else {
+        server.head = conn;
+    }
+    server.tail = conn;
+    pthread_cond_signal(&server.ready);
+    pthread_mutex_unlock(&server.lock);
+}
+
+static void accept_connections(void) {
+    for (;;) {
+        int fd = accept4(server.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+
+        conn_t *conn = (conn_t*)calloc(1, sizeof(conn_t));
+        struct epoll_event event = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = conn };
+        if (!conn || epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        STAT_ADD(connections, 1);
+        STAT_ADD(active_connections, 1);
+    }
+}
+
+static void handle_stop(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    if (write(server.stop_pipe[1], "x", 1) < 0) {
+        // Nothing to do; the daemon is stopping anyway
+    }
+    errno = saved_errno;
+}
+
+// Bind the listening socket, replacing a stale one but not a live daemon's
+static int listen_on(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 && errno == EADDRINUSE) {
+        lrs_client_t *live = lrs_client_connect(path);
+        if (live) {
+            lrs_client_close(live);
+            close(fd);
+            return -2;
+        }
+        unlink(path);
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    if (listen(fd, 128) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    if (sodium_init() < 0) {
+        printf("Error initializing libsodium\n");
+        return 1;
+    }
+
+    unsigned threads = lrs_cpu_count() < 4 ? 4 : lrs_cpu_count();
+    size_t budget_mib = 0;
+    lrs_kdf_params_t kdf_params;
+    lrs_kdf_params_default(&kdf_params);
+    int arg = 1;
+    while (arg + 1 < argc && strncmp(argv[arg], "--", 2) == 0) {
+        char *end;
+        unsigned long value = strtoul(argv[arg + 1], &end, 10);
+        if (*end != '\0' || value == 0) {
+            printf("Error: Invalid value for %s\n", argv[arg]);
+            return 1;
+        }
+        if (strcmp(argv[arg], "--threads") == 0 && value <= 1024) {
+            threads = (unsigned)value;
+        } else if (strcmp(argv[arg], "--memory-mib") == 0) {
+            budget_mib = value;
+        } else if (strcmp(argv[arg], "--ops") == 0 && value <= UINT32_MAX) {
+            kdf_params.ops = (uint32_t)value;
+        } else if (strcmp(argv[arg], "--mem-kib") == 0 && value <= UINT32_MAX) {
+            kdf_params.mem_limit_kib = (uint32_t)value;
+        } else if (strcmp(argv[arg], "--parallelism") == 0 && value <= UINT32_MAX) {
+            kdf_params.parallelism = (uint32_t)value;
+        } else {
+            printf("Error: Unknown option %s\n", argv[arg]);
+            return 1;
+        }
+        arg += 2;
+    }
+    if (arg != argc - 1) {
+        printf("Usage: %s [--threads N] [--memory-mib N] [--ops N] [--mem-kib N] [--parallelism N] <socket_path>\n",
+               argv[0]);
+        return 1;
+    }
+    if (lrs_set_kdf_params(&kdf_params) != 0) {
+        printf("Error: Invalid KDF parameters\n");
+        return 1;
+    }
+    const char *socket_path = argv[arg];
+
+    // Only the owner may connect
+    umask(077);
+    server.listen_fd = listen_on(socket_path);
+    if (server.listen_fd < 0) {
+        printf(server.listen_fd == -2 ? "Error: Another lrsd is serving %s\n"
+                                      : "Error: Cannot listen on %s\n", socket_path);
+        return 1;
+    }
+
+    // Sessions cover encryption; foreign blobs reuse derived keys for a while
+    randombytes_buf(server.session_hash_key, sizeof(server.session_hash_key));
+    lrs_key_cache_enable(LRSD_SESSIONS_MAX, LRSD_SESSION_IDLE_S);
+    if (budget_mib) lrs_memory_set_budget(budget_mib * 1024 * 1024, -1);
+    clock_gettime(CLOCK_MONOTONIC, &server.started);
+
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server.epoll_fd < 0 || pipe2(server.stop_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        printf("Error: Cannot set up event loop\n");
+        unlink(socket_path);
+        return 1;
+    }
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &event);
+    event.data.ptr = &server.stop_pipe;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.stop_pipe[0], &event);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_t *workers = (pthread_t*)calloc(threads, sizeof(pthread_t));
+    unsigned started = 0;
+    while (workers && started < threads && pthread_create(&workers[started], NULL, worker_main, NULL) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        printf("Error: Cannot start workers\n");
+        unlink(socket_path);
+        return 1;
+    }
+    fprintf(stderr, "lrsd: serving %s with %u workers\n", socket_path, started);
+
+    // Dispatch readiness until stopped
+    int running = 1;
+    while (running) {
+        struct epoll_event events[64];
+        int ready = epoll_wait(server.epoll_fd, events, 64, -1);
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.ptr == NULL) {
+                accept_connections();
+            } else if (events[i].data.ptr == &server.stop_pipe) {
+                running = 0;
+            } else {
+                queue_connection((conn_t*)events[i].data.ptr);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&server.lock);
+    server.shutdown = 1;
+    pthread_cond_broadcast(&server.ready);
+    pthread_mutex_unlock(&server.lock);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    close(server.listen_fd);
+    unlink(socket_path);
+
+    // Wipe every key the daemon held
+    for (size_t i = 0; i < LRSD_SESSIONS_MAX; i++) {
+        if (server.sessions[i].used) lrs_session_close(&server.sessions[i].session);
+    }
+    lrs_key_cache_disable();
+
+    fprintf(stderr, "lrsd: %llu connections, %llu requests (%llu errors), %llu session opens, %llu session hits\n",
+            (unsigned long long)server.stats.connections, (unsigned long long)server.stats.requests,
+            (unsigned long long)server.stats.errors, (unsigned long long)server.stats.session_opens,
+            (unsigned long long)server.stats.session_hits);
+    return 0;
+}